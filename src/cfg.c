@@ -0,0 +1,665 @@
+/**
+ * @file   cfg.c
+ * @author Kieran Colford <colfordk@gmail.com>
+ *
+ * @brief These are the control flow graphs that the dataflow passes
+ * of the optimizer work on.
+ *
+ * Copyright (C) 2014, 2015 Kieran Colford
+ *
+ * This file is part of Mongoose.
+ *
+ * Mongoose is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mongoose is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mongoose; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * @note The graph doesn't copy anything out of the function, the
+ * blocks point straight at its statements.  Any pass that changes
+ * which statements there are, or where control goes, has to build
+ * the graph again.
+ *
+ */
+
+#include "config.h"
+
+#include "ast.h"
+#include "ast_util.h"
+#include "cfg.h"
+#include "free.h"
+#include "lib.h"
+#include "parse.h"
+#include "xalloc.h"
+
+#include <assert.h>
+#include <string.h>
+
+/**
+ * Replace each nested scope in the list of statements at @c ss with
+ * the statements inside of it.
+ *
+ * @param ss A reference to the list.
+ */
+static void
+flatten (struct ast **ss)
+{
+  while (*ss != NULL)
+    {
+      struct ast *s = *ss;
+      if (s->type != block_type)
+	{
+	  ss = &s->next;
+	  continue;
+	}
+      *ss = ast_cat (s->ops[0], s->next);
+      s->ops[0] = NULL;
+      s->next = NULL;
+      AST_FREE (s);
+    }
+}
+
+/**
+ * Check if @c s is a variable in the frame, rather than a global
+ * symbol.  This includes the parameters.
+ *
+ * @param s The AST to check.
+ *
+ * @return true if it is, false otherwise.
+ */
+static int
+is_frame_var (const struct ast *s)
+{
+  return (s->type == variable_type && IS_MEMORY (s->loc)
+	  && s->loc->index == NULL && STREQ (s->loc->base, "%rbp"));
+}
+
+static int
+find_var (const struct cfg *g, int offset)
+{
+  int i;
+  for (i = 0; i < g->nvars; i++)
+    if (g->vars[i] == offset)
+      return i;
+  return -1;
+}
+
+/**
+ * Collect the variables of the frame that are used in @c s, along
+ * with the ones whose address is taken.
+ *
+ * @param g The graph to add the variables to.
+ * @param s The AST to scan.
+ * @param escaped The offsets of the variables whose address is
+ * taken.
+ * @param nescaped The number of them.
+ */
+static void
+scan_vars (struct cfg *g, const struct ast *s, int **escaped, int *nescaped)
+{
+  for (; s != NULL; s = s->next)
+    {
+      if (is_frame_var (s) && find_var (g, s->loc->offset) < 0)
+	{
+	  g->vars = xnrealloc (g->vars, g->nvars + 1, sizeof *g->vars);
+	  g->names = xnrealloc (g->names, g->nvars + 1, sizeof *g->names);
+	  g->vars[g->nvars] = s->loc->offset;
+	  g->names[g->nvars++] = xstrdup (s->op.variable.name);
+	}
+      else if (s->type == unary_type && s->op.unary.op == '&'
+	       && is_frame_var (s->ops[0]))
+	{
+	  *escaped = xnrealloc (*escaped, *nescaped + 1, sizeof **escaped);
+	  (*escaped)[(*nescaped)++] = s->ops[0]->loc->offset;
+	}
+      int i;
+      for (i = 0; i < s->num_ops; i++)
+	scan_vars (g, s->ops[i], escaped, nescaped);
+    }
+}
+
+/**
+ * Find the block that starts with the label @c l.
+ *
+ * @param g The graph.
+ * @param l The location of the label.
+ *
+ * @return The number of the block.
+ */
+static int
+find_label (const struct cfg *g, const struct loc *l)
+{
+  int b;
+  for (b = 0; b < g->nblocks; b++)
+    {
+      const struct ast *s = g->blocks[b].first;
+      if (s->type == label_type && STREQ (s->loc->base, l->base))
+	return b;
+    }
+  assert (! "this should not have been reached");
+  return -1;
+}
+
+/**
+ * Check if the statement @c s ends its basic block.
+ *
+ * @param s The statement.
+ *
+ * @return true if it does, false otherwise.
+ */
+static int
+ends_block (const struct ast *s)
+{
+  return s->type == cond_type || s->type == jump_type || s->type == ret_type;
+}
+
+static void
+add_pred (struct cfg_block *b, int p)
+{
+  b->preds = xnrealloc (b->preds, b->npreds + 1, sizeof *b->preds);
+  b->preds[b->npreds++] = p;
+}
+
+struct cfg *
+cfg_build (struct ast *s)
+{
+  assert (s->type == function_type);
+  assert (s->ops[1]->type == block_type);
+  flatten (&s->ops[1]->ops[0]);
+
+  struct cfg *g = xzalloc (sizeof *g);
+  g->function = s;
+
+  /* Split the body into blocks. */
+  struct ast *i;
+  for (i = s->ops[1]->ops[0]; i != NULL; i = i->next)
+    {
+      if (g->nblocks == 0 || i->type == label_type
+	  || ends_block (g->blocks[g->nblocks - 1].last))
+	{
+	  g->blocks = xnrealloc (g->blocks, g->nblocks + 1,
+				 sizeof *g->blocks);
+	  struct cfg_block *b = &g->blocks[g->nblocks++];
+	  b->first = i;
+	  b->succ[0] = b->succ[1] = -1;
+	  b->preds = NULL;
+	  b->npreds = 0;
+	  b->idom = -1;
+	}
+      g->blocks[g->nblocks - 1].last = i;
+    }
+
+  /* Connect them up. */
+  int b;
+  for (b = 0; b < g->nblocks; b++)
+    {
+      struct cfg_block *p = &g->blocks[b];
+      int next = b + 1 < g->nblocks ? b + 1 : -1;
+      switch (p->last->type)
+	{
+	case jump_type:
+	  p->succ[0] = find_label (g, p->last->loc);
+	  break;
+
+	case cond_type:
+	  p->succ[0] = next;
+	  p->succ[1] = find_label (g, p->last->loc);
+	  break;
+
+	case ret_type:
+	  break;
+
+	default:
+	  p->succ[0] = next;
+	}
+      int k;
+      for (k = 0; k < 2; k++)
+	if (p->succ[k] >= 0)
+	  add_pred (&g->blocks[p->succ[k]], b);
+    }
+
+  /* Find the variables, then drop the ones that escape. */
+  int *escaped = NULL, nescaped = 0;
+  scan_vars (g, s->ops[0], &escaped, &nescaped);
+  scan_vars (g, s->ops[1], &escaped, &nescaped);
+  int j;
+  for (j = 0; j < nescaped; j++)
+    {
+      int v = find_var (g, escaped[j]);
+      if (v >= 0)
+	{
+	  g->slots = xnrealloc (g->slots, g->nslots + 1, sizeof *g->slots);
+	  g->slots[g->nslots++] = escaped[j];
+	  FREE (g->names[v]);
+	  g->nvars--;
+	  g->vars[v] = g->vars[g->nvars];
+	  g->names[v] = g->names[g->nvars];
+	}
+    }
+  FREE (escaped);
+
+  return g;
+}
+
+void
+cfg_free (struct cfg *g)
+{
+  if (g == NULL)
+    return;
+  int b;
+  for (b = 0; b < g->nblocks; b++)
+    FREE (g->blocks[b].preds);
+  FREE (g->blocks);
+  int v;
+  for (v = 0; v < g->nvars; v++)
+    FREE (g->names[v]);
+  FREE (g->names);
+  FREE (g->vars);
+  FREE (g->slots);
+  FREE (g);
+}
+
+int
+cfg_var (const struct cfg *g, const struct ast *s)
+{
+  if (s == NULL || !is_frame_var (s))
+    return -1;
+  return find_var (g, s->loc->offset);
+}
+
+int
+cfg_slot (const struct cfg *g, const struct ast *s)
+{
+  int i;
+  if (s == NULL || !is_frame_var (s))
+    return -1;
+  for (i = 0; i < g->nslots; i++)
+    if (g->slots[i] == s->loc->offset)
+      return i;
+  return -1;
+}
+
+struct ast *
+cfg_stmt_expr (struct ast *s)
+{
+  switch (s->type)
+    {
+    case cond_type:
+    case ret_type:
+    case alloc_type:
+      return s->ops[0];
+
+    case label_type:
+    case jump_type:
+      return NULL;
+
+    case variable_type:
+      return s->op.variable.type == NULL ? s : NULL;
+
+    default:
+      return s;
+    }
+}
+
+/**
+ * Note what is changed by storing to the lvalue @c s.
+ *
+ * @param g The graph.
+ * @param s The lvalue.
+ * @param kill The set to add it to.
+ */
+static void
+store_kills (const struct cfg *g, const struct ast *s, char *kill)
+{
+  int v = cfg_var (g, s);
+  if (v >= 0)
+    kill[v] = 1;
+  else
+    kill[g->nvars] = 1;
+}
+
+void
+cfg_kills (const struct cfg *g, const struct ast *s, char *kill)
+{
+  switch (s->type)
+    {
+    case binary_type:
+      if (s->op.binary.op == '=')
+	store_kills (g, s->ops[0], kill);
+      break;
+
+    case unary_type:
+      if (s->op.unary.op == INC || s->op.unary.op == DEC)
+	store_kills (g, s->ops[0], kill);
+      break;
+
+    case function_call_type:
+      kill[g->nvars] = 1;
+      break;
+
+    default:
+      break;
+    }
+  int j;
+  for (j = 0; j < s->num_ops; j++)
+    {
+      const struct ast *i;
+      for (i = s->ops[j]; i != NULL; i = i->next)
+	cfg_kills (g, i, kill);
+    }
+}
+
+int
+cfg_step (const struct cfg *g, const struct ast *s, int v, long long *step)
+{
+  if (s->type == unary_type && (s->op.unary.op == INC
+				|| s->op.unary.op == DEC)
+      && cfg_var (g, s->ops[0]) == v)
+    {
+      *step = s->op.unary.op == INC ? 1 : -1;
+      return 1;
+    }
+  if (s->type != binary_type || s->op.binary.op != '='
+      || cfg_var (g, s->ops[0]) != v)
+    return 0;
+  const struct ast *e = s->ops[1];
+  if (e->type != binary_type || (e->op.binary.op != '+'
+				 && e->op.binary.op != '-')
+      || cfg_var (g, e->ops[0]) != v || e->ops[1]->type != integer_type)
+    return 0;
+  *step = e->ops[1]->op.integer.i;
+  if (e->op.binary.op == '-')
+    *step = -*step;
+  return 1;
+}
+
+void
+cfg_reads (const struct cfg *g, const struct ast *s, char *live)
+{
+  int j = cfg_var (g, s);
+  if (j >= 0)
+    {
+      live[j] = 1;
+      return;
+    }
+  /* Assigning to a variable doesn't read it. */
+  if (s->type == binary_type && s->op.binary.op == '='
+      && s->ops[0]->type == variable_type)
+    {
+      cfg_reads (g, s->ops[1], live);
+      return;
+    }
+  for (j = 0; j < s->num_ops; j++)
+    {
+      const struct ast *i;
+      for (i = s->ops[j]; i != NULL; i = i->next)
+	cfg_reads (g, i, live);
+    }
+}
+
+void
+cfg_transfer (const struct cfg *g, const struct ast *s, char *live)
+{
+  const struct ast *e = cfg_stmt_expr ((struct ast *) s);
+  if (e == NULL)
+    return;
+  if (e->type == binary_type && e->op.binary.op == '=')
+    {
+      int v = cfg_var (g, e->ops[0]);
+      if (v >= 0)
+	live[v] = 0;
+    }
+  cfg_reads (g, e, live);
+}
+
+struct ast **
+cfg_block_stmts (const struct cfg_block *b, int *n)
+{
+  struct ast *s, **out;
+  int m = 0;
+  CFG_FOREACH_STMT (s, b)
+    m++;
+  out = xcalloc (m + 1, sizeof *out);
+  *n = m;
+  m = 0;
+  CFG_FOREACH_STMT (s, b)
+    out[m++] = s;
+  return out;
+}
+
+void
+cfg_liveness (const struct cfg *g, char *ins, char *outs)
+{
+  int nb = g->nblocks, n = g->nvars, b, k, changed;
+  char *live = xzalloc (n + 1);
+  memset (ins, 0, (size_t) nb * n);
+  memset (outs, 0, (size_t) nb * n);
+  do
+    {
+      changed = 0;
+      for (b = nb - 1; b >= 0; b--)
+	{
+	  const struct cfg_block *blk = &g->blocks[b];
+	  int i, m;
+	  for (k = 0; k < 2; k++)
+	    if (blk->succ[k] >= 0)
+	      for (i = 0; i < n; i++)
+		outs[b * n + i] |= ins[blk->succ[k] * n + i];
+	  memcpy (live, &outs[b * n], n);
+	  struct ast **all = cfg_block_stmts (blk, &m);
+	  for (i = m - 1; i >= 0; i--)
+	    cfg_transfer (g, all[i], live);
+	  FREE (all);
+	  if (memcmp (live, &ins[b * n], n) != 0)
+	    {
+	      memcpy (&ins[b * n], live, n);
+	      changed = 1;
+	    }
+	}
+    }
+  while (changed);
+  FREE (live);
+}
+
+/**
+ * Number the blocks of @c g that can be reached in the order that a
+ * depth first search finishes with them.
+ *
+ * @param g The graph.
+ * @param post Where to store the number of each block, or -1 for the
+ * ones that can't be reached.
+ * @param order Where to store the blocks by their number.
+ *
+ * @return The number of blocks that can be reached.
+ */
+static int
+postorder (const struct cfg *g, int *post, int *order)
+{
+  int n = 0, depth = 0, b;
+  int *stack = xcalloc (g->nblocks, sizeof *stack);
+  int *edge = xcalloc (g->nblocks, sizeof *edge);
+  char *seen = xzalloc (g->nblocks);
+  for (b = 0; b < g->nblocks; b++)
+    post[b] = -1;
+
+  stack[depth++] = 0;
+  seen[0] = 1;
+  while (depth > 0)
+    {
+      b = stack[depth - 1];
+      if (edge[b] < 2)
+	{
+	  int t = g->blocks[b].succ[edge[b]++];
+	  if (t >= 0 && !seen[t])
+	    {
+	      seen[t] = 1;
+	      stack[depth++] = t;
+	    }
+	  continue;
+	}
+      depth--;
+      order[n] = b;
+      post[b] = n++;
+    }
+
+  FREE (seen);
+  FREE (edge);
+  FREE (stack);
+  return n;
+}
+
+void
+cfg_dominators (struct cfg *g)
+{
+  if (g->nblocks == 0)
+    return;
+  int *post = xcalloc (g->nblocks, sizeof *post);
+  int *order = xcalloc (g->nblocks, sizeof *order);
+  int n = postorder (g, post, order);
+  int b;
+  for (b = 0; b < g->nblocks; b++)
+    g->blocks[b].idom = -1;
+  g->blocks[0].idom = 0;
+
+  /* This is the iterative algorithm of Cooper, Harvey and Kennedy,
+     which walks up from two predecessors until they meet. */
+  int changed;
+  do
+    {
+      changed = 0;
+      int k;
+      for (k = n - 2; k >= 0; k--)
+	{
+	  struct cfg_block *blk = &g->blocks[order[k]];
+	  int idom = -1, p;
+	  for (p = 0; p < blk->npreds; p++)
+	    {
+	      int a = blk->preds[p];
+	      if (g->blocks[a].idom < 0)
+		continue;
+	      int c = idom;
+	      while (c >= 0 && a != c)
+		{
+		  while (post[a] < post[c])
+		    a = g->blocks[a].idom;
+		  while (post[c] < post[a])
+		    c = g->blocks[c].idom;
+		}
+	      idom = a;
+	    }
+	  if (blk->idom != idom)
+	    {
+	      blk->idom = idom;
+	      changed = 1;
+	    }
+	}
+    }
+  while (changed);
+
+  FREE (order);
+  FREE (post);
+}
+
+int
+cfg_dominates (const struct cfg *g, int a, int b)
+{
+  if (g->blocks[b].idom < 0)
+    return 0;
+  while (b != a && b != 0)
+    b = g->blocks[b].idom;
+  return b == a;
+}
+
+int
+cfg_loop (const struct cfg *g, int h, char *body)
+{
+  const struct cfg_block *hdr = &g->blocks[h];
+  int *stack = xcalloc (g->nblocks, sizeof *stack);
+  int depth = 0, n = 0, p;
+  for (p = 0; p < hdr->npreds; p++)
+    if (cfg_dominates (g, h, hdr->preds[p]) && !body[hdr->preds[p]])
+      {
+	body[hdr->preds[p]] = 1;
+	stack[depth++] = hdr->preds[p];
+	n++;
+      }
+  if (n == 0)
+    {
+      FREE (stack);
+      return 0;
+    }
+  if (!body[h])
+    {
+      body[h] = 1;
+      n++;
+    }
+  while (depth > 0)
+    {
+      const struct cfg_block *b = &g->blocks[stack[--depth]];
+      if (b == hdr)
+	continue;
+      for (p = 0; p < b->npreds; p++)
+	if (!body[b->preds[p]] && g->blocks[b->preds[p]].idom >= 0)
+	  {
+	    body[b->preds[p]] = 1;
+	    stack[depth++] = b->preds[p];
+	    n++;
+	  }
+    }
+  FREE (stack);
+  return n;
+}
+
+int
+cfg_preheader (const struct cfg *g, int h, const char *body)
+{
+  const struct cfg_block *hdr = &g->blocks[h];
+  if (h == 0 || hdr->first->type != label_type)
+    return 0;
+  const struct ast *last = g->blocks[h - 1].last;
+  if (body[h - 1] || last->type == jump_type || last->type == ret_type
+      || (last->type == cond_type
+	  && STREQ (last->loc->base, hdr->first->loc->base)))
+    return 0;
+  int p;
+  for (p = 0; p < hdr->npreds; p++)
+    if (!body[hdr->preds[p]] && hdr->preds[p] != h - 1)
+      return 0;
+  return 1;
+}
+
+struct ast *
+cfg_new_temp (struct cfg *g, char *name)
+{
+  struct ast *f = g->function;
+  int size = 0;
+  struct ast *i;
+  for (i = f->ops[0]; i != NULL; i = i->next)
+    if (i->type == variable_type)
+      size += i->op.variable.alloc;
+  for (i = f->ops[1]->ops[0]; i != NULL; i = i->next)
+    if (i->type == alloc_type && i->throw_away && i->ops[0] != NULL
+	&& i->ops[0]->type == integer_type)
+      size += i->ops[0]->op.integer.i;
+
+  /* Allocate it at the top of the body, like collect_vars does. */
+  struct ast *a = make_alloc (make_integer (8));
+  a->throw_away = 1;
+  a->next = f->ops[1]->ops[0];
+  if (g->nblocks > 0 && g->blocks[0].first == a->next)
+    g->blocks[0].first = a;
+  f->ops[1]->ops[0] = a;
+
+  struct ast *t = make_variable (NULL, name);
+  MAKE_BASE_LOC (t->loc, memory_loc, xstrdup ("%rbp"));
+  t->loc->offset = -(size + 8);
+  return t;
+}
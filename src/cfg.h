@@ -0,0 +1,282 @@
+/**
+ * @file   cfg.h
+ * @author Kieran Colford <colfordk@gmail.com>
+ *
+ * @brief This is the header file for the control flow graphs that the
+ * dataflow passes of the optimizer work on.
+ *
+ * Copyright (C) 2014, 2015 Kieran Colford
+ *
+ * This file is part of Mongoose.
+ *
+ * Mongoose is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mongoose is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mongoose; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef CFG_H
+#define CFG_H
+
+struct ast;
+
+/**
+ * A basic block, which is a run of consecutive statements in the
+ * body of a function that control only enters at the top of and only
+ * leaves at the bottom of.
+ *
+ */
+
+struct cfg_block
+{
+  struct ast *first;		/**< The first statement. */
+  struct ast *last;		/**< The last statement. */
+  int succ[2];			/**< The blocks that control goes to
+				   next, or -1.  The first is where
+				   control falls through or jumps to,
+				   the second is where a conditional
+				   goto at the end branches to. */
+  int *preds;			/**< The blocks that control comes
+				   from. */
+  int npreds;			/**< The number of predecessors. */
+  int idom;			/**< The immediate dominator, which is
+				   the block itself for the entry and
+				   -1 for a block that can't be
+				   reached.  Only filled in by
+				   cfg_dominators. */
+};
+
+/**
+ * The control flow graph of a function.
+ *
+ */
+
+struct cfg
+{
+  struct ast *function;		/**< The function that the graph is
+				   of. */
+  struct cfg_block *blocks;	/**< The basic blocks, in the order
+				   that they appear in the body.  The
+				   first one is the entry. */
+  int nblocks;			/**< The number of basic blocks. */
+  int *vars;			/**< The frame offsets of the variables
+				   that are tracked. */
+  char **names;			/**< The name of each tracked variable,
+				   or of one of them when several
+				   share the same slot. */
+  int nvars;			/**< The number of tracked
+				   variables. */
+  int *slots;			/**< The frame offsets of the variables
+				   whose address is taken. */
+  int nslots;			/**< The number of them. */
+};
+
+/**
+ * Loop over the statements of the block @c B.
+ *
+ * @param S The variable that holds each statement.
+ * @param B The block to loop over.
+ */
+#define CFG_FOREACH_STMT(S, B)					\
+  for ((S) = (B)->first; (S) != NULL;				\
+       (S) = (S) == (B)->last ? NULL : (S)->next)
+
+/**
+ * Build the control flow graph of the function @c s.  The nested
+ * scopes of its body are flattened first, since after the dealias
+ * pass they don't mean anything anymore.
+ *
+ * The variables that are tracked are the ones in the frame whose
+ * address is never taken, since those can only be changed by
+ * assigning to them by name.
+ *
+ * @param s The function.
+ *
+ * @return The new graph.
+ */
+extern struct cfg *cfg_build (struct ast *s);
+
+/**
+ * Free the graph @c g, leaving the function that it was built from
+ * alone.
+ *
+ * @param g The graph to free.
+ */
+extern void cfg_free (struct cfg *g);
+
+/**
+ * Get the number of the tracked variable that @c s refers to.
+ *
+ * @param g The graph.
+ * @param s The AST to check.
+ *
+ * @return The index of the variable in cfg::vars, or -1 if @c s isn't
+ * a tracked variable.
+ */
+extern int cfg_var (const struct cfg *g, const struct ast *s);
+
+/**
+ * Get the number of the variable whose address is taken that @c s
+ * refers to.  Besides being stored to by name, it can be changed by
+ * a store through a pointer or by a function call.
+ *
+ * @param g The graph.
+ * @param s The AST to check.
+ *
+ * @return The index of the variable in cfg::slots, or -1 if @c s
+ * isn't one of them.
+ */
+extern int cfg_slot (const struct cfg *g, const struct ast *s);
+
+/**
+ * Get the expression that the statement @c s evaluates.
+ *
+ * This is the statement itself for an expression statement.
+ *
+ * @param s The statement.
+ *
+ * @return The expression, or NULL if there isn't one.
+ */
+extern struct ast *cfg_stmt_expr (struct ast *s);
+
+/**
+ * Note which of the tracked variables of @c g are changed by
+ * evaluating @c s, and whether memory is.  A store through a pointer,
+ * to a variable that isn't tracked, or by a function call changes
+ * memory as a whole.
+ *
+ * @param g The graph.
+ * @param s The expression.
+ * @param kill The set to add them to, with one entry for each tracked
+ * variable and one more after them for memory.
+ */
+extern void cfg_kills (const struct cfg *g, const struct ast *s, char *kill);
+
+/**
+ * Check if the statement @c s adds a literal to the tracked variable
+ * @c v, like v++ or v -= 2 does.
+ *
+ * @param g The graph.
+ * @param s The statement.
+ * @param v The variable.
+ * @param step Where to store what it adds.
+ *
+ * @return true if it does, false otherwise.
+ */
+extern int cfg_step (const struct cfg *g, const struct ast *s, int v,
+		     long long *step);
+
+/**
+ * Note the tracked variables of @c g that @c s reads.
+ *
+ * @param g The graph.
+ * @param s The expression.
+ * @param live The set to add them to.
+ */
+extern void cfg_reads (const struct cfg *g, const struct ast *s,
+		       char *live);
+
+/**
+ * Move the set of the tracked variables of @c g that are live from
+ * after the statement @c s to before it.
+ *
+ * @param g The graph.
+ * @param s The statement.
+ * @param live The live variables.
+ */
+extern void cfg_transfer (const struct cfg *g, const struct ast *s,
+			  char *live);
+
+/**
+ * Get the statements of the block @c b as an array, so that they can
+ * be walked from the bottom up.
+ *
+ * @param b The block.
+ * @param n Where to store the number of statements.
+ *
+ * @return The statements, which must be freed.
+ */
+extern struct ast **cfg_block_stmts (const struct cfg_block *b, int *n);
+
+/**
+ * Find the tracked variables of @c g that are live into and out of
+ * each block, which are the ones that are read along some path from
+ * there before they are stored to.
+ *
+ * @param g The graph.
+ * @param ins Where to store the ones that are live into each block,
+ * with cfg::nvars entries for each block.
+ * @param outs Where to store the ones that are live out of them.
+ */
+extern void cfg_liveness (const struct cfg *g, char *ins, char *outs);
+
+/**
+ * Find the immediate dominator of each block of @c g, which is the
+ * closest block that every path from the entry to it goes through.
+ *
+ * @param g The graph.
+ */
+extern void cfg_dominators (struct cfg *g);
+
+/**
+ * Check if block @c a dominates block @c b.  The dominators have to
+ * have been found first.
+ *
+ * @param g The graph.
+ * @param a The dominating block.
+ * @param b The dominated block.
+ *
+ * @return true if it does, false otherwise.
+ */
+extern int cfg_dominates (const struct cfg *g, int a, int b);
+
+/**
+ * Find the natural loop whose header is the block @c h, which is
+ * made of @c h and every block that can get back to it along a back
+ * edge without going through it.  The dominators have to have been
+ * found first.
+ *
+ * @param g The graph.
+ * @param h The header.
+ * @param body Where to mark the blocks of the loop.
+ *
+ * @return The number of blocks in the loop, or 0 if @c h isn't the
+ * header of one.
+ */
+extern int cfg_loop (const struct cfg *g, int h, char *body);
+
+/**
+ * Check if the loop whose header is @c h is only entered by falling
+ * through into it from the block just before.  Then whatever is put
+ * just before the label of the header is run once each time that
+ * the loop is entered.
+ *
+ * @param g The graph.
+ * @param h The header.
+ * @param body The blocks of the loop.
+ *
+ * @return true if it is, false otherwise.
+ */
+extern int cfg_preheader (const struct cfg *g, int h, const char *body);
+
+/**
+ * Give the function of @c g a new slot in its frame.
+ *
+ * @param g The graph.
+ * @param name The name to give the slot.
+ *
+ * @return A variable that refers to the new slot.
+ */
+extern struct ast *cfg_new_temp (struct cfg *g, char *name);
+
+#endif
@@ -64,6 +64,7 @@ collect_vars_r (struct ast *s)
       if (s->ops[0]->type == integer_type)
 	{
 	  vars = make_alloc (s->ops[0]);
+	  vars->throw_away = 1;
 	  s->ops[0] = NULL;
 	}
       break;
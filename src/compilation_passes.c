@@ -38,7 +38,17 @@ run_compilation_passes (struct ast **ss)
   ret = ret || transform (ss);
   ret = ret || dealias (ss);
   ret = ret || collect_vars (*ss);
+  ret = ret || inliner (ss);
+  ret = ret || constprop (*ss);
   ret = ret || optimizer (ss);
+  ret = ret || ifconv (*ss);
+  ret = ret || rotate (*ss);
+  ret = ret || unroll (*ss);
+  ret = ret || licm (*ss);
+  ret = ret || ivsr (*ss);
+  ret = ret || gvn (*ss);
+  ret = ret || dce (*ss);
+  ret = ret || slots (*ss);
   ret = ret || gen_code (*ss);
   AST_FREE (*ss);
   return ret;
@@ -87,6 +87,9 @@ struct argp_option opts[] = {
     N_("Issue debuging data on the parser.") },
   { NULL,       'O',    "n", OPTION_ARG_OPTIONAL,
     N_("Control the optimization level (starts at 0, default is 1)") },
+  { NULL,       'f', "FLAG",                   0,
+    N_("Control code generation, FLAG is one of omit-frame-pointer or"
+       " no-omit-frame-pointer") },
   { "echo",     'e',   NULL,                   0,
     N_("Echo all assembly to stdout") },
   { NULL,       'c',   NULL,                   0,
@@ -125,6 +128,7 @@ arg_parse (int key, char *arg, struct argp_state *state)
 
     case 'v':
       debug = -1;
+      verbose = 1;
       break;
       
     case 'd':
@@ -138,6 +142,15 @@ arg_parse (int key, char *arg, struct argp_state *state)
 	optimize = strtol (arg, NULL, 0);
       break;
 
+    case 'f':
+      if (STREQ (arg, "omit-frame-pointer"))
+	omit_frame_pointer = 1;
+      else if (STREQ (arg, "no-omit-frame-pointer"))
+	omit_frame_pointer = 0;
+      else
+	argp_error (state, _("unrecognized option '-f%s'"), arg);
+      break;
+
     case 'e':
       debug = -1;
       break;
@@ -157,6 +170,7 @@ arg_parse (int key, char *arg, struct argp_state *state)
     case 'q':
       debug = 0;
       yydebug = 0;
+      verbose = 0;
       break;
 
     case ARGP_KEY_ARG:
@@ -49,6 +49,13 @@
  */
 #define BUILTIN(NAME) ("__builtin_" #NAME)
 
+/**
+ * The number of function arguments that are passed through registers.
+ * Any arguments after these are passed on the stack, just above the
+ * return address.
+ */
+#define REGISTER_ARGS 6
+
 extern FILE *yyin;		/**< The input stream for the
 				   lexer. */
 extern FILE *outfile;		/**< The output stream for the
@@ -69,12 +76,19 @@ extern int yylineno;		/**< The current line number as
 extern int optimize;		/**< A flag describing the
 				   optimization levels that each phase
 				   must adhere to. */
+extern int omit_frame_pointer;	/**< A flag that if true frees %rbp
+				   from holding the frame pointer so
+				   it can be used as a general
+				   register. */
 extern int yydebug;		/**< A flag that if true will cause
 				   the Yacc parser to issue debugging
 				   output. */
 extern int debug;		/**< A flag that if true says that all
 				   assembly will be echoed to
 				   stdout. */
+extern int verbose;		/**< A flag that if true says that
+				   statistics about the optimizations
+				   will be reported. */
 
 extern char stop;		/**< A character that defines how far
 				   the compiler should go during its
@@ -100,6 +114,173 @@ extern int gen_code (struct ast *s);
  */
 extern int optimizer (struct ast **ss);
 
+/** 
+ * The function inlining pass, which replaces the calls to small
+ * functions of the same file with copies of their bodies.
+ * 
+ * @param ss A reference to the AST to operate on.
+ * 
+ * @return Error code.
+ */
+extern int inliner (struct ast **ss);
+
+/** 
+ * The constant and copy propagation pass, which follows the values of
+ * the variables through the control flow of each function and
+ * replaces the uses of them that are known.
+ * 
+ * @param s The AST to operate on.
+ * 
+ * @return Error code.
+ */
+extern int constprop (struct ast *s);
+
+/** 
+ * The if-conversion pass, which turns the if statements that choose
+ * between two cheap values into conditional moves.
+ * 
+ * @param s The AST to operate on.
+ * 
+ * @return Error code.
+ */
+extern int ifconv (struct ast *s);
+
+/** 
+ * The loop rotation pass, which moves the test of each while loop to
+ * the bottom, behind a guard, so that every trip around takes only
+ * one branch.
+ * 
+ * @param s The AST to operate on.
+ * 
+ * @return Error code.
+ */
+extern int rotate (struct ast *s);
+
+/** 
+ * The loop unrolling pass, which copies the bodies of small counted
+ * loops so that they test and branch less often.
+ * 
+ * @param s The AST to operate on.
+ * 
+ * @return Error code.
+ */
+extern int unroll (struct ast *s);
+
+/** 
+ * The loop invariant code motion pass, which computes the
+ * expressions that don't change inside of a loop once before it.
+ * 
+ * @param s The AST to operate on.
+ * 
+ * @return Error code.
+ */
+extern int licm (struct ast *s);
+
+/** 
+ * The induction variable strength reduction pass, which walks a
+ * pointer through the arrays that a loop indexes with its counter.
+ * 
+ * @param s The AST to operate on.
+ * 
+ * @return Error code.
+ */
+extern int ivsr (struct ast *s);
+
+/** 
+ * The value numbering pass, which makes each function compute the
+ * expressions that it repeats only once.
+ * 
+ * @param s The AST to operate on.
+ * 
+ * @return Error code.
+ */
+extern int gvn (struct ast *s);
+
+/** 
+ * The dead code elimination pass, which takes out the statements
+ * that can't be reached or whose results are never used.
+ * 
+ * @param s The AST to operate on.
+ * 
+ * @return Error code.
+ */
+extern int dce (struct ast *s);
+
+/** 
+ * The stack slot coloring pass, which lets the local variables whose
+ * live ranges don't overlap share their slots in the frame.
+ * 
+ * @param s The AST to operate on.
+ * 
+ * @return Error code.
+ */
+extern int slots (struct ast *s);
+
+/** 
+ * Evaluate the binary operator @c op on two integers the way that the
+ * generated code would.
+ * 
+ * @param op The operator.
+ * @param l The left operand.
+ * @param r The right operand.
+ * @param res Where to store the result.
+ * 
+ * @return true if it could be evaluated, false otherwise.
+ */
+extern int fold_binary (int op, long long l, long long r, long long *res);
+
+/** 
+ * Evaluate the unary operator @c op on an integer the way that the
+ * generated code would.
+ * 
+ * @param op The operator.
+ * @param a The operand.
+ * @param res Where to store the result.
+ * 
+ * @return true if it could be evaluated, false otherwise.
+ */
+extern int fold_unary (int op, long long a, long long *res);
+
+/** 
+ * Check if evaluating @c s has any effects besides its value.
+ * 
+ * @param s The AST to check, not counting the ones after it.
+ * 
+ * @return true if it does, false otherwise.
+ */
+extern int has_side_effects (const struct ast *s);
+
+/** 
+ * Check if the address of a label is taken anywhere in @c s or the
+ * ASTs after it.
+ * 
+ * @param s The AST to check.
+ * @param base The location of the label, or NULL for any label.
+ * 
+ * @return true if it is, false otherwise.
+ */
+extern int takes_label_address (const struct ast *s, const char *base);
+
+/** 
+ * Check if @c a and @c b are the same expression.
+ * 
+ * @param a The first AST.
+ * @param b The second AST.
+ * 
+ * @return true if they are, false otherwise.
+ */
+extern int same_tree (const struct ast *a, const struct ast *b);
+
+/** 
+ * Check if the value of @c s is worth saving in the frame to be used
+ * again, rather than being computed again.
+ * 
+ * @param s The expression.
+ * 
+ * @return true if it is, false otherwise.
+ */
+extern int worth_saving (const struct ast *s);
+
 /** 
  * The transformation pass for the lower level passes.
  * 
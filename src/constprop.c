@@ -0,0 +1,590 @@
+/**
+ * @file   constprop.c
+ * @author Kieran Colford <colfordk@gmail.com>
+ *
+ * @brief This is the constant and copy propagation pass.
+ *
+ * Copyright (C) 2014, 2015 Kieran Colford
+ *
+ * This file is part of Mongoose.
+ *
+ * Mongoose is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mongoose is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mongoose; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * @note This is sparse conditional constant propagation done over the
+ * basic blocks of each function rather than over SSA form.  A block
+ * is only looked at once an edge into it is known to be taken, so the
+ * values coming out of a branch whose condition is constant never
+ * reach the side that isn't taken.  The uses that end up with a known
+ * value are replaced by it, and the optimizer pass that follows folds
+ * what that leaves behind, including the conditional gotos.
+ *
+ */
+
+#include "config.h"
+
+#include "ast.h"
+#include "ast_util.h"
+#include "cfg.h"
+#include "compiler.h"
+#include "free.h"
+#include "lib.h"
+#include "parse.h"
+#include "xalloc.h"
+
+#include <assert.h>
+#include <string.h>
+
+/**
+ * What is known about the value of a variable or an expression.
+ *
+ */
+
+struct cp_val
+{
+  enum {
+    cp_top,			/**< Nothing yet, since no path to it
+				   has been followed. */
+    cp_const,			/**< The integer cp_val::c. */
+    cp_copy,			/**< Whatever the tracked variable
+				   cp_val::var currently holds. */
+    cp_bottom			/**< Anything at all. */
+  } kind;			/**< How much is known. */
+  long long c;			/**< The constant. */
+  int var;			/**< The variable that it is a copy
+				   of. */
+};
+
+static const struct cfg *graph;	/**< The function being
+				   propagated through. */
+static int *mods;		/**< How many times the current
+				   statement changes each variable. */
+static int root_var;		/**< The variable that the current
+				   statement as a whole assigns to, or
+				   -1. */
+
+static struct cp_val
+make_val (int kind, long long c, int var)
+{
+  struct cp_val v;
+  v.kind = kind;
+  v.c = c;
+  v.var = var;
+  return v;
+}
+
+static int
+val_eq (struct cp_val a, struct cp_val b)
+{
+  if (a.kind != b.kind)
+    return 0;
+  if (a.kind == cp_const)
+    return a.c == b.c;
+  if (a.kind == cp_copy)
+    return a.var == b.var;
+  return 1;
+}
+
+static struct cp_val
+meet (struct cp_val a, struct cp_val b)
+{
+  if (a.kind == cp_top)
+    return b;
+  if (b.kind == cp_top)
+    return a;
+  if (val_eq (a, b))
+    return a;
+  return make_val (cp_bottom, 0, -1);
+}
+
+/**
+ * Get the variable that @c s changes, if @c s is an assignment or an
+ * increment of one.
+ *
+ * @param s The AST to check.
+ *
+ * @return The variable, or -1.
+ */
+static int
+assigned_var (const struct ast *s)
+{
+  if (s->type == binary_type && s->op.binary.op == '=')
+    return cfg_var (graph, s->ops[0]);
+  if (s->type == unary_type && (s->op.unary.op == INC
+				|| s->op.unary.op == DEC))
+    return cfg_var (graph, s->ops[0]);
+  return -1;
+}
+
+static void
+count_mods (const struct ast *s)
+{
+  int v = assigned_var (s);
+  if (v >= 0)
+    mods[v]++;
+  int j;
+  for (j = 0; j < s->num_ops; j++)
+    {
+      const struct ast *i;
+      for (i = s->ops[j]; i != NULL; i = i->next)
+	count_mods (i);
+    }
+}
+
+/**
+ * Get ready to look at the statement whose expression is @c e.
+ *
+ * @param e The expression, or NULL.
+ */
+static void
+begin_stmt (const struct ast *e)
+{
+  memset (mods, 0, graph->nvars * sizeof *mods);
+  root_var = -1;
+  if (e == NULL)
+    return;
+  count_mods (e);
+  root_var = assigned_var (e);
+}
+
+/**
+ * Check if the variable @c v can be read in the current statement.
+ * The order in which the parts of an expression are evaluated isn't
+ * known, so a variable that is changed in the middle of it can't be,
+ * except for reading it to compute what the whole statement assigns
+ * to it.
+ *
+ * @param v The variable.
+ *
+ * @return true if it can, false otherwise.
+ */
+static int
+readable (int v)
+{
+  return mods[v] == 0 || (mods[v] == 1 && v == root_var);
+}
+
+static void
+assign (struct cp_val *out, int v, struct cp_val x)
+{
+  if (mods[v] != 1 || (x.kind == cp_copy && x.var == v))
+    x = make_val (cp_bottom, 0, -1);
+  out[v] = x;
+}
+
+static struct cp_val eval (const struct ast *s, const struct cp_val *in,
+			   struct cp_val *out);
+
+/**
+ * Evaluate the expressions inside of @c s, but not @c s itself.
+ *
+ * @param s The AST.
+ * @param in The values of the variables before the statement.
+ * @param out Where the values that the statement assigns are stored.
+ */
+static void
+eval_inside (const struct ast *s, const struct cp_val *in,
+	     struct cp_val *out)
+{
+  int j;
+  for (j = 0; j < s->num_ops; j++)
+    {
+      const struct ast *i;
+      for (i = s->ops[j]; i != NULL; i = i->next)
+	eval (i, in, out);
+    }
+}
+
+static struct cp_val
+eval_binary (const struct ast *s, const struct cp_val *in,
+	     struct cp_val *out)
+{
+  struct cp_val bottom = make_val (cp_bottom, 0, -1);
+  if (s->op.binary.op == '=')
+    {
+      struct cp_val x = eval (s->ops[1], in, out);
+      int v = cfg_var (graph, s->ops[0]);
+      if (v >= 0)
+	assign (out, v, x);
+      else
+	eval_inside (s->ops[0], in, out);
+      return x;
+    }
+
+  struct cp_val l = eval (s->ops[0], in, out);
+  struct cp_val r = eval (s->ops[1], in, out);
+  long long res;
+  if (l.kind == cp_const && r.kind == cp_const
+      && fold_binary (s->op.binary.op, l.c, r.c, &res))
+    return make_val (cp_const, res, -1);
+  if (l.kind == cp_top || r.kind == cp_top)
+    return make_val (cp_top, 0, -1);
+  return bottom;
+}
+
+static struct cp_val
+eval_unary (const struct ast *s, const struct cp_val *in, struct cp_val *out)
+{
+  struct cp_val bottom = make_val (cp_bottom, 0, -1);
+  int op = s->op.unary.op;
+  if (op == INC || op == DEC)
+    {
+      int v = cfg_var (graph, s->ops[0]);
+      if (v < 0)
+	{
+	  eval_inside (s->ops[0], in, out);
+	  return bottom;
+	}
+      struct cp_val old = mods[v] == 1 ? in[v] : bottom, next = bottom;
+      if (old.kind == cp_const)
+	next = make_val (cp_const, (unsigned long long) old.c
+			 + (op == INC ? 1 : -1), -1);
+      else if (old.kind != cp_top)
+	old = bottom;
+      assign (out, v, next);
+      return s->unary_prefix ? next : old;
+    }
+
+  struct cp_val a = eval (s->ops[0], in, out);
+  long long res;
+  if (a.kind == cp_const && fold_unary (op, a.c, &res))
+    return make_val (cp_const, res, -1);
+  if (a.kind == cp_top && (op == '-' || op == '~'))
+    return a;
+  return bottom;
+}
+
+/**
+ * Evaluate the expression @c s.
+ *
+ * @param s The expression, not counting the ones after it.
+ * @param in The values of the variables before the statement.
+ * @param out Where the values that the statement assigns are stored.
+ *
+ * @return The value of @c s.
+ */
+static struct cp_val
+eval (const struct ast *s, const struct cp_val *in, struct cp_val *out)
+{
+  struct cp_val x = make_val (cp_bottom, 0, -1);
+  int v;
+  switch (s->type)
+    {
+    case integer_type:
+      x = make_val (cp_const, s->op.integer.i, -1);
+      break;
+
+    case variable_type:
+      v = cfg_var (graph, s);
+      if (v >= 0 && readable (v))
+	{
+	  x = in[v];
+	  if (x.kind == cp_bottom)
+	    x = make_val (cp_copy, 0, v);
+	}
+      break;
+
+    case binary_type:
+      x = eval_binary (s, in, out);
+      break;
+
+    case unary_type:
+      x = eval_unary (s, in, out);
+      break;
+
+    case ternary_type:
+      {
+	struct cp_val c = eval (s->ops[0], in, out);
+	struct cp_val a = eval (s->ops[1], in, out);
+	struct cp_val b = eval (s->ops[2], in, out);
+	if (c.kind == cp_const)
+	  x = c.c ? a : b;
+	else if (c.kind == cp_top)
+	  x = c;
+	else
+	  x = a.kind == cp_top || b.kind == cp_top ? x : meet (a, b);
+      }
+      break;
+
+    default:
+      eval_inside (s, in, out);
+    }
+
+  if (s->boolean_not)
+    {
+      if (x.kind == cp_const)
+	x.c = !x.c;
+      else if (x.kind != cp_top)
+	x = make_val (cp_bottom, 0, -1);
+    }
+  return x;
+}
+
+/**
+ * Run the statement @c s over the values of the variables in @c
+ * state.
+ *
+ * @param s The statement.
+ * @param state The values before it, which are replaced by the
+ * values after it.
+ *
+ * @return The value of the expression that @c s evaluates.
+ */
+static struct cp_val
+transfer (struct ast *s, struct cp_val *state)
+{
+  struct ast *e = cfg_stmt_expr (s);
+  begin_stmt (e);
+  if (e == NULL)
+    return make_val (cp_bottom, 0, -1);
+
+  struct cp_val *in = xmemdup (state, graph->nvars * sizeof *state);
+  struct cp_val x = eval (e, in, state);
+  FREE (in);
+
+  /* Anything that was a copy of a variable that changed isn't
+     anymore. */
+  int v, w;
+  for (v = 0; v < graph->nvars; v++)
+    if (mods[v] > 0)
+      for (w = 0; w < graph->nvars; w++)
+	if (state[w].kind == cp_copy && state[w].var == v)
+	  state[w] = make_val (cp_bottom, 0, -1);
+  return x;
+}
+
+/**
+ * Replace the expression at @c ss with what is known about it, or
+ * failing that, the expressions inside of it.
+ *
+ * @param ss A reference to the expression.
+ * @param in The values of the variables before the statement.
+ * @param scratch Room for the values that the statement assigns.
+ */
+static void rewrite (struct ast **ss, const struct cp_val *in,
+		     struct cp_val *scratch);
+
+/**
+ * Rewrite the expressions inside of @c s, leaving @c s itself and the
+ * variables that it assigns to alone.
+ *
+ * @param s The expression.
+ * @param in The values of the variables before the statement.
+ * @param scratch Room for the values that the statement assigns.
+ */
+static void
+rewrite_inside (struct ast *s, const struct cp_val *in,
+		struct cp_val *scratch)
+{
+  int j;
+  for (j = 0; j < s->num_ops; j++)
+    {
+      struct ast **i;
+      for (i = &s->ops[j]; *i != NULL; i = &(*i)->next)
+	{
+	  if (j == 0 && assigned_var (s) >= 0)
+	    continue;
+	  if (j == 0 && s->type == binary_type && s->op.binary.op == '=')
+	    rewrite_inside (*i, in, scratch);
+	  else if (j == 0 && s->type == unary_type
+		   && (s->op.unary.op == INC || s->op.unary.op == DEC
+		       || s->op.unary.op == '&'))
+	    rewrite_inside (*i, in, scratch);
+	  else
+	    rewrite (i, in, scratch);
+	}
+    }
+}
+
+static void
+rewrite (struct ast **ss, const struct cp_val *in, struct cp_val *scratch)
+{
+  struct ast *s = *ss;
+  if (s->type == variable_type && s->op.variable.type != NULL)
+    return;
+
+  struct cp_val x = eval (s, in, scratch);
+  if (x.kind == cp_const && s->type != integer_type && !has_side_effects (s))
+    {
+      struct ast *t = make_integer (x.c);
+      t->throw_away = s->throw_away;
+      SWAP_AST (*ss, t);
+      AST_FREE (t);
+      return;
+    }
+
+  int v = cfg_var (graph, s);
+  if (v >= 0)
+    {
+      /* Read the variable that this one is a copy of instead. */
+      if (readable (v) && in[v].kind == cp_copy && in[v].var != v
+	  && readable (in[v].var))
+	{
+	  int w = in[v].var;
+	  s->loc->offset = graph->vars[w];
+	  FREE (s->op.variable.name);
+	  s->op.variable.name = xstrdup (graph->names[w]);
+	}
+      return;
+    }
+
+  rewrite_inside (s, in, scratch);
+}
+
+/**
+ * Replace what is known in the statement @c s.
+ *
+ * @param s The statement.
+ * @param in The values of the variables before it.
+ */
+static void
+rewrite_stmt (struct ast *s, const struct cp_val *in)
+{
+  struct ast *e = cfg_stmt_expr (s);
+  begin_stmt (e);
+  if (e == NULL)
+    return;
+  struct cp_val *scratch = xmemdup (in, graph->nvars * sizeof *in);
+  if (e == s)
+    rewrite_inside (s, in, scratch);
+  else
+    rewrite (&s->ops[0], in, scratch);
+  FREE (scratch);
+}
+
+/**
+ * Compute the values coming into the block @c b.
+ *
+ * @param b The block.
+ * @param outs The values leaving each block.
+ * @param taken Which edges out of each block are known to be taken.
+ * @param in Where to store the values.
+ */
+static void
+block_in (int b, const struct cp_val *outs, const char *taken,
+	  struct cp_val *in)
+{
+  int n = graph->nvars, v, i, k;
+  for (v = 0; v < n; v++)
+    in[v] = make_val (b == 0 ? cp_bottom : cp_top, 0, -1);
+  const struct cfg_block *blk = &graph->blocks[b];
+  for (i = 0; i < blk->npreds; i++)
+    {
+      int p = blk->preds[i];
+      for (k = 0; k < 2; k++)
+	if (graph->blocks[p].succ[k] == b && taken[2 * p + k])
+	  for (v = 0; v < n; v++)
+	    in[v] = meet (in[v], outs[p * n + v]);
+    }
+}
+
+static void
+constprop_function (struct ast *f)
+{
+  struct cfg *g = cfg_build (f);
+  graph = g;
+  int n = g->nvars, nb = g->nblocks;
+  if (nb == 0)
+    {
+      cfg_free (g);
+      return;
+    }
+
+  mods = xcalloc (n + 1, sizeof *mods);
+  struct cp_val *outs = xcalloc ((size_t) nb * n + 1, sizeof *outs);
+  struct cp_val *state = xcalloc (n + 1, sizeof *state);
+  char *taken = xzalloc (2 * nb);
+  char *visited = xzalloc (nb);
+  char *queued = xzalloc (nb);
+  int *work = xcalloc (nb, sizeof *work);
+  int nwork = 0;
+
+  work[nwork++] = 0;
+  queued[0] = 1;
+  while (nwork > 0)
+    {
+      int b = work[--nwork];
+      queued[b] = 0;
+      const struct cfg_block *blk = &g->blocks[b];
+
+      block_in (b, outs, taken, state);
+      struct ast *s;
+      struct cp_val x = make_val (cp_bottom, 0, -1);
+      CFG_FOREACH_STMT (s, blk)
+	x = transfer (s, state);
+
+      int changed = !visited[b], v, k;
+      for (v = 0; v < n; v++)
+	if (!val_eq (state[v], outs[b * n + v]))
+	  changed = 1;
+      memcpy (&outs[b * n], state, n * sizeof *state);
+      visited[b] = 1;
+
+      for (k = 0; k < 2; k++)
+	{
+	  int t = blk->succ[k];
+	  if (t < 0)
+	    continue;
+	  /* Only follow the side of a conditional goto that its
+	     condition allows. */
+	  if (blk->last->type == cond_type
+	      && (x.kind == cp_top
+		  || (x.kind == cp_const && (x.c != 0) != k)))
+	    continue;
+	  if ((changed || !taken[2 * b + k]) && !queued[t])
+	    {
+	      work[nwork++] = t;
+	      queued[t] = 1;
+	    }
+	  taken[2 * b + k] = 1;
+	}
+    }
+
+  /* Now that everything is known, replace what we can in the blocks
+     that can be reached. */
+  int b;
+  for (b = 0; b < nb; b++)
+    {
+      if (!visited[b])
+	continue;
+      block_in (b, outs, taken, state);
+      struct ast *s;
+      CFG_FOREACH_STMT (s, &g->blocks[b])
+	{
+	  rewrite_stmt (s, state);
+	  transfer (s, state);
+	}
+    }
+
+  FREE (work);
+  FREE (queued);
+  FREE (visited);
+  FREE (taken);
+  FREE (state);
+  FREE (outs);
+  FREE (mods);
+  cfg_free (g);
+  graph = NULL;
+}
+
+int
+constprop (struct ast *s)
+{
+  if (optimize < 1)
+    return 0;
+  for (; s != NULL; s = s->next)
+    if (s->type == function_type)
+      constprop_function (s);
+  return 0;
+}
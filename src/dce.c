@@ -0,0 +1,292 @@
+/**
+ * @file   dce.c
+ * @author Kieran Colford <colfordk@gmail.com>
+ *
+ * @brief This is the dead code elimination pass.
+ *
+ * Copyright (C) 2014, 2015 Kieran Colford
+ *
+ * This file is part of Mongoose.
+ *
+ * Mongoose is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mongoose is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mongoose; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * @note A statement is dead when control can never reach it, when
+ * all it does is compute a value that is thrown away, or when it
+ * stores to a tracked variable that isn't live afterwards.  Labels
+ * that nothing jumps to, and jumps to the statement right after them,
+ * are dropped too.  Taking one of these out can make others dead, so
+ * the pass is repeated until nothing more changes.
+ *
+ */
+
+#include "config.h"
+
+#include "ast.h"
+#include "ast_util.h"
+#include "cfg.h"
+#include "compiler.h"
+#include "free.h"
+#include "lib.h"
+#include "parse.h"
+#include "xalloc.h"
+
+#include <assert.h>
+#include <string.h>
+
+static struct cfg *graph;	/**< The function being cleaned up. */
+static struct ast **doomed;	/**< The statements to take out. */
+static int ndoomed;		/**< The number of them. */
+static struct ast **stripped;	/**< The stores to take out, leaving
+				   the value that they store behind
+				   for its side effects. */
+static int nstripped;		/**< The number of them. */
+
+static int
+in_list (struct ast *const *l, int n, const struct ast *s)
+{
+  int i;
+  for (i = 0; i < n; i++)
+    if (l[i] == s)
+      return 1;
+  return 0;
+}
+
+static void
+doom (struct ast *s)
+{
+  if (in_list (doomed, ndoomed, s))
+    return;
+  doomed = xnrealloc (doomed, ndoomed + 1, sizeof *doomed);
+  doomed[ndoomed++] = s;
+}
+
+static void
+strip (struct ast *s)
+{
+  stripped = xnrealloc (stripped, nstripped + 1, sizeof *stripped);
+  stripped[nstripped++] = s;
+}
+
+/**
+ * Get the tracked variable that the statement @c s as a whole stores
+ * to.
+ *
+ * @param s The statement.
+ *
+ * @return The variable, or -1.
+ */
+static int
+stored_var (const struct ast *s)
+{
+  if (s->type == binary_type && s->op.binary.op == '=')
+    return cfg_var (graph, s->ops[0]);
+  return -1;
+}
+
+/**
+ * Decide if the statement @c s is dead, given the variables that are
+ * live after it, and then move the set to before it.
+ *
+ * @param s The statement.
+ * @param live The live variables.
+ */
+static void
+sweep (struct ast *s, char *live)
+{
+  if (cfg_stmt_expr (s) != s)
+    {
+      cfg_transfer (graph, s, live);
+      return;
+    }
+
+  if (!has_side_effects (s))
+    {
+      doom (s);
+      return;
+    }
+
+  int v = stored_var (s);
+  if (s->type == unary_type && (s->op.unary.op == INC
+				|| s->op.unary.op == DEC))
+    v = cfg_var (graph, s->ops[0]);
+  if (v < 0 || live[v])
+    {
+      cfg_transfer (graph, s, live);
+      return;
+    }
+
+  /* An array that is never used doesn't need its memory either. */
+  if (s->type == unary_type || s->ops[1]->type == alloc_type
+      || !has_side_effects (s->ops[1]))
+    doom (s);
+  else
+    {
+      strip (s);
+      cfg_reads (graph, s->ops[1], live);
+    }
+}
+
+/**
+ * Check if the label of the jump or conditional goto @c s is the
+ * statement right after it.
+ *
+ * @param s The statement.
+ *
+ * @return true if it is, false otherwise.
+ */
+static int
+jumps_to_next (const struct ast *s)
+{
+  return (s->next != NULL && s->next->type == label_type
+	  && STREQ (s->next->loc->base, s->loc->base));
+}
+
+/**
+ * Find the dead statements of the function @c f and take them out.
+ *
+ * @param f The function.
+ *
+ * @return true if anything was taken out, false otherwise.
+ */
+static int
+dce_once (struct ast *f)
+{
+  struct cfg *g = cfg_build (f);
+  graph = g;
+  int nb = g->nblocks, n = g->nvars, b, k;
+  if (nb == 0)
+    {
+      cfg_free (g);
+      return 0;
+    }
+
+  /* Find the blocks that can be reached. */
+  char *reached = xzalloc (nb);
+  int *stack = xcalloc (nb, sizeof *stack), depth = 0;
+  stack[depth++] = 0;
+  reached[0] = 1;
+  /* The labels whose addresses are taken can be gone to from
+     anywhere. */
+  for (b = 1; b < nb; b++)
+    if (g->blocks[b].first->type == label_type
+	&& takes_label_address (f->ops[1], g->blocks[b].first->loc->base))
+      {
+	reached[b] = 1;
+	stack[depth++] = b;
+      }
+  while (depth > 0)
+    {
+      const struct cfg_block *blk = &g->blocks[stack[--depth]];
+      for (k = 0; k < 2; k++)
+	if (blk->succ[k] >= 0 && !reached[blk->succ[k]])
+	  {
+	    reached[blk->succ[k]] = 1;
+	    stack[depth++] = blk->succ[k];
+	  }
+    }
+
+  /* Find the variables that are live into and out of each block. */
+  char *ins = xzalloc ((size_t) nb * n + 1);
+  char *outs = xzalloc ((size_t) nb * n + 1);
+  char *live = xzalloc (n + 1);
+  cfg_liveness (g, ins, outs);
+
+  /* Sweep each block from the bottom up. */
+  for (b = 0; b < nb; b++)
+    {
+      struct ast *s;
+      if (!reached[b])
+	{
+	  CFG_FOREACH_STMT (s, &g->blocks[b])
+	    doom (s);
+	  continue;
+	}
+      int m, i;
+      struct ast **all = cfg_block_stmts (&g->blocks[b], &m);
+      memcpy (live, &outs[b * n], n);
+      for (i = m - 1; i >= 0; i--)
+	sweep (all[i], live);
+      FREE (all);
+    }
+
+  /* Drop the jumps that go nowhere, then the labels that are left
+     with nothing jumping to them. */
+  struct ast **ss, *s;
+  for (s = f->ops[1]->ops[0]; s != NULL; s = s->next)
+    if ((s->type == jump_type
+	 || (s->type == cond_type && !has_side_effects (s->ops[0])))
+	&& jumps_to_next (s))
+      doom (s);
+  for (s = f->ops[1]->ops[0]; s != NULL; s = s->next)
+    {
+      if (s->type != label_type)
+	continue;
+      const struct ast *i;
+      for (i = f->ops[1]->ops[0]; i != NULL; i = i->next)
+	if ((i->type == jump_type || i->type == cond_type)
+	    && !in_list (doomed, ndoomed, i)
+	    && STREQ (i->loc->base, s->loc->base))
+	  break;
+      if (i == NULL && !takes_label_address (f->ops[1], s->loc->base))
+	doom (s);
+    }
+
+  int any = ndoomed > 0 || nstripped > 0;
+  for (ss = &f->ops[1]->ops[0]; *ss != NULL;)
+    {
+      s = *ss;
+      if (in_list (doomed, ndoomed, s))
+	{
+	  *ss = s->next;
+	  s->next = NULL;
+	  AST_FREE (s);
+	  continue;
+	}
+      if (in_list (stripped, nstripped, s))
+	{
+	  struct ast *t = s->ops[1];
+	  s->ops[1] = NULL;
+	  t->throw_away = 1;
+	  SWAP_AST (*ss, t);
+	  AST_FREE (t);
+	}
+      ss = &(*ss)->next;
+    }
+
+  FREE (doomed);
+  ndoomed = 0;
+  FREE (stripped);
+  nstripped = 0;
+  FREE (live);
+  FREE (outs);
+  FREE (ins);
+  FREE (stack);
+  FREE (reached);
+  cfg_free (g);
+  graph = NULL;
+  return any;
+}
+
+int
+dce (struct ast *s)
+{
+  if (optimize < 1)
+    return 0;
+  for (; s != NULL; s = s->next)
+    if (s->type == function_type)
+      while (dce_once (s))
+	;
+  return 0;
+}
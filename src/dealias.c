@@ -139,9 +139,12 @@ free_state (struct state_stack *s)
 static struct state_stack *state = NULL; /**< The current state
 					    level. */
 
-static int func_allocd = 0;	/**< The amount of memory that has so
-				   far been allocated for the
-				   function. */
+static int func_allocd = 0;	/**< The amount of memory that is
+				   allocated for the variables that
+				   are currently in scope. */
+static int func_allocd_max = 0;	/**< The most memory that was ever
+				   allocated at once for the function,
+				   which is the size of its frame. */
 static int curr_labelno = 1;	/**< The number of the next label that
 				   will be identified. */
 
@@ -163,6 +166,25 @@ add_to_state (const char *v, size_t s)
   FREE_LOC (l);
 }
 
+/**
+ * Add a parameter that was passed on the stack to the state.  It
+ * isn't allocated any memory since it can be used right where the
+ * caller left it.
+ *
+ * @param v The parameter name to be added.
+ * @param n The position of @c v among the stack parameters.
+ */
+static inline void
+add_stack_param_to_state (const char *v, int n)
+{
+  struct loc *l;
+  MAKE_BASE_LOC (l, memory_loc, xstrdup ("%rbp"));
+  /* Skip over the saved %rbp and the return address. */
+  l->offset = 16 + 8 * n;
+  gl_sortedlist_add (state->state, compare_entry, create_entry (v, l));
+  FREE_LOC (l);
+}
+
 /**
  * Search the state for an entry with the same key as l.  If one can't
  * be found, then it is an externally linked in symbol and is simply
@@ -221,6 +243,41 @@ get_label (char *l)
   return s;
 }
 
+/* Forward declaration for the parameter handling. */
+static void dealias_r (struct ast **ss);
+
+/**
+ * De-alias the parameter list of a function.  The parameters that
+ * arrive in registers are declared like any other variable, while
+ * the ones that arrive on the stack are left where they are.
+ *
+ * @param s The list of parameters.
+ */
+static void
+dealias_params (struct ast *s)
+{
+  int argnum = 0;
+  for (; s != NULL; s = s->next)
+    {
+      if (s->type != variable_type)
+	continue;
+      if (argnum < REGISTER_ARGS)
+	{
+	  struct ast *t = s->next;
+	  s->next = NULL;
+	  dealias_r (&s);
+	  s->next = ast_cat (s->next, t);
+	}
+      else
+	{
+	  add_stack_param_to_state (s->op.variable.name,
+				    argnum - REGISTER_ARGS);
+	  s->loc = get_from_state (s->op.variable.name);
+	}
+      argnum++;
+    }
+}
+
 static void
 dealias_r (struct ast **ss)
 {
@@ -233,14 +290,18 @@ dealias_r (struct ast **ss)
     {
     case block_type:
       state = create_state (state);
+      int allocd = func_allocd;
       dealias_r (&s->ops[0]);
       state = free_state (state);
+      /* The variables of this scope are dead now, so their slots can
+	 be handed out again to the ones that follow. */
+      func_allocd = allocd;
       break;
 
     case function_type:
-      func_allocd = 0;
+      func_allocd = func_allocd_max = 0;
       state = create_state (state);
-      dealias_r (&s->ops[0]);
+      dealias_params (s->ops[0]);
       dealias_r (&s->ops[1]);
       state = free_state (state);
       break;
@@ -248,9 +309,17 @@ dealias_r (struct ast **ss)
     case variable_type:
       if (s->op.variable.type != NULL)
 	{
-	  s->next = ast_cat (make_alloc (make_integer (8)), s->next);
 	  s->op.variable.alloc = 8;
 	  add_to_state (s->op.variable.name, 8);
+	  /* Only grow the frame when the variable doesn't fit in the
+	     slots that were freed by the scopes that came before. */
+	  if (func_allocd > func_allocd_max)
+	    {
+	      struct ast *a;
+	      a = make_alloc (make_integer (func_allocd - func_allocd_max));
+	      s->next = ast_cat (a, s->next);
+	      func_allocd_max = func_allocd;
+	    }
 	}
       s->loc = get_from_state (s->op.variable.name);
       assert (s->loc != NULL);
@@ -266,6 +335,11 @@ dealias_r (struct ast **ss)
       assert (s->loc != NULL);
       break;
 
+    case label_value_type:
+      s->loc = get_label (s->op.label_value.name);
+      assert (s->loc != NULL);
+      break;
+
     case cond_type:
       dealias_r (&s->ops[0]);
       s->loc = get_label (s->op.cond.name);
@@ -287,7 +361,7 @@ dealias (struct ast **ss)
   /* Nullify the global vars. */
   free_state (state);
   state = create_state (NULL);
-  func_allocd = 0;
+  func_allocd = func_allocd_max = 0;
   curr_labelno = 1;
 
   dealias_r (ss);
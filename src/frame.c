@@ -0,0 +1,145 @@
+/**
+ * @file   frame.c
+ * @author Kieran Colford <colfordk@gmail.com>
+ * 
+ * @brief This is the layout of stack frames.
+ * 
+ * Copyright (C) 2014, 2015 Kieran Colford
+ *
+ * This file is part of Mongoose.
+ *
+ * Mongoose is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mongoose is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Mongoose; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include "ast.h"
+#include "compiler.h"
+#include "frame.h"
+#include "lib.h"
+#include "xalloc.h"
+
+#include <assert.h>
+#include <string.h>
+
+/**
+ * The amount of memory below %rsp that the System V ABI guarantees
+ * won't be clobbered by signal handlers.
+ */
+#define RED_ZONE 128
+
+/** 
+ * Walk over the body of a function and find the memory that it
+ * allocates statically as well as the largest area needed for the
+ * arguments of the function calls that it makes, and whether the
+ * address of anything in the frame is taken.
+ * 
+ * @param s The AST to scan.
+ * @param f The frame to fill in.
+ */
+static void
+scan_frame (struct ast *s, struct frame *f)
+{
+  for (; s != NULL; s = s->next)
+    {
+      if (s->type == alloc_type && s->ops[0] != NULL)
+	{
+	  if (s->throw_away && s->ops[0]->type == integer_type)
+	    f->locals += s->ops[0]->op.integer.i;
+	  else
+	    f->dynamic = 1;
+	}
+      else if (s->type == function_call_type)
+	{
+	  int n = 0;
+	  struct ast *i;
+	  for (i = s->ops[1]; i != NULL; i = i->next)
+	    if (i->type != block_type)
+	      n++;
+	  n -= REGISTER_ARGS;
+	  if (n > 0 && 8 * n > f->outgoing)
+	    f->outgoing = 8 * n;
+	  f->leaf = 0;
+	}
+      else if (s->type == unary_type && s->op.unary.op == '&'
+	       && s->ops[0]->type == variable_type
+	       && IS_MEMORY (s->ops[0]->loc))
+	f->escapes = 1;
+      int i;
+      for (i = 0; i < s->num_ops; i++)
+	scan_frame (s->ops[i], f);
+    }
+}
+
+/** 
+ * Rewrite every location based on the frame pointer to be based on
+ * the stack pointer.
+ * 
+ * @param s The AST to rewrite.
+ * @param dist The distance from %rsp to the frame pointer.
+ */
+static void
+rebase_locs (struct ast *s, int dist)
+{
+  for (; s != NULL; s = s->next)
+    {
+      if (IS_MEMORY (s->loc) && STREQ (s->loc->base, "%rbp"))
+	{
+	  FREE (s->loc->base);
+	  s->loc->base = xstrdup ("%rsp");
+	  s->loc->offset += dist;
+	}
+      int i;
+      for (i = 0; i < s->num_ops; i++)
+	rebase_locs (s->ops[i], dist);
+    }
+}
+
+void
+frame_layout (struct ast *s, struct frame *f)
+{
+  assert (s->type == function_type);
+  memset (f, 0, sizeof *f);
+  f->leaf = 1;
+
+  struct ast *i;
+  for (i = s->ops[0]; i != NULL; i = i->next)
+    if (i->type == variable_type)
+      f->params += i->op.variable.alloc;
+  scan_frame (s->ops[1], f);
+
+  /* Dynamic allocations move %rsp, so they need a frame pointer to
+     find anything. */
+  f->omit_fp = omit_frame_pointer && !f->dynamic;
+
+  /* A leaf function can leave its frame in the red zone.  Without a
+     frame pointer we also need room there to save %rbp in case it is
+     used. */
+  int used = f->params + f->locals + f->outgoing;
+  if (f->leaf && !f->dynamic && used + (f->omit_fp ? 8 : 0) <= RED_ZONE)
+    f->red_zone = 1;
+  else
+    f->size = (used + 15) / 16 * 16;
+
+  /* The stack pointer sits where %rbp would have been pushed, less
+     the size of the frame. */
+  if (f->omit_fp)
+    {
+      f->rsp_offset = f->red_zone ? -8 : f->size;
+      rebase_locs (s->ops[0], f->rsp_offset);
+      rebase_locs (s->ops[1], f->rsp_offset);
+    }
+}
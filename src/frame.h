@@ -0,0 +1,77 @@
+/**
+ * @file   frame.h
+ * @author Kieran Colford <colfordk@gmail.com>
+ * 
+ * @brief This is the header file for the layout of stack frames.
+ * 
+ * Copyright (C) 2014, 2015 Kieran Colford
+ *
+ * This file is part of Mongoose.
+ *
+ * Mongoose is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mongoose is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Mongoose; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef FRAME_H
+#define FRAME_H
+
+struct ast;
+
+/**
+ * The layout of a function's stack frame.
+ *
+ * Everything in the frame is addressed relative to where %rbp would
+ * point if it held the frame pointer: the spilled register
+ * parameters, the local variables, and finally the outgoing argument
+ * area at the very bottom.
+ * 
+ */
+
+struct frame
+{
+  int params;			/**< Memory for the parameters passed
+				   through registers. */
+  int locals;			/**< Memory for the local variables. */
+  int outgoing;			/**< Memory for the arguments that are
+				   passed on the stack to the
+				   functions that are called. */
+  int size;			/**< The total amount that %rsp is
+				   lowered by below the frame
+				   pointer. */
+  int rsp_offset;		/**< The distance from %rsp to the
+				   frame pointer when it is
+				   omitted. */
+  unsigned leaf: 1;		/**< Whether no calls are made. */
+  unsigned dynamic: 1;		/**< Whether memory is allocated at run
+				   time. */
+  unsigned escapes: 1;		/**< Whether the address of something
+				   in the frame is taken. */
+  unsigned red_zone: 1;		/**< Whether the frame lives in the red
+				   zone and needn't be allocated. */
+  unsigned omit_fp: 1;		/**< Whether %rbp is free to be used
+				   as a general register. */
+};
+
+/** 
+ * Lay out the stack frame of the function @c s.  If the frame pointer
+ * is to be omitted, then all the locations that are based on it are
+ * rewritten to be based on %rsp instead.
+ * 
+ * @param s The function to lay out.
+ * @param f The layout of the frame.
+ */
+extern void frame_layout (struct ast *s, struct frame *f);
+
+#endif
@@ -25,9 +25,8 @@
  * @todo The current implementation restricts itself in that it cannot
  * save the value of a register when it runs out of registers.  Thus
  * we cannot manage when presented with an expression that is too
- * long, a function call is passed as the paramater to another
- * function, or there are more parameters for a function than
- * registers available.
+ * long, or a function call is passed as the paramater to another
+ * function.
  *
  */
 
@@ -68,14 +67,20 @@
 #include "ast.h"
 #include "compiler.h"
 #include "extendf.h"
+#include "frame.h"
 #include "free.h"
+#include "insn.h"
+#include "isel.h"
 #include "lib.h"
 #include "my_printf.h"
 #include "parse.h"
 #include "xalloc.h"
 
+#include <limits.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <assert.h>
 
@@ -89,24 +94,35 @@
 
 /** 
  * Emit code to move the data stored in location X to location Y using
- * the operator OP.
+ * the operator OP, which takes the immediate IMM as an extra first
+ * operand unless it is NULL.
  *
  * This is the essential command of the entire register allocation
  * framework.
  * 
  * @param OP Operation to move the data.
+ * @param IMM The immediate, or NULL if there is none.
  * @param X Source operand.
  * @param Y Destionation operand.
  */
-#define MOVE_LOC_WITH(OP, X, Y) do {			\
-    if ((X) != NULL)					\
-      {							\
-	EMIT2 (OP, print_loc (X), print_loc (Y));	\
-	FREE_LOC (X);					\
-      }							\
-    (X) = (Y);						\
+#define MOVE_LOC_WITH_IMM(OP, IMM, X, Y) do {			\
+    if ((X) != NULL)						\
+      {								\
+	if ((IMM) != NULL)					\
+	  EMIT3 (OP, (IMM), print_loc (X), print_loc (Y));	\
+	else							\
+	  EMIT2 (OP, print_loc (X), print_loc (Y));		\
+	FREE_LOC (X);						\
+      }								\
+    (X) = (Y);							\
   } while (0)
 
+/**
+ * @see MOVE_LOC_WITH_IMM
+ */
+#define MOVE_LOC_WITH(OP, X, Y)			\
+  MOVE_LOC_WITH_IMM (OP, NULL, X, Y)
+
 /** 
  * Allocate a register in the variable X.
  * 
@@ -115,8 +131,32 @@
 #define ALLOC_REGISTER(X) do {				\
     const char *_d = regis (general_regis (avail++));	\
     MAKE_BASE_LOC (X, register_loc, xstrdup (_d));	\
+    if (avail > regs_used)				\
+      regs_used = avail;				\
   } while (0)
 
+/** 
+ * Check if the register @c R holds the frame and so can't be handed
+ * out like the general registers.
+ * 
+ * @param R A string representation of a register.
+ */
+#define IS_FRAME_REGISTER(R)				\
+  (STREQ ((R), "%rsp") || (!frame.omit_fp && STREQ ((R), "%rbp")))
+
+/**
+ * A pseudo-instruction that stands in for the epilogue of a function
+ * until its body is complete and we know which registers need to be
+ * restored.
+ */
+#define EPILOGUE ".epilogue"
+
+/**
+ * A pseudo-instruction that stands in for the epilogue of a function
+ * followed by a jump to its operand, in place of a call and a return.
+ */
+#define TAIL_CALL ".tailcall"
+
 /** 
  * Emit the code specified in the format string.
  * 
@@ -127,11 +167,41 @@
       fprintf (stderr, __VA_ARGS__);		\
   } while (0)
 
-#define EMIT_LABEL(L) PUT ("%s:\n", (L))
-#define EMIT0(OP) PUT ("\t%s\n", (OP))
-#define EMIT1(OP, A) PUT ("\t%s\t%s\n", (OP), (A))
-#define EMIT2(OP, A, B) PUT ("\t%s\t%s, %s\n", (OP), (A), (B))
-#define EMIT3(OP, A, B, C) PUT ("\t%s\t%s, %s, %s\n", (OP), (A), (B), (C))
+/**
+ * Append an instruction to the current function.
+ */
+#define EMIT_LABEL(L) insn_emit (insns, 1, (L), 0)
+#define EMIT0(OP) insn_emit (insns, 0, (OP), 0)
+#define EMIT1(OP, A) insn_emit (insns, 0, (OP), 1, (A))
+#define EMIT2(OP, A, B) insn_emit (insns, 0, (OP), 2, (A), (B))
+#define EMIT3(OP, A, B, C) insn_emit (insns, 0, (OP), 3, (A), (B), (C))
+
+/**
+ * The position of %rbp among the general registers.
+ */
+#define RBP_GENERAL_INDEX 7
+
+static int avail = 0;		/**< Top of available register
+				   stack. */
+static int regs_used = 0;	/**< The most general registers that
+				   were in use at once in the current
+				   function. */
+static struct frame frame;	/**< The layout of the current
+				   function's stack frame. */
+static gl_list_t insns = NULL;	/**< The instructions of the current
+				   function. */
+static const struct ast *function = NULL; /**< The current
+					     function. */
+static int self_tail_call = 0;	/**< Whether the current function
+				   jumps back to its own entry. */
+static int str_labelno = 0;	/**< Current label number for strings
+				   in the data section. */
+static char *data_section = NULL; /**< The data section. */
+static int branch_labelno = 0;	/**< Current label number for branch
+				   destinations in the text
+				   section. */
+static int table_labelno = 0;	/**< Current label number for jump
+				   tables. */
 
 /** 
  * Get the string variant of a register index.
@@ -145,7 +215,7 @@ regis (int a)
 {
   const char *storage[] =
     { "%rax", "%rbx", "%rcx", "%rdx", "%rdi", "%rsi", "%r8", "%r9", "%r10",
-      "%r11", "%r12", "%r13", "%r14", "%r15" };
+      "%r11", "%r12", "%r13", "%r14", "%r15", "%rbp" };
 #if USE_REGISTER_CHECKING
   CHECK_BOUNDS (storage, a);
 #endif
@@ -167,8 +237,8 @@ regis (int a)
 static int
 call_regis(int a)
 {
-  const int storage[] =
-    { 4, 5, 2, 3, 6, 7 };
+  const int storage[REGISTER_ARGS] =
+    { 4, 5, 3, 2, 6, 7 };
 #if USE_REGISTER_CHECKING
   CHECK_BOUNDS (storage, a);
 #endif
@@ -193,43 +263,38 @@ static int
 general_regis(int a)
 {
   const int storage[] =
-    { 1, 8, 9, 10, 11, 12, 13
+    { 1, 8, 9, 10, 11, 12, 13, 14
 #if USE_CALL_REGISTERS_GENERALY
       , 7, 6, 3, 2, 5, 4
 #endif
     };
+  /* %rbp can only be used when it doesn't hold the frame pointer. */
+  if (!frame.omit_fp && a >= RBP_GENERAL_INDEX)
+    a++;
 #if USE_REGISTER_CHECKING
   CHECK_BOUNDS (storage, a);
 #endif
   return storage[a];
 }
 
-static int avail = 0;		/**< Top of available register
-				   stack. */
-static int str_labelno = 0;	/**< Current label number for strings
-				   in the data section. */
-static char *data_section = NULL; /**< The data section. */
-static int branch_labelno = 0;	/**< Current label number for branch
-				   destinations in the text
-				   section. */
-
 /** 
  * Macro to allocate a register to a location while also checking to
  * see if it can reuse any of the locations that it is about to free.
  *
  * This macro will preserve the data found in S and simply apply the
- * operator I to it.
+ * operator I to it, along with the immediate IMM if it isn't NULL.
  * 
  * @param I The instruction to use.
+ * @param IMM The immediate, or NULL if there is none.
  * @param S The variable to be moved into a register.
  */
-#define GIVE_REGISTER_HOW(I, S) do {					\
+#define GIVE_REGISTER_HOW_IMM(I, IMM, S) do {				\
     unsigned _addto_avail = 0;						\
     struct loc *_t = NULL;						\
     if (IS_MEMORY (S))							\
       {									\
 	_addto_avail += 1;						\
-	if (STRNEQ ((S)->base, "%rbp"))					\
+	if (!IS_FRAME_REGISTER ((S)->base))				\
 	  MAKE_BASE_LOC (_t, register_loc, xstrdup ((S)->base));	\
 	else if ((S)->index != NULL)					\
 	  MAKE_BASE_LOC (_t, register_loc, xstrdup ((S)->index));	\
@@ -238,10 +303,16 @@ static int branch_labelno = 0;	/**< Current label number for branch
       }									\
     if (_t == NULL)							\
       ALLOC_REGISTER (_t);						\
-    MOVE_LOC_WITH (I, S, _t);						\
+    MOVE_LOC_WITH_IMM (I, IMM, S, _t);					\
     avail += _addto_avail;						\
   } while (0)
 
+/**
+ * @see GIVE_REGISTER_HOW_IMM
+ */
+#define GIVE_REGISTER_HOW(I, S)			\
+  GIVE_REGISTER_HOW_IMM (I, NULL, S)
+
 /** 
  * Give a register to location S preserving its data by moving it to
  * the new location.
@@ -262,17 +333,6 @@ static int branch_labelno = 0;	/**< Current label number for branch
 #define MOVE_LOC(X, Y)				\
   MOVE_LOC_WITH ("mov", X, Y)
 
-/** 
- * Wrapper macro around sub macros to decide on which method of
- * register selection is necessary.
- * 
- * @param N Method to use.
- * @param X First location.
- * @param Y Section location.
- */
-#define ENSURE_DESTINATION_REGISTER(N, X, Y)	\
-  ENSURE_DESTINATION_REGISTER##N (X, Y)
-
 /**
  * Ensure that that @c X is in a register. 
  *
@@ -283,153 +343,830 @@ static int branch_labelno = 0;	/**< Current label number for branch
       GIVE_REGISTER (X);			\
   } while (0)
 
+/**
+ * The cost of a rule whose operands can't be made to fit it.
+ */
+#define ISEL_NO_FIT (~0U)
+
+/* Forward declaration for more specific functions. */
+static void gen_code_r (struct ast *);
+
 /** 
- * Designed for any binary operation on the x86_64 by restricting the
- * destination to being a memory/register and forcing one of them to
- * be a register.
- *
- * Although a @c mov instruction can handle a memory and an immediate,
- * it cannot handle a 64-bit immediate operand, so we force one of
- * them to be a register.
+ * Label every expression in @c s with the number of registers that
+ * it needs to be evaluated, in the manner of Sethi and Ullman.
+ * Literals and variables can be used directly as operands and so
+ * need none, while an operator needs one more than its operands when
+ * both of them need the same amount.
+ * 
+ * @param s The AST to label.
  * 
- * @param X @c s->loc
- * @param Y @c from->loc
+ * @return The number of registers needed by @c s.
  */
-#define ENSURE_DESTINATION_REGISTER0(X, Y) do {	\
-    assert (!IS_LITERAL (X));			\
-    if (!IS_REGISTER (X) && !IS_REGISTER (Y))	\
-      GIVE_REGISTER (Y);			\
-  } while (0)
+static unsigned
+label_regs (struct ast *s)
+{
+  unsigned need = 0;
+  for (; s != NULL; s = s->next)
+    {
+      unsigned most = 0, ties = 0;
+      int i;
+      for (i = 0; i < s->num_ops; i++)
+	{
+	  unsigned n = label_regs (s->ops[i]);
+	  if (n > most)
+	    {
+	      most = n;
+	      ties = 0;
+	    }
+	  else if (n == most && n > 0)
+	    ties = 1;
+	}
+      switch (s->type)
+	{
+	case integer_type:
+	case string_type:
+	case variable_type:
+	  s->regs = 0;
+	  break;
+
+	default:
+	  s->regs = most + ties;
+	  if (s->regs == 0)
+	    s->regs = 1;
+	}
+      need = s->regs;
+    }
+  return need;
+}
 
 /**
- * Designed for the addition and subtraction operations.  These
- * require one of the destination/source operands to be in a register
- * while the other can be memory or (if it's the source operand) an
- * immediate.
+ * Find the operator that gives the same result as @c op does once
+ * its operands are swapped.
+ *
+ * @param op The operator to swap.
  *
- * @param X @c s->loc
- * @param Y @c from->loc
+ * @return The swapped operator, or 0 if @c op can't be swapped.
  */
-#define ENSURE_DESTINATION_REGISTER1(X, Y) do {	\
-    if (!IS_REGISTER (X))			\
-      {						\
-	if (IS_REGISTER (Y))			\
-	  SWAP (X, Y);				\
-	else					\
-	  GIVE_REGISTER (X);			\
-      }						\
-  } while (0)
+static int
+swapped_op (int op)
+{
+  switch (op)
+    {
+    case '+':
+    case '*':
+    case '&':
+    case '|':
+    case '^':
+    case EQ:
+    case NE:
+      return op;
+
+    case '<':
+      return '>';
+
+    case '>':
+      return '<';
+
+    case LE:
+      return GE;
+
+    case GE:
+      return LE;
+
+    default:
+      return 0;
+    }
+}
 
 /**
- * Designed to behave exactly as ENSURE_DESTINATION_REGISTER1, but is
- * guaranteed to keep the ordering of its arguments.
+ * Classify the location @c l by the kind of operand that it can be
+ * used as.
+ *
+ * @param l The location to classify.
  *
- * @param X @c s->loc
- * @param Y @c from->loc
+ * @return The class of @c l, or 0 if it can only be moved into a
+ * register.
  */
-#define ENSURE_DESTINATION_REGISTER2(X, Y) do {	\
-    if (!IS_REGISTER (X))			\
-      {						\
-	if (IS_REGISTER (Y))			\
-	  {					\
-	    struct loc *t = loc_dup (Y);	\
-	    GIVE_REGISTER (Y);			\
-	    MOVE_LOC ((X), t);			\
-	  }					\
-	else					\
-	  GIVE_REGISTER (X);			\
-      }						\
-  } while (0)
+static unsigned
+loc_class (struct loc *l)
+{
+  assert (l != NULL);
+  switch (l->kind)
+    {
+    case register_loc:
+      return isel_reg;
+
+    case memory_loc:
+    case symbol_loc:
+      return isel_mem;
+
+    case literal_loc:
+      {
+	/* Only a mov into a register can take a 64-bit immediate. */
+	char *end;
+	long long v = strtoll (l->base, &end, 10);
+	if (*end == '\0' && (v < INT32_MIN || v > INT32_MAX))
+	  return 0;
+	return isel_imm;
+      }
+
+    default:
+      assert (! "this should not have been reached");
+      abort ();
+    }
+}
 
 /**
- * Designed for use with the right and left shift operators.  These
- * require the right-hand argument to either be and immediate value or
- * placed in the %cl register.
+ * Predict the class of the operand that evaluating @c s will leave
+ * behind.
  *
- * @param X @c s->loc
- * @param Y @c from->loc
+ * @param s The expression to classify.
+ *
+ * @return The class of the operand.
  */
-#define ENSURE_DESTINATION_REGISTER3(X, Y) do {		\
-    if (!IS_LITERAL (Y))				\
-      {							\
-	struct loc *_l;					\
-	MAKE_BASE_LOC (_l, register_loc, "%rcx");	\
-	MOVE_LOC ((Y), _l);				\
-	(Y)->base = xstrdup ("%cl");			\
-      }							\
-    if (IS_LITERAL (X))					\
-      GIVE_REGISTER (X);				\
-  } while (0)
+static unsigned
+ast_class (struct ast *s)
+{
+  switch (s->type)
+    {
+    case integer_type:
+      if (s->op.integer.i < INT32_MIN || s->op.integer.i > INT32_MAX)
+	return 0;
+      return isel_imm;
+
+    case variable_type:
+      return loc_class (s->loc);
+
+    case string_type:
+      return isel_mem;
+
+    case unary_type:
+      return s->op.unary.op == '*' ? isel_mem : isel_reg;
+
+    case binary_type:
+      return s->op.binary.op == '[' ? isel_mem : isel_reg;
+
+    default:
+      return isel_reg;
+    }
+}
+
+/**
+ * Get the value of the integer literal at @c l.
+ *
+ * @param l The location to check.
+ * @param v Where to store the value.
+ *
+ * @return true if @c l is an integer literal, false otherwise.
+ */
+static int
+literal_value (struct loc *l, long long *v)
+{
+  char *end;
+  if (!IS_LITERAL (l))
+    return 0;
+  *v = strtoll (l->base, &end, 10);
+  return *end == '\0';
+}
+
+/**
+ * Check if the literal @c c is one that the rules of the form @c form
+ * can handle.  Multiplications need @c c to be a power of two, or 3,
+ * 5 or 9 times one, so that it can be done with lea and a shift.
+ * Divisions can handle anything but 0, and since the remainder needs
+ * @c c as an immediate it has to fit in 32 bits.
+ *
+ * @param form The form of the rule.
+ * @param op The operator.
+ * @param c The literal.
+ *
+ * @return true if the rule can be used, false otherwise.
+ */
+static int
+const_reducible (enum isel_form form, int op, long long c)
+{
+  if (c == LLONG_MIN)
+    return 0;
+  unsigned long long u = c < 0 ? -c : c;
+  switch (form)
+    {
+    case isel_mulconst:
+      if (u == 0)
+	return 1;
+      while (u % 2 == 0)
+	u /= 2;
+      return u == 1 || u == 3 || u == 5 || u == 9;
+
+    case isel_divconst:
+      return u != 0 && (op == '/' || u <= INT32_MAX);
+
+    default:
+      return 1;
+    }
+}
+
+/**
+ * Compute the cost of using the rule @c r on operands of the classes
+ * @c dst and @c src, counting a move into a register for each operand
+ * that doesn't fit.
+ *
+ * @param r The rule to use.
+ * @param dst The class of the destination operand.
+ * @param src The class of the source operand.
+ *
+ * @return The cost, or ISEL_NO_FIT if the operands can't be made to
+ * fit.
+ */
+static unsigned
+isel_fit (const struct isel_rule *r, unsigned dst, unsigned src)
+{
+  unsigned cost = r->cost;
+  if (!(dst & r->dst))
+    {
+      if (!(r->dst & isel_reg))
+	return ISEL_NO_FIT;
+      cost++;
+    }
+  if (r->src != 0 && !(src & r->src))
+    {
+      if (!(r->src & (isel_reg | isel_cl)))
+	return ISEL_NO_FIT;
+      cost++;
+    }
+  return cost;
+}
+
+/**
+ * The operands that were captured by matching a tree pattern.
+ */
+struct isel_match
+{
+  struct ast *base;		/**< The expression matched by b. */
+  struct ast *index;		/**< The expression matched by i. */
+  long long scale;		/**< The literal matched by s. */
+  long long disp;		/**< The literal matched by d. */
+};
+
+/**
+ * Match the tree pattern at @c *p against the expression @c s.  An
+ * operator in the pattern is a single character followed by its one
+ * or two operands in parentheses, while every other letter captures
+ * an operand in @c m.
+ *
+ * @param p The pattern, which is advanced past what was matched.
+ * @param s The expression to match.
+ * @param m The captured operands.
+ *
+ * @return true if @c s matches the pattern, false otherwise.
+ */
+static int
+isel_match_tree (const char **p, struct ast *s, struct isel_match *m)
+{
+  char c = *(*p)++;
+  switch (c)
+    {
+    case 'b':
+      m->base = s;
+      return 1;
+
+    case 'i':
+      m->index = s;
+      return 1;
+
+    case 's':
+      if (s->type != integer_type)
+	return 0;
+      m->scale = s->op.integer.i;
+      return (m->scale == 1 || m->scale == 2 || m->scale == 4
+	      || m->scale == 8);
+
+    case 'd':
+      if (s->type != integer_type)
+	return 0;
+      m->disp = s->op.integer.i;
+      return m->disp >= INT32_MIN && m->disp <= INT32_MAX;
+
+    default:
+      {
+	/* The pattern says how many operands the operator has, which
+	   tells a dereference apart from a multiplication. */
+	int unary = s->type == unary_type && s->op.unary.op == c;
+	if (!unary && (s->type != binary_type || s->op.binary.op != c))
+	  return 0;
+	assert (**p == '(');
+	(*p)++;
+	if (!isel_match_tree (p, s->ops[0], m))
+	  return 0;
+	if (unary != (**p == ')'))
+	  return 0;
+	if (!unary)
+	  {
+	    (*p)++;
+	    if (!isel_match_tree (p, s->ops[1], m))
+	      return 0;
+	  }
+	assert (**p == ')');
+	(*p)++;
+	return 1;
+      }
+    }
+}
+
+/**
+ * Match the tree pattern of the rule @c r, which folds an address into
+ * a memory operand, against the expression @c s.  The index of an
+ * array counts elements of 8 bytes, so its index and displacement are
+ * scaled to bytes here.
+ *
+ * @param r The rule.
+ * @param s The expression to match.
+ * @param m The captured operands.
+ *
+ * @return true if @c s matches and its displacement still fits in 32
+ * bits, false otherwise.
+ */
+static int
+isel_match_address (const struct isel_rule *r, struct ast *s,
+		    struct isel_match *m)
+{
+  const char *p = r->tree;
+  if (!isel_match_tree (&p, s, m))
+    return 0;
+  if (r->op == '[')
+    {
+      if (m->disp < INT32_MIN / 8 || m->disp > INT32_MAX / 8)
+	return 0;
+      m->disp *= 8;
+      m->scale = 8;
+    }
+  return 1;
+}
+
+/**
+ * The cost of evaluating @c s into a register.
+ *
+ * @param s The expression to evaluate.
+ *
+ * @return The cost.
+ */
+static unsigned
+isel_reg_cost (struct ast *s)
+{
+  if (s == NULL)
+    return 0;
+  return s->cost + (ast_class (s) & isel_reg ? 0 : 1);
+}
+
+/**
+ * Label every expression in @c s with the cost of the cheapest way of
+ * evaluating it, and every binary operator with the rule that does it
+ * for that cost.  This is done bottom up so that a rule covering a
+ * whole tree can be weighed against the rules covering each of its
+ * operators.
+ *
+ * @param s The AST to label.
+ */
+static void
+label_isel (struct ast *s)
+{
+  for (; s != NULL; s = s->next)
+    {
+      unsigned cost = 0;
+      int i;
+      for (i = 0; i < s->num_ops; i++)
+	{
+	  label_isel (s->ops[i]);
+	  if (s->ops[i] != NULL)
+	    cost += s->ops[i]->cost;
+	}
+      switch (s->type)
+	{
+	case integer_type:
+	case string_type:
+	case variable_type:
+	  s->cost = 0;
+	  break;
+
+	default:
+	  s->cost = cost + 1;
+	}
+      s->rule = 0;
+      int op;
+      if (s->type == binary_type)
+	op = s->op.binary.op;
+      else if (s->type == unary_type && s->op.unary.op == '*')
+	op = '*';
+      else
+	continue;
+
+      unsigned best = ISEL_NO_FIT;
+      for (i = 0; i < isel_nrules; i++)
+	{
+	  const struct isel_rule *r = &isel_rules[i];
+	  if (r->op != op)
+	    continue;
+	  unsigned c;
+	  if (r->tree == NULL)
+	    {
+	      /* A dereference is only ever covered by a tree. */
+	      if (s->type != binary_type)
+		continue;
+	      unsigned dst = ast_class (s->ops[0]);
+	      unsigned src = ast_class (s->ops[1]);
+	      c = ISEL_NO_FIT;
+	      if (s->ops[1]->type != integer_type
+		  || const_reducible (r->form, r->op, s->ops[1]->op.integer.i))
+		c = isel_fit (r, dst, src);
+	      if (r->swap != isel_fixed && isel_fit (r, src, dst) < c
+		  && (s->ops[0]->type != integer_type
+		      || const_reducible (r->form, r->op,
+					  s->ops[0]->op.integer.i)))
+		c = isel_fit (r, src, dst);
+	      if (c == ISEL_NO_FIT)
+		continue;
+	      c += cost;
+	    }
+	  else
+	    {
+	      struct isel_match m = { 0 };
+	      const char *p = r->tree;
+	      if (r->form == isel_address ? !isel_match_address (r, s, &m)
+		  : !isel_match_tree (&p, s, &m))
+		continue;
+	      c = r->cost + isel_reg_cost (m.base) + isel_reg_cost (m.index);
+	    }
+	  if (c < best)
+	    {
+	      best = c;
+	      s->rule = i + 1;
+	    }
+	}
+      if (best != ISEL_NO_FIT)
+	s->cost = best;
+    }
+}
+
+/**
+ * Select the cheapest rule that implements the operator @c op on the
+ * operands @c x and @c y, which have already been evaluated.  Tree
+ * patterns were already considered by label_isel and so are skipped.
+ *
+ * @param op The operator.
+ * @param x The destination operand.
+ * @param y The source operand, or NULL if there is none.
+ * @param swap Set to true if the operands must be swapped.
+ *
+ * @return The rule to use.
+ */
+static const struct isel_rule *
+isel_select (int op, struct loc *x, struct loc *y, int *swap)
+{
+  const struct isel_rule *best = NULL;
+  unsigned best_cost = ISEL_NO_FIT;
+  unsigned dst = loc_class (x);
+  unsigned src = y != NULL ? loc_class (y) : 0;
+  int i;
+  *swap = 0;
+  for (i = 0; i < isel_nrules; i++)
+    {
+      const struct isel_rule *r = &isel_rules[i];
+      if (r->op != op || r->tree != NULL)
+	continue;
+      long long v;
+      unsigned c = isel_fit (r, dst, src);
+      if (c < best_cost
+	  && (y == NULL || !literal_value (y, &v)
+	      || const_reducible (r->form, op, v)))
+	{
+	  best = r;
+	  best_cost = c;
+	  *swap = 0;
+	}
+      if (r->swap != isel_fixed && y != NULL)
+	{
+	  c = isel_fit (r, src, dst);
+	  if (c < best_cost
+	      && (!literal_value (x, &v) || const_reducible (r->form, op, v)))
+	    {
+	      best = r;
+	      best_cost = c;
+	      *swap = 1;
+	    }
+	}
+    }
+  if (best == NULL)
+    error (1, 0, _("FATAL: no instruction selection rule for op-code: %d"),
+	   op);
+  return best;
+}
+
+/**
+ * Move the operands @c x and @c y into registers as needed to make
+ * them fit the rule @c r.  The order of the operands is kept, and
+ * when @c y already holds a register the destination is given that
+ * register, so that it is the source that is freed afterwards.
+ *
+ * @param r The rule to fit.
+ * @param x The destination operand.
+ * @param y The source operand, or NULL if there is none.
+ */
+static void
+isel_apply (const struct isel_rule *r, struct loc **x, struct loc **y)
+{
+  if (!(loc_class (*x) & r->dst))
+    {
+      if (y != NULL && IS_REGISTER (*y))
+	{
+	  struct loc *t = loc_dup (*y);
+	  GIVE_REGISTER (*y);
+	  MOVE_LOC (*x, t);
+	}
+      else
+	GIVE_REGISTER (*x);
+    }
+  if (y != NULL && !(loc_class (*y) & r->src))
+    {
+      if (r->src & isel_cl)
+	{
+	  struct loc *l;
+	  MAKE_BASE_LOC (l, register_loc, xstrdup ("%rcx"));
+	  MOVE_LOC (*y, l);
+	  FREE ((*y)->base);
+	  (*y)->base = xstrdup ("%cl");
+	}
+      else
+	GIVE_REGISTER (*y);
+    }
+}
+
+/**
+ * Emit the code to test the value at @c *l against zero.
+ *
+ * @param l The location of the value, which is freed.
+ */
+static void
+gen_code_truth (struct loc **l)
+{
+  int swap;
+  const struct isel_rule *r = isel_select (ISEL_TRUTH, *l, NULL, &swap);
+  isel_apply (r, l, NULL);
+  if (r->form == isel_test)
+    {
+      /* print_loc reuses the same buffer, so only call it once. */
+      const char *p = print_loc (*l);
+      EMIT2 (r->insn, p, p);
+    }
+  else
+    EMIT2 (r->insn, "$0", print_loc (*l));
+  FREE_LOC (*l);
+}
+
+/**
+ * Emit the code to tear down the current stack frame, leaving the
+ * return address on top of the stack.
+ */
+static void
+gen_code_teardown (void)
+{
+  if (frame.omit_fp)
+    {
+      if (regs_used > RBP_GENERAL_INDEX)
+	{
+	  const char *save = my_printf ("%d(%%rsp)", frame.rsp_offset);
+	  EMIT2 ("mov", save, "%rbp");
+	  FREE (save);
+	}
+      if (!frame.red_zone)
+	{
+	  const char *size = my_printf ("$%d", frame.size + 8);
+	  EMIT2 ("add", size, "%rsp");
+	  FREE (size);
+	}
+    }
+  else
+    {
+      /* Memory that is allocated at run time moves the stack
+	 pointer too. */
+      if (frame.size > 0 || frame.dynamic)
+	EMIT2 ("mov", "%rbp", "%rsp");
+      EMIT1 ("pop", "%rbp");
+    }
+}
+
+/**
+ * Emit the code to tear down the current stack frame and return.
+ */
+static void
+gen_code_epilogue (void)
+{
+  gen_code_teardown ();
+  EMIT0 ("ret");
+}
+
+/**
+ * Get the label at the entry of the current function, after its
+ * frame is set up, that its tail calls to itself jump to.
+ *
+ * @return The label, which must be freed.
+ */
+static char *
+entry_label (void)
+{
+  return my_printf (".LT%s", function->op.function.name);
+}
+
+static void
+gen_code_function (struct ast *s)
+{
+  frame_layout (s, &frame);
+  label_regs (s->ops[1]);
+  label_isel (s->ops[1]);
+  /* Only the statements whose values are thrown away give back every
+     register, so the last function can leave some behind. */
+  avail = 0;
+  regs_used = 0;
+  function = s;
+  self_tail_call = 0;
+
+  /* Generate the body of the function first, that way we know which
+     registers it uses before setting up the frame. */
+  gl_list_t body = insns = insn_list_create ();
+  gen_code_r (s->ops[1]);
+  insns = insn_list_create ();
+
+  /* Enter the .text section and declare this symbol as global if it
+     should be. */
+  EMIT0 (".text");
+  if (!s->static_decl)
+    EMIT1 (".global", s->op.function.name);
+  EMIT_LABEL (s->op.function.name);
+
+  /* Set up the stack frame with a single allocation, unless it fits
+     in the red zone. */
+  if (frame.omit_fp)
+    {
+      if (!frame.red_zone)
+	{
+	  const char *size = my_printf ("$%d", frame.size + 8);
+	  EMIT2 ("sub", size, "%rsp");
+	  FREE (size);
+	}
+      if (regs_used > RBP_GENERAL_INDEX)
+	{
+	  const char *save = my_printf ("%d(%%rsp)", frame.rsp_offset);
+	  EMIT2 ("mov", "%rbp", save);
+	  FREE (save);
+	}
+    }
+  else
+    {
+      EMIT1 ("push", "%rbp");
+      EMIT2 ("mov", "%rsp", "%rbp");
+      if (frame.size > 0)
+	{
+	  const char *size = my_printf ("$%d", frame.size);
+	  EMIT2 ("sub", size, "%rsp");
+	  FREE (size);
+	}
+    }
+
+  /* A tail call to the function itself comes back here with the new
+     arguments in the same registers. */
+  if (self_tail_call)
+    {
+      char *entry = entry_label ();
+      EMIT_LABEL (entry);
+      FREE (entry);
+    }
+
+  /* Walk over the list of arguments and store the ones passed through
+     registers into the frame.  The rest are already there. */
+  struct ast *i;
+  int argnum = 0;
+  for (i = s->ops[0]; i != NULL && argnum < REGISTER_ARGS; i = i->next)
+    {
+      if (i->type != variable_type)
+	continue;
+      EMIT2 ("mov", regis(call_regis(argnum)), print_loc (i->loc));
+      argnum++;
+    }
+
+  /* Copy over the body, filling in the epilogues now that we know
+     what they have to restore. */
+  size_t j;
+  for (j = 0; j < gl_list_size (body); j++)
+    {
+      const struct insn *in = gl_list_get_at (body, j);
+      if (!in->label && STREQ (in->op, EPILOGUE))
+	gen_code_epilogue ();
+      else if (!in->label && STREQ (in->op, TAIL_CALL))
+	{
+	  gen_code_teardown ();
+	  EMIT1 ("jmp", in->args[0]);
+	}
+      else
+	insn_emit (insns, in->label, in->op, in->nargs, in->args[0],
+		   in->args[1], in->args[2]);
+    }
+  gl_list_free (body);
+
+  if (optimize > 0)
+    peephole (insns);
+  insn_list_print (outfile, insns);
+  if (debug)
+    insn_list_print (stderr, insns);
+  gl_list_free (insns);
+  insns = NULL;
+  function = NULL;
+}
+
+static void gen_code_call_args (struct ast *s);
+
+/**
+ * Check if the value @c s that is being returned can be a tail call,
+ * where the current frame is torn down before jumping to the function
+ * that is called, so that it returns straight to our caller.  None of
+ * the arguments can be on the stack, since that belongs to our
+ * caller, and nothing in our frame can be pointed to.
+ *
+ * @param s The value.
+ *
+ * @return true if it can, false otherwise.
+ */
+static int
+is_tail_call (const struct ast *s)
+{
+  if (optimize < 1 || s->type != function_call_type
+      || s->ops[0]->type != variable_type
+      || frame.escapes || frame.dynamic)
+    return 0;
+  const struct ast *i;
+  int n = 0;
+  for (i = s->ops[1]; i != NULL; i = i->next)
+    if (i->type != block_type)
+      n++;
+  return n <= REGISTER_ARGS;
+}
+
+/**
+ * Check if the call @c s is to the current function with as many
+ * arguments as it has parameters, so that it can jump back to the
+ * entry instead of setting up a new frame.
+ *
+ * @param s The call.
+ *
+ * @return true if it can, false otherwise.
+ */
+static int
+is_self_call (const struct ast *s)
+{
+  if (STRNEQ (s->ops[0]->op.variable.name, function->op.function.name))
+    return 0;
+  const struct ast *i = s->ops[1], *j = function->ops[0];
+  for (;; i = i->next, j = j->next)
+    {
+      while (i != NULL && i->type == block_type)
+	i = i->next;
+      while (j != NULL && j->type != variable_type)
+	j = j->next;
+      if (i == NULL || j == NULL)
+	return i == j;
+    }
+}
 
 /**
- * Designed for when both @c X and @c Y must be registers but cannot
- * have their arguments swapped.
+ * Generate a call in tail position.
  *
- * @param X @c s->loc
- * @param Y @c from->loc
+ * @param s The call.
  */
-#define ENSURE_DESTINATION_REGISTER4(X, Y) do {	\
-    ENSURE_DESTINATION_REGISTER2 (X, Y);	\
-    ENSURE_DESTINATION_REGISTER_UNI (Y);	\
-  } while (0)
-
-/** 
- * In a binary operation, call ENSURE_DESTINATION_REGISTER with @c N
- * on the arguments @c X and @c Y.  Followed by emitting an
- * instruction using the operator @c OP and the locations @c X and @c
- * Y.
- * 
- * @param N Which ENSURE_DESTINATION_REGISTER to call.
- * @param OP The assembly opcode.
- * @param X @c s->loc
- * @param Y @c from->loc
- */
-#define BINARY_ENSURE_AND_PUT(N, OP, X, Y) do {	\
-    ENSURE_DESTINATION_REGISTER (N, X, Y);	\
-    EMIT2 (OP, print_loc (Y), print_loc (X));	\
-  } while (0)
-
-
-/* Forward declaration for more specific functions. */
-static void gen_code_r (struct ast *);
-
 static void
-gen_code_function (struct ast *s)
+gen_code_tail_call (struct ast *s)
 {
-  /* Enter the .text section and declare this symbol as global if it
-     should be. */
-  EMIT0 (".text");
-  if (!s->static_decl)
-    EMIT1 (".global", s->op.function.name);
-  EMIT_LABEL (s->op.function.name);
-
-  /* Set up the stack frame. */
-  EMIT1 ("push", "%rbp");
-  EMIT2 ("mov", "%rsp", "%rbp");
-
-  /* Walk over the list of arguments and push them into the
-     stack. */
-  struct ast *i;
-  int argnum;
-  argnum = 0;
-  for (i = s->ops[0]; i != NULL; i = i->next)
+  gen_code_call_args (s);
+  if (is_self_call (s))
     {
-      if (i->type != variable_type)
-	continue;
-      const char *alloc = my_printf ("$%d", i->op.variable.alloc);
-      EMIT2 ("sub", alloc, "%rsp");
-      FREE (alloc);
-      EMIT2 ("mov", regis(call_regis(argnum)), print_loc (i->loc));
-      argnum++;
+      char *entry = entry_label ();
+      EMIT1 ("jmp", entry);
+      FREE (entry);
+      self_tail_call = 1;
     }
-
-  /* Generate the body of the function. */
-  gen_code_r (s->ops[1]);
+  else
+    {
+      EMIT2 ("mov", "$0", "%rax"); /* Needed for printf. */
+      EMIT1 (TAIL_CALL, s->ops[0]->loc->base);
+    }
+  FREE_LOC (s->ops[0]->loc);
 }
 
 static void
 gen_code_ret (struct ast *s)
 {
+  if (s->ops[0] != NULL && is_tail_call (s->ops[0]))
+    {
+      gen_code_tail_call (s->ops[0]);
+      return;
+    }
+
   /* Move the return value into the %rax register. */
   if (s->ops[0] != NULL)
     {
@@ -439,9 +1176,7 @@ gen_code_ret (struct ast *s)
       MOVE_LOC (s->ops[0]->loc, ret);
     }
   /* Function footer. */
-  EMIT2 ("mov", "%rbp", "%rsp");
-  EMIT1 ("pop", "%rbp");
-  EMIT0 ("ret");
+  EMIT0 (EPILOGUE);
 }
 
 /** 
@@ -479,10 +1214,7 @@ const char *binop_branch_suffix[MAX_TOKEN] = { NULL };
       }									\
     else								\
       {									\
-	if (!IS_REGISTER ((S)->loc))					\
-	  GIVE_REGISTER ((S)->loc);					\
-	EMIT2 ("cmpq", "$0", print_loc ((S)->loc));			\
-	FREE_LOC ((S)->loc);						\
+	gen_code_truth (&(S)->loc);					\
 	instruct = my_printf ("%s%sz", (OP),				\
 			      (!(S)->boolean_not ? "n" : ""));		\
       }									\
@@ -499,16 +1231,259 @@ gen_code_cond (struct ast *s)
   FREE_LOC (s->ops[0]->loc);
 }
 
+/**
+ * Check if the conditional goto @c s compares @c x with the address
+ * of a label.
+ *
+ * @param s The conditional goto.
+ * @param x The expression.
+ *
+ * @return true if it does, false otherwise.
+ */
+static int
+is_label_compare (const struct ast *s, const struct ast *x)
+{
+  const struct ast *c = s->ops[0];
+  return (c->type == binary_type && c->op.binary.op == EQ
+	  && !c->boolean_not && c->ops[1]->type == label_value_type
+	  && same_tree (c->ops[0], x));
+}
+
+/**
+ * Generate the conditional gotos starting at @c s that a computed
+ * goto was lowered into as a single indirect jump, since the value
+ * that they compare with the address of each label is where to go.
+ *
+ * @param s The first conditional goto.
+ *
+ * @return The last statement that was generated, or NULL if @c s
+ * isn't part of a computed goto.
+ */
+static struct ast *
+gen_code_computed_jump (struct ast *s)
+{
+  struct ast *x = s->ops[0]->ops[0], *t, *last = s;
+  if (!is_label_compare (s, x) || x->type != variable_type
+      || x->boolean_not)
+    return NULL;
+  for (t = s->next; t != NULL && t->jump_table; t = t->next)
+    {
+      if (t->type == jump_type)
+	{
+	  last = t;
+	  break;
+	}
+      if (t->type != cond_type || !is_label_compare (t, x))
+	break;
+      last = t;
+    }
+
+  gen_code_r (x);
+  char *target = my_printf ("*%s", print_loc (x->loc));
+  EMIT1 ("jmp", target);
+  FREE (target);
+  return last;
+}
+
+static void emit_imm (const char *op, long long v, struct loc *l);
+
+/**
+ * Generate the run of conditional gotos starting at @c s that a
+ * switch statement marked as a jump table, as a bounds check and an
+ * indirect jump through a table of their labels.  The run ends at the
+ * first one that doesn't compare the same variable with a bigger
+ * value, and the values that none of them match go on to whatever is
+ * after it.  The passes may have taken some of them out of the
+ * middle, so only what is left of the run is trusted.
+ *
+ * @param s The first conditional goto of the run.
+ *
+ * @return The last statement that was generated, or NULL if the run
+ * isn't worth a table.
+ */
+static struct ast *
+gen_code_jump_table (struct ast *s)
+{
+  const struct ast *x = s->ops[0]->ops[0];
+  struct ast *t, *end = NULL, *last;
+  long long lo = 0, hi = 0;
+  int n = 0;
+  for (t = s; t != NULL && t->type == cond_type && t->jump_table; t = t->next)
+    {
+      const struct ast *c = t->ops[0];
+      if (c->type != binary_type || c->op.binary.op != EQ || c->boolean_not
+	  || c->ops[1]->type != integer_type || c->ops[1]->boolean_not
+	  || !same_tree (c->ops[0], x)
+	  || (n > 0 && c->ops[1]->op.integer.i <= hi))
+	break;
+      if (n++ == 0)
+	lo = c->ops[1]->op.integer.i;
+      hi = c->ops[1]->op.integer.i;
+      end = t;
+    }
+  if (n < 2 || x->type != variable_type || x->boolean_not
+      || lo < INT_MIN || hi > INT_MAX || hi - lo >= 64LL * n)
+    return NULL;
+
+  /* Find where the values that aren't in the table go. */
+  const char *dflt;
+  char *own = NULL;
+  last = end->next;
+  if (last != NULL && last->type == jump_type && last->jump_table)
+    dflt = print_loc (last->loc);
+  else
+    {
+      dflt = own = my_printf (".LW%d", table_labelno++);
+      last = end;
+    }
+
+  size_t span = hi - lo + 1, i;
+  const char **entries = xnrealloc (NULL, span, sizeof *entries);
+  for (i = 0; i < span; i++)
+    entries[i] = dflt;
+  for (t = s; t != end->next; t = t->next)
+    entries[t->ops[0]->ops[1]->op.integer.i - lo] = print_loc (t->loc);
+
+  struct loc *r;
+  ALLOC_REGISTER (r);
+  EMIT2 ("mov", print_loc (x->loc), print_loc (r));
+  if (lo != 0)
+    emit_imm ("sub", lo, r);
+  emit_imm ("cmp", hi - lo, r);
+  EMIT1 ("ja", dflt);
+  char *table = my_printf (".LW%d", table_labelno++);
+  char *target = my_printf ("*%s(,%s,8)", table, print_loc (r));
+  EMIT1 ("jmp", target);
+  FREE_LOC (r);
+
+  EXTENDF (data_section, "\t.section\t.rodata\n\t.align\t8\n%s:\n", table);
+  for (i = 0; i < span; i++)
+    EXTENDF (data_section, "\t.quad\t%s\n", entries[i]);
+  EXTENDF (data_section, "%s", "\t.data\n");
+  if (own != NULL)
+    EMIT_LABEL (own);
+
+  FREE (entries);
+  FREE (table);
+  FREE (target);
+  FREE (own);
+  return last;
+}
+
+
+/**
+ * Get the name of the low byte or the low 32 bits of the general
+ * register @c r.
+ *
+ * @param r The register.
+ * @param bits Either 8 or 32.
+ *
+ * @return The name of the part of it.
+ */
+static const char *
+subregis (const char *r, int bits)
+{
+  const char *storage[][3] =
+    { { "%rax", "%al", "%eax" }, { "%rbx", "%bl", "%ebx" },
+      { "%rcx", "%cl", "%ecx" }, { "%rdx", "%dl", "%edx" },
+      { "%rdi", "%dil", "%edi" }, { "%rsi", "%sil", "%esi" },
+      { "%r8", "%r8b", "%r8d" }, { "%r9", "%r9b", "%r9d" },
+      { "%r10", "%r10b", "%r10d" }, { "%r11", "%r11b", "%r11d" },
+      { "%r12", "%r12b", "%r12d" }, { "%r13", "%r13b", "%r13d" },
+      { "%r14", "%r14b", "%r14d" }, { "%r15", "%r15b", "%r15d" },
+      { "%rbp", "%bpl", "%ebp" } };
+  int i;
+  for (i = 0; i < SLEN (storage); i++)
+    if (STREQ (storage[i][0], r))
+      return storage[i][bits == 8 ? 1 : 2];
+  assert (! "this should not have been reached");
+  return NULL;
+}
+
+/**
+ * Check if the ternary @c s picks between two literals on the result
+ * of a comparison, where the difference between them is a power of
+ * two or its negation and the smaller one fits in an immediate.
+ * These can be worked out from the flags with setcc instead of
+ * loading both literals and moving one of them.
+ *
+ * @param s The ternary.
+ *
+ * @return true if it does, false otherwise.
+ */
+static int
+is_setcc (const struct ast *s)
+{
+  const struct ast *c = s->ops[0];
+  if (s->boolean_not || c->type != binary_type
+      || binop_branch_suffix[c->op.binary.op] == NULL
+      || s->ops[1]->type != integer_type || s->ops[2]->type != integer_type
+      || s->ops[1]->boolean_not || s->ops[2]->boolean_not)
+    return 0;
+  long long lo = s->ops[2]->op.integer.i;
+  long long d = s->ops[1]->op.integer.i - lo;
+  if (d < 0)
+    d = -d;
+  return (d != 0 && d <= (1LL << 31) && (d & (d - 1)) == 0
+	  && lo >= INT_MIN && lo <= INT_MAX);
+}
+
+/**
+ * Generate the code for a ternary that is covered by @c is_setcc.
+ *
+ * @param s The ternary.
+ */
+static void
+gen_code_setcc (struct ast *s)
+{
+  long long hi = s->ops[1]->op.integer.i, lo = s->ops[2]->op.integer.i;
+  if (hi < lo)
+    {
+      /* Flip the test so that it picks the bigger one. */
+      s->ops[0]->boolean_not ^= 1;
+      long long t = hi;
+      hi = lo;
+      lo = t;
+    }
+  long long d = hi - lo;
+  gen_code_r (s->ops[0]);
+  FREE_LOC (s->ops[0]->loc);
+
+  /* None of these moves touch the flags. */
+  ALLOC_REGISTER (s->loc);
+  const char *r = s->loc->base;
+  EMIT_BRANCH_CODE ("set", s->ops[0], 1, subregis (r, 8));
+  EMIT2 ("movzbl", subregis (r, 8), subregis (r, 32));
+  if (d > 1)
+    {
+      int k = 0;
+      while ((1LL << k) < d)
+	k++;
+      emit_imm ("shl", k, s->loc);
+    }
+  if (lo != 0)
+    emit_imm ("add", lo, s->loc);
+}
+
 static void
 gen_code_ternary (struct ast *s)
 {
+  if (optimize > 0 && is_setcc (s))
+    {
+      gen_code_setcc (s);
+      return;
+    }
+
   gen_code_r (s->ops[2]);
   s->loc = loc_dup (s->ops[2]->loc);
 
   gen_code_r (s->ops[1]);
   gen_code_r (s->ops[0]);
   
-  ENSURE_DESTINATION_REGISTER (4, s->loc, s->ops[1]->loc);
+  int swap;
+  const struct isel_rule *r = isel_select ('?', s->loc, s->ops[1]->loc,
+					   &swap);
+  isel_apply (r, &s->loc, &s->ops[1]->loc);
   EMIT_BRANCH_CODE ("cmov", s->ops[0], 2, print_loc (s->ops[1]->loc),
 		    print_loc (s->loc));
   
@@ -516,67 +1491,419 @@ gen_code_ternary (struct ast *s)
   FREE_LOC (s->ops[1]->loc);
 }
 
+/**
+ * Generate the code for the tree covered by the rule @c r, which
+ * computes an address with lea.
+ *
+ * @param s The root of the tree.
+ * @param r The rule that covers it.
+ */
+static void
+gen_code_lea (struct ast *s, const struct isel_rule *r)
+{
+  struct isel_match m = { 0 };
+  const char *p = r->tree;
+  if (!isel_match_tree (&p, s, &m))
+    assert (! "this should not have been reached");
+
+  gen_code_r (m.base);
+  s->loc = loc_dup (m.base->loc);
+  ENSURE_DESTINATION_REGISTER_UNI (s->loc);
+  gen_code_r (m.index);
+  struct loc *index = loc_dup (m.index->loc);
+  ENSURE_DESTINATION_REGISTER_UNI (index);
+
+  const char *addr = my_printf ("%lld(%s,%s,%lld)", m.disp, s->loc->base,
+				index->base, m.scale ? m.scale : 1);
+  EMIT2 ("lea", addr, print_loc (s->loc));
+  FREE (addr);
+  FREE_LOC (index);
+}
+
+/**
+ * Generate the code for the tree covered by the rule @c r, which
+ * folds an address into a memory operand.  The base and the index are
+ * evaluated into registers, and they stay allocated for as long as
+ * the memory operand is in use.
+ *
+ * @param s The root of the tree.
+ * @param r The rule that covers it.
+ */
+static void
+gen_code_address (struct ast *s, const struct isel_rule *r)
+{
+  struct isel_match m = { 0 };
+  if (!isel_match_address (r, s, &m))
+    assert (! "this should not have been reached");
+
+  gen_code_r (m.base);
+  s->loc = loc_dup (m.base->loc);
+  ENSURE_DESTINATION_REGISTER_UNI (s->loc);
+  if (m.index != NULL)
+    {
+      gen_code_r (m.index);
+      struct loc *index = loc_dup (m.index->loc);
+      ENSURE_DESTINATION_REGISTER_UNI (index);
+      s->loc->index = index->base;
+      s->loc->scale = m.scale ? m.scale : 1;
+      index->base = NULL;
+      FREE_LOC (index);
+    }
+  s->loc->kind = memory_loc;
+  s->loc->offset = m.disp;
+}
+
+/**
+ * Emit the instruction @c op with the immediate @c v as its source
+ * and @c l as its destination.
+ *
+ * @param op The instruction.
+ * @param v The immediate.
+ * @param l The destination.
+ */
+static void
+emit_imm (const char *op, long long v, struct loc *l)
+{
+  const char *imm = my_printf ("$%lld", v);
+  EMIT2 (op, imm, print_loc (l));
+  FREE (imm);
+}
+
+/**
+ * Find the magic number that divides by @c d when it is multiplied
+ * with the dividend and the high half of the product is kept, along
+ * with how far to shift that afterwards.  This is the algorithm from
+ * Hacker's Delight by Henry S. Warren.
+ *
+ * @param d The divisor, which must be at least 2.
+ * @param m The magic number.
+ * @param shift The shift.
+ */
+static void
+magic_signed (unsigned long long d, long long *m, int *shift)
+{
+  const unsigned long long two63 = 1ULL << 63;
+  unsigned long long anc = two63 - 1 - two63 % d;
+  unsigned long long q1 = two63 / anc, r1 = two63 - q1 * anc;
+  unsigned long long q2 = two63 / d, r2 = two63 - q2 * d;
+  unsigned long long delta;
+  int p = 63;
+  do
+    {
+      p++;
+      q1 *= 2;
+      r1 *= 2;
+      if (r1 >= anc)
+	{
+	  q1++;
+	  r1 -= anc;
+	}
+      q2 *= 2;
+      r2 *= 2;
+      if (r2 >= d)
+	{
+	  q2++;
+	  r2 -= d;
+	}
+      delta = d - r2;
+    }
+  while (q1 < delta || (q1 == delta && r1 == 0));
+  *m = (long long) (q2 + 1);
+  *shift = p - 64;
+}
+
+/**
+ * Multiply the register @c l by the literal @c c with shifts and lea.
+ *
+ * @param l The register.
+ * @param c The literal, which const_reducible must accept.
+ */
+static void
+gen_code_mulconst (struct loc *l, long long c)
+{
+  unsigned long long u = c < 0 ? -c : c;
+  if (u == 0)
+    {
+      EMIT2 ("mov", "$0", print_loc (l));
+      return;
+    }
+  int k = 0;
+  while (u % 2 == 0)
+    {
+      u /= 2;
+      k++;
+    }
+  if (u > 1)
+    {
+      const char *addr = my_printf ("(%s,%s,%llu)", l->base, l->base, u - 1);
+      EMIT2 ("lea", addr, print_loc (l));
+      FREE (addr);
+    }
+  if (k > 0)
+    emit_imm ("shl", k, l);
+  if (c < 0)
+    EMIT1 ("neg", print_loc (l));
+}
+
+/**
+ * Make the location @c l refer to the register @c to wherever it
+ * refers to the register @c from.
+ *
+ * @param l The location, which can be NULL.
+ * @param from The old register.
+ * @param to The new register.
+ */
+static void
+rename_register (struct loc *l, const char *from, const char *to)
+{
+  if (l == NULL)
+    return;
+  if (l->base != NULL && STREQ (l->base, from))
+    {
+      FREE (l->base);
+      l->base = xstrdup (to);
+    }
+  if (l->index != NULL && STREQ (l->index, from))
+    {
+      FREE (l->index);
+      l->index = xstrdup (to);
+    }
+}
+
+/**
+ * Move what %rdx holds into a new register before an instruction that
+ * writes to it, if it is one of the general registers in use.  The
+ * new register stands in for %rdx until restore_rdx is called.
+ *
+ * @param a A location that has to follow the move, or NULL.
+ * @param b Another one, or NULL.
+ *
+ * @return The new register, or NULL if %rdx wasn't in use.
+ */
+static struct loc *
+save_rdx (struct loc *a, struct loc *b)
+{
+  int i;
+  for (i = 0; i < avail; i++)
+    if (STREQ (regis (general_regis (i)), "%rdx"))
+      break;
+  if (i == avail)
+    return NULL;
+
+  struct loc *t;
+  ALLOC_REGISTER (t);
+  EMIT2 ("mov", "%rdx", print_loc (t));
+  rename_register (a, "%rdx", t->base);
+  rename_register (b, "%rdx", t->base);
+  return t;
+}
+
+/**
+ * Put back what save_rdx moved out of %rdx and free the register that
+ * it was moved to, which has to be the last one in use.
+ *
+ * @param t The register returned by save_rdx, or NULL.
+ * @param a A location that followed the move, or NULL.
+ * @param b Another one, or NULL.
+ */
+static void
+restore_rdx (struct loc *t, struct loc *a, struct loc *b)
+{
+  if (t == NULL)
+    return;
+  EMIT2 ("mov", print_loc (t), "%rdx");
+  rename_register (a, t->base, "%rdx");
+  rename_register (b, t->base, "%rdx");
+  FREE_LOC (t);
+}
+
+/**
+ * Divide the register @c l by the literal @c d, or take the remainder,
+ * without using idiv.  Powers of two are shifted after adding a bias
+ * that makes negative dividends round towards zero, while anything
+ * else is multiplied by its magic number, which takes %rax and %rdx.
+ *
+ * @param op Either '/' or '%'.
+ * @param l The register.
+ * @param d The literal, which const_reducible must accept.
+ */
+static void
+gen_code_divconst (int op, struct loc *l, long long d)
+{
+  unsigned long long u = d < 0 ? -d : d;
+  if (u == 1)
+    {
+      if (op == '%')
+	EMIT2 ("mov", "$0", print_loc (l));
+      else if (d < 0)
+	EMIT1 ("neg", print_loc (l));
+      return;
+    }
+
+  struct loc *t, *save = NULL;
+  ALLOC_REGISTER (t);
+  if ((u & (u - 1)) == 0)
+    {
+      int k = 0;
+      while ((1ULL << k) != u)
+	k++;
+      EMIT2 ("mov", print_loc (l), print_loc (t));
+      emit_imm ("sar", 63, t);
+      emit_imm ("shr", 64 - k, t);
+      EMIT2 ("add", print_loc (l), print_loc (t));
+      if (op == '/')
+	emit_imm ("sar", k, t);
+      else
+	emit_imm ("and", -(long long) u, t);
+    }
+  else
+    {
+      long long m;
+      int shift;
+      magic_signed (u, &m, &shift);
+      save = save_rdx (l, t);
+      const char *magic = my_printf ("$%lld", m);
+      EMIT2 ("mov", magic, "%rax");
+      FREE (magic);
+      EMIT1 ("imulq", print_loc (l));
+      if (m < 0)
+	EMIT2 ("add", print_loc (l), "%rdx");
+      if (shift > 0)
+	{
+	  const char *imm = my_printf ("$%d", shift);
+	  EMIT2 ("sar", imm, "%rdx");
+	  FREE (imm);
+	}
+      EMIT2 ("mov", print_loc (l), print_loc (t));
+      emit_imm ("shr", 63, t);
+      EMIT2 ("add", "%rdx", print_loc (t));
+      if (op == '%')
+	emit_imm ("imul", u, t);
+    }
+
+  if (op == '/')
+    {
+      if (d < 0)
+	EMIT1 ("neg", print_loc (t));
+      EMIT2 ("mov", print_loc (t), print_loc (l));
+    }
+  else
+    EMIT2 ("sub", print_loc (t), print_loc (l));
+  restore_rdx (save, l, t);
+  FREE_LOC (t);
+}
+
 static void
 gen_code_binary (struct ast *s)
 {
+  if (s->rule != 0 && isel_rules[s->rule - 1].tree != NULL)
+    {
+      if (isel_rules[s->rule - 1].form == isel_address)
+	gen_code_address (s, &isel_rules[s->rule - 1]);
+      else
+	gen_code_lea (s, &isel_rules[s->rule - 1]);
+      return;
+    }
+
+  /* Evaluate the operand that needs the most registers first, so that
+     its registers are free again by the time the other one is
+     evaluated.  We can only do this for the operators that let us
+     swap their operands and only when the order of evaluation can't
+     be observed. */
+  int op = swapped_op (s->op.binary.op);
+  if (op != 0 && s->ops[1]->regs > s->ops[0]->regs
+      && !has_side_effects (s->ops[0])
+      && !has_side_effects (s->ops[1]))
+    {
+      s->op.binary.op = op;
+      SWAP (s->ops[0], s->ops[1]);
+    }
+
   gen_code_r (s->ops[0]);
   gen_code_r (s->ops[1]);
   s->loc = loc_dup (s->ops[0]->loc);
   struct ast _from, *from;
   from = &_from;
   from->loc = loc_dup (s->ops[1]->loc);
-  switch (s->op.binary.op)
-    {
-#define AUTO_ENSURE_PUT(CASE, N, OP)				\
-      case CASE:						\
-	BINARY_ENSURE_AND_PUT (N, OP, s->loc, from->loc);	\
-	break
-
-      AUTO_ENSURE_PUT ('=', 0, "movq");
-      AUTO_ENSURE_PUT ('&', 1, "and");
-      AUTO_ENSURE_PUT ('|', 1, "or");
-      AUTO_ENSURE_PUT ('^', 1, "xor");
-      AUTO_ENSURE_PUT ('+', 1, "add");
-      AUTO_ENSURE_PUT ('-', 2, "sub");
-      AUTO_ENSURE_PUT (RS, 3, "shr");
-      AUTO_ENSURE_PUT (LS, 3, "shl");
-    case LE:
-    case GE:
-    case '<':
-    case '>':
-    case EQ:
-      BINARY_ENSURE_AND_PUT (2, "cmp", s->loc, from->loc);
+
+  int swap;
+  const struct isel_rule *r = isel_select (s->op.binary.op, s->loc,
+					   from->loc, &swap);
+  if (swap)
+    {
+      SWAP (s->loc, from->loc);
+      if (r->swap == isel_mirror)
+	s->op.binary.op = swapped_op (s->op.binary.op);
+    }
+  switch (r->form)
+    {
+    case isel_alu:
+      isel_apply (r, &s->loc, &from->loc);
+      EMIT2 (r->insn, print_loc (from->loc), print_loc (s->loc));
+      break;
+
+    case isel_cmp:
+      isel_apply (r, &s->loc, &from->loc);
+      EMIT2 (r->insn, print_loc (from->loc), print_loc (s->loc));
       FREE_LOC (from->loc);
       FREE_LOC (s->loc);
       break;
 
-#undef AUTO_ENSURE_PUT
-
-#define AUTO_MULDIV_PUT(CASE, OP, REG)			\
-      case CASE:					\
-	do {						\
-	  struct loc *l = NULL;				\
-	  MAKE_BASE_LOC (l, register_loc, "%rax");	\
-	  MOVE_LOC (s->loc, l);				\
-	  EMIT2 ("mov", "$0", "%rdx");			\
-	  if (IS_LITERAL (from->loc))			\
-	    GIVE_REGISTER (from->loc);			\
-	  EMIT1 ((OP), print_loc (from->loc));		\
-	  FREE_LOC (from->loc);				\
-	  s->loc->base = xstrdup (REG);			\
-	  GIVE_REGISTER (s->loc);			\
-	} while (0);					\
-	break
-
-      AUTO_MULDIV_PUT ('*', "imulq", "%rax");
-      AUTO_MULDIV_PUT ('/', "idivq", "%rax");
-      AUTO_MULDIV_PUT ('%', "idivq", "%rdx");
-
-#undef AUTO_MULDIV_PUT
-
-    case '[':
+    case isel_muldiv:
+      {
+	struct loc *l;
+	MAKE_BASE_LOC (l, register_loc, xstrdup ("%rax"));
+	MOVE_LOC (s->loc, l);
+	isel_apply (r, &s->loc, &from->loc);
+	/* cqo writes %rdx, which can hold the divisor or a value that
+	   is needed later. */
+	struct loc *save = save_rdx (from->loc, NULL);
+	EMIT0 ("cqo");
+	EMIT1 (r->insn, print_loc (from->loc));
+	FREE (s->loc->base);
+	s->loc->base = xstrdup (r->reg);
+	if (save != NULL && STREQ (r->reg, "%rdx"))
+	  {
+	    EMIT2 ("mov", "%rdx", "%rax");
+	    FREE (s->loc->base);
+	    s->loc->base = xstrdup ("%rax");
+	  }
+	restore_rdx (save, from->loc, NULL);
+	FREE_LOC (from->loc);
+	GIVE_REGISTER (s->loc);
+      }
+      break;
+
+    case isel_imul3:
+      /* A literal has to be loaded first, but memory can be read
+	 straight into a new register. */
+      isel_apply (r, &s->loc, &from->loc);
+      if (IS_REGISTER (s->loc))
+	{
+	  const char *p = print_loc (s->loc);
+	  EMIT3 (r->insn, print_loc (from->loc), p, p);
+	}
+      else
+	GIVE_REGISTER_HOW_IMM (r->insn, print_loc (from->loc), s->loc);
+      break;
+
+    case isel_mulconst:
+    case isel_divconst:
+      {
+	long long v;
+	if (!literal_value (from->loc, &v))
+	  assert (! "this should not have been reached");
+	isel_apply (r, &s->loc, &from->loc);
+	if (r->form == isel_mulconst)
+	  gen_code_mulconst (s->loc, v);
+	else
+	  gen_code_divconst (s->op.binary.op, s->loc, v);
+      }
+      break;
+
+    case isel_index:
       assert (!IS_LITERAL (s->loc));
-      ENSURE_DESTINATION_REGISTER (4, s->loc, from->loc);
+      isel_apply (r, &s->loc, &from->loc);
       s->loc->kind = memory_loc;
       s->loc->index = from->loc->base;
       s->loc->scale = 8;
@@ -594,6 +1921,12 @@ gen_code_binary (struct ast *s)
 static void
 gen_code_unary (struct ast *s)
 {
+  if (s->rule != 0)
+    {
+      gen_code_address (s, &isel_rules[s->rule - 1]);
+      return;
+    }
+
   gen_code_r (s->ops[0]);
   s->loc = loc_dup (s->ops[0]->loc);
   switch (s->op.unary.op)
@@ -623,15 +1956,24 @@ gen_code_unary (struct ast *s)
       break;
 
     case INC:
-      if (!s->unary_prefix)
-	GIVE_REGISTER (s->loc);
-      EMIT1 ("incq", print_loc (s->ops[0]->loc));
-      break;
-
     case DEC:
-      if (!s->unary_prefix)
-	GIVE_REGISTER (s->loc);
-      EMIT1 ("decq", print_loc (s->ops[0]->loc));
+      {
+	/* The register that the old value is kept in can be one that
+	   the address is computed in, so then the new value is read
+	   back and undone instead. */
+	int late = (!s->unary_prefix && IS_MEMORY (s->loc)
+		    && (!IS_FRAME_REGISTER (s->loc->base)
+			|| s->loc->index != NULL));
+	int inc = s->op.unary.op == INC;
+	if (!s->unary_prefix && !late)
+	  GIVE_REGISTER (s->loc);
+	EMIT1 (inc ? "incq" : "decq", print_loc (s->ops[0]->loc));
+	if (late)
+	  {
+	    GIVE_REGISTER (s->loc);
+	    EMIT1 (inc ? "decq" : "incq", print_loc (s->loc));
+	  }
+      }
       break;
 
     default:
@@ -642,19 +1984,37 @@ gen_code_unary (struct ast *s)
 }
 
 /** 
- * Generate code for a function call.
+ * Generate code to put the arguments of a function call where the
+ * function expects them.
  * 
  * @param s The AST to parse.
  */
 static void
-gen_code_function_call (struct ast *s)
+gen_code_call_args (struct ast *s)
 {
   /** @todo Don't clobber other registers when making a
       function call. */
   int a = 0;
   gen_code_r (s->ops[1]);
   struct ast *i;
+
+  /* Store the arguments that don't fit in registers into the area
+     reserved for them at the bottom of the frame. */
   for (i = s->ops[1]; i != NULL; i = i->next)
+    {
+      if (i->type == block_type)
+	continue;
+      if (a++ < REGISTER_ARGS)
+	continue;
+      struct loc *slot;
+      MAKE_BASE_LOC (slot, memory_loc, xstrdup ("%rsp"));
+      slot->offset = 8 * (a - 1 - REGISTER_ARGS);
+      ENSURE_DESTINATION_REGISTER_UNI (i->loc);
+      MOVE_LOC (i->loc, slot);
+    }
+
+  a = 0;
+  for (i = s->ops[1]; i != NULL && a < REGISTER_ARGS; i = i->next)
     {
       if (i->type == block_type)
 	continue;
@@ -664,7 +2024,17 @@ gen_code_function_call (struct ast *s)
     }
   /* We don't support function pointers yet. */
   assert (s->ops[0]->type == variable_type);
+}
 
+/** 
+ * Generate code for a function call.
+ * 
+ * @param s The AST to parse.
+ */
+static void
+gen_code_function_call (struct ast *s)
+{
+  gen_code_call_args (s);
   EMIT2 ("mov", "$0", "%rax"); /* Needed for printf. */
   EMIT1 ("call", s->ops[0]->loc->base);
   FREE_LOC (s->ops[0]->loc);
@@ -694,6 +2064,17 @@ gen_code_r (struct ast *s)
       break;
 
     case cond_type:
+      if (s->jump_table)
+	{
+	  struct ast *last = gen_code_computed_jump (s);
+	  if (last == NULL)
+	    last = gen_code_jump_table (s);
+	  if (last != NULL)
+	    {
+	      s = last;
+	      break;
+	    }
+	}
       gen_code_cond (s);
       break;
 
@@ -705,6 +2086,18 @@ gen_code_r (struct ast *s)
       EMIT1 ("jmp", print_loc (s->loc));
       break;
 
+    case label_value_type:
+      {
+	struct loc *t;
+	ALLOC_REGISTER (t);
+	const char *addr = my_printf ("%s(%%rip)", s->loc->base);
+	EMIT2 ("lea", addr, print_loc (t));
+	FREE (addr);
+	FREE_LOC (s->loc);
+	s->loc = t;
+      }
+      break;
+
     case integer_type:
       if (s->loc == NULL)
 	MAKE_BASE_LOC (s->loc, literal_loc,
@@ -733,13 +2126,36 @@ gen_code_r (struct ast *s)
       break;
 
     case alloc_type:
-      if (s->ops[0] != NULL)
+      /* The variables that were collected at the top of the function
+	 were already allocated when the frame was set up, so only the
+	 allocations whose address is used are left.  These are
+	 rounded up to keep the stack aligned and placed above the
+	 outgoing argument area. */
+      if (s->ops[0] != NULL && !s->throw_away)
 	{
 	  gen_code_r (s->ops[0]);
-	  EMIT2 ("sub", print_loc (s->ops[0]->loc), "%rsp");
+	  if (s->ops[0]->type == integer_type)
+	    {
+	      const char *size = my_printf ("$%lld", (s->ops[0]->op.integer.i
+						      + 15) / 16 * 16);
+	      EMIT2 ("sub", size, "%rsp");
+	      FREE (size);
+	    }
+	  else
+	    {
+	      ENSURE_DESTINATION_REGISTER_UNI (s->ops[0]->loc);
+	      EMIT2 ("add", "$15", print_loc (s->ops[0]->loc));
+	      EMIT2 ("and", "$-16", print_loc (s->ops[0]->loc));
+	      EMIT2 ("sub", print_loc (s->ops[0]->loc), "%rsp");
+	    }
 	  FREE_LOC (s->ops[0]->loc);
-	  MAKE_BASE_LOC (s->loc, register_loc, xstrdup ("%rsp"));
-	  GIVE_REGISTER (s->loc);
+	  MAKE_BASE_LOC (s->loc, memory_loc, xstrdup ("%rsp"));
+	  s->loc->offset = frame.outgoing;
+	  struct loc *t;
+	  ALLOC_REGISTER (t);
+	  EMIT2 ("lea", print_loc (s->loc), print_loc (t));
+	  FREE_LOC (s->loc);
+	  s->loc = t;
 	}
       break;
 
@@ -771,6 +2187,7 @@ gen_code (struct ast *s)
   str_labelno = 0;
   FREE (data_section);
   branch_labelno = 0;
+  table_labelno = 0;
 
   /* Set up branch codes. */
   binop_branch_suffix['<'] = "l";
@@ -783,5 +2200,7 @@ gen_code (struct ast *s)
   gen_code_r (s);
   PUT ("%s", data_section);
   FREE (data_section);
+  if (verbose)
+    peephole_report (stderr);
   return 0;
 }
@@ -0,0 +1,786 @@
+/**
+ * @file   gvn.c
+ * @author Kieran Colford <colfordk@gmail.com>
+ *
+ * @brief This is the value numbering pass, which finds expressions
+ * that are computed more than once and computes them only once.
+ *
+ * Copyright (C) 2014, 2015 Kieran Colford
+ *
+ * This file is part of Mongoose.
+ *
+ * Mongoose is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mongoose is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mongoose; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * @note Two expressions get the same value number when they apply
+ * the same operators to the same variables and nothing that they
+ * read changes in between.  The blocks are visited down the dominator
+ * tree, so the expressions that are available at the end of a block
+ * are available at the start of the blocks that it dominates, less
+ * the ones whose operands are changed along the way.  Each variable
+ * whose address is taken has a slot of its own, which is changed by
+ * storing to it by name, through a pointer or by a function call.
+ * The rest of memory is tracked as a whole: any store through a
+ * pointer, to a variable whose address is taken, or by a function
+ * call changes every load through a pointer.
+ *
+ * A store to one of those slots, or through a pointer, makes the
+ * value that it stores known for the loads of the same place after
+ * it, until something changes either the place or its address.
+ *
+ * The first time that an expression is used again, it is saved into
+ * a new slot in the frame just before the statement that computed it
+ * first, and every use of it after that loads the slot instead.
+ *
+ */
+
+#include "config.h"
+
+#include "ast.h"
+#include "ast_util.h"
+#include "cfg.h"
+#include "compiler.h"
+#include "free.h"
+#include "lib.h"
+#include "my_printf.h"
+#include "parse.h"
+#include "xalloc.h"
+
+#include <assert.h>
+#include <string.h>
+
+/**
+ * An expression that has been given a value number.
+ *
+ */
+
+struct gvn_expr
+{
+  struct ast *first;		/**< The first place that it is
+				   computed, or NULL once that is
+				   gone. */
+  struct ast **slot;		/**< The operand that holds
+				   gvn_expr::first. */
+  struct ast *stmt;		/**< The statement that computes
+				   it. */
+  int block;			/**< The block of gvn_expr::stmt. */
+  struct ast *temp;		/**< The slot that it is saved in, or
+				   NULL until it is used again. */
+  char *deps;			/**< Which of the tracked variables it
+				   reads, with memory as a whole
+				   after the last of them and then
+				   the slots. */
+  const struct ast *load;	/**< The place that gvn_expr::stmt
+				   stores the value in gvn_expr::slot
+				   to, or NULL if this is an
+				   expression that is computed. */
+};
+
+static struct cfg *graph;	/**< The function being numbered. */
+static struct gvn_expr **exprs;	/**< Every expression that has been
+				   numbered. */
+static int nexprs;		/**< The number of them. */
+static int width;		/**< The size of a set of what is read
+				   or changed. */
+
+/**
+ * Check if any of the variables in @c a are also in @c b.
+ *
+ * @param a The first set.
+ * @param b The second set.
+ *
+ * @return true if they overlap, false otherwise.
+ */
+static int
+overlaps (const char *a, const char *b)
+{
+  int v;
+  for (v = 0; v < width; v++)
+    if (a[v] && b[v])
+      return 1;
+  return 0;
+}
+
+/**
+ * Find the expression that was saved into the variable @c s.
+ *
+ * @param s The variable.
+ *
+ * @return The expression, or NULL if @c s isn't one of the slots
+ * that this pass made.
+ */
+static struct gvn_expr *
+find_temp (const struct ast *s)
+{
+  int i;
+  if (!IS_MEMORY (s->loc))
+    return NULL;
+  for (i = 0; i < nexprs; i++)
+    if (exprs[i]->temp != NULL
+	&& exprs[i]->temp->loc->offset == s->loc->offset)
+      return exprs[i];
+  return NULL;
+}
+
+/**
+ * Note which of the tracked variables and whether memory are read by
+ * the expression @c s.
+ *
+ * @param s The expression.
+ * @param deps The set to add them to.
+ */
+static void
+read_deps (const struct ast *s, char *deps)
+{
+  int j;
+  switch (s->type)
+    {
+    case variable_type:
+      j = cfg_var (graph, s);
+      if (j >= 0)
+	deps[j] = 1;
+      else if ((j = cfg_slot (graph, s)) >= 0)
+	deps[graph->nvars + 1 + j] = 1;
+      else
+	{
+	  const struct gvn_expr *e = find_temp (s);
+	  if (e == NULL)
+	    deps[graph->nvars] = 1;
+	  else
+	    for (j = 0; j < width; j++)
+	      deps[j] |= e->deps[j];
+	}
+      return;
+
+    case binary_type:
+      if (s->op.binary.op == '[')
+	deps[graph->nvars] = 1;
+      break;
+
+    case unary_type:
+      /* Only the address of a variable is taken, which never
+	 changes. */
+      if (s->op.unary.op == '&')
+	{
+	  if (s->ops[0]->type == variable_type)
+	    return;
+	  s = s->ops[0];
+	  for (j = 0; j < s->num_ops; j++)
+	    read_deps (s->ops[j], deps);
+	  return;
+	}
+      if (s->op.unary.op == '*')
+	deps[graph->nvars] = 1;
+      break;
+
+    default:
+      break;
+    }
+  for (j = 0; j < s->num_ops; j++)
+    {
+      const struct ast *i;
+      for (i = s->ops[j]; i != NULL; i = i->next)
+	read_deps (i, deps);
+    }
+}
+
+/**
+ * Note which of the slots of the variables whose address is taken
+ * are changed by evaluating @c s.  A store to one of them by name
+ * only changes that one, while a store through a pointer or a
+ * function call can change any of them.
+ *
+ * @param s The expression.
+ * @param kill The set to add them to.
+ */
+static void
+slot_kills (const struct ast *s, char *kill)
+{
+  const struct ast *l = NULL;
+  if (s->type == binary_type && s->op.binary.op == '=')
+    l = s->ops[0];
+  else if (s->type == unary_type && (s->op.unary.op == INC
+				     || s->op.unary.op == DEC))
+    l = s->ops[0];
+  int j = l == NULL ? -1 : cfg_slot (graph, l);
+  if (j >= 0)
+    kill[graph->nvars + 1 + j] = 1;
+  else if ((l != NULL && l->type != variable_type)
+	   || s->type == function_call_type)
+    memset (kill + graph->nvars + 1, 1, graph->nslots);
+  for (j = 0; j < s->num_ops; j++)
+    {
+      const struct ast *i;
+      for (i = s->ops[j]; i != NULL; i = i->next)
+	slot_kills (i, kill);
+    }
+}
+
+/**
+ * Note everything that is changed by evaluating @c s.
+ *
+ * @param s The expression.
+ * @param kill The set to add it to.
+ */
+static void
+kills_of (const struct ast *s, char *kill)
+{
+  cfg_kills (graph, s, kill);
+  slot_kills (s, kill);
+}
+
+int
+worth_saving (const struct ast *s)
+{
+  if (s->boolean_not || s->noreturnint || s->throw_away
+      || has_side_effects (s))
+    return 0;
+  switch (s->type)
+    {
+    case binary_type:
+      switch (s->op.binary.op)
+	{
+	case '[':
+	case '*':
+	case '/':
+	case '%':
+	  return 1;
+
+	case '+':
+	case '-':
+	case '&':
+	case '|':
+	case '^':
+	case LS:
+	case RS:
+	  break;
+
+	default:
+	  return 0;
+	}
+      break;
+
+    case unary_type:
+      switch (s->op.unary.op)
+	{
+	case '*':
+	  return 1;
+
+	case '-':
+	case '~':
+	  break;
+
+	default:
+	  return 0;
+	}
+      break;
+
+    default:
+      return 0;
+    }
+
+  /* A single cheap operation on variables and literals is done again
+     as quickly as its value could be loaded back. */
+  int j;
+  for (j = 0; j < s->num_ops; j++)
+    if (s->ops[j]->type == binary_type || s->ops[j]->type == unary_type)
+      return 1;
+  return 0;
+}
+
+/**
+ * Forget the expressions that are computed inside of @c s, since it
+ * is about to be thrown away.
+ *
+ * @param s The expression.
+ */
+static void
+forget (const struct ast *s)
+{
+  int i, j;
+  for (i = 0; i < nexprs; i++)
+    if (exprs[i]->first == s)
+      {
+	assert (exprs[i]->temp == NULL);
+	exprs[i]->first = NULL;
+      }
+  for (j = 0; j < s->num_ops; j++)
+    if (s->ops[j] != NULL)
+      forget (s->ops[j]);
+}
+
+/**
+ * Note that the expressions computed inside of @c s are now computed
+ * by the statement @c stmt.
+ *
+ * @param s The expression.
+ * @param stmt The statement.
+ */
+static void
+relocate (const struct ast *s, struct ast *stmt)
+{
+  int i, j;
+  for (i = 0; i < nexprs; i++)
+    if (exprs[i]->first == s)
+      exprs[i]->stmt = stmt;
+  for (j = 0; j < s->num_ops; j++)
+    if (s->ops[j] != NULL)
+      relocate (s->ops[j], stmt);
+}
+
+/**
+ * Save the expression @c e into a new slot just before the statement
+ * that computes it.
+ *
+ * @param e The expression.
+ */
+static void
+save (struct gvn_expr *e)
+{
+  static int tempno = 0;
+  struct ast **slot = e->slot, *v = *slot;
+  e->temp = cfg_new_temp (graph, my_printf ("cse.%d", tempno++));
+  struct ast *h = make_binary ('=', ast_dup (e->temp), v);
+  h->throw_away = 1;
+  *slot = ast_dup (e->temp);
+
+  /* The expression that is stored goes along with the value. */
+  int i;
+  for (i = 0; i < nexprs; i++)
+    if (exprs[i]->slot == slot && exprs[i]->first == v)
+      exprs[i]->slot = &h->ops[1];
+
+  struct ast **ss = &graph->function->ops[1]->ops[0];
+  while (*ss != e->stmt)
+    ss = &(*ss)->next;
+  h->next = *ss;
+  *ss = h;
+  if (graph->blocks[e->block].first == e->stmt)
+    graph->blocks[e->block].first = h;
+  relocate (v, h);
+}
+
+/**
+ * Replace the expression at @c ss with the value of @c e, which is
+ * saved first if it isn't already somewhere that it can be read
+ * from.  A store can leave a literal or a variable, which the value
+ * of @c e is as long as it is available.
+ *
+ * @param e The expression that is available.
+ * @param ss A reference to the expression to replace.
+ */
+static void
+reuse (struct gvn_expr *e, struct ast **ss)
+{
+  struct ast *s = *ss;
+  if (e->temp == NULL
+      && (e->load == NULL || ((*e->slot)->type != integer_type
+			      && (*e->slot)->type != variable_type)))
+    save (e);
+  *ss = ast_dup (e->temp != NULL ? e->temp : *e->slot);
+  forget (s);
+  AST_FREE (s);
+}
+
+/**
+ * The expressions that are available at some point.
+ *
+ */
+
+struct gvn_set
+{
+  int *e;			/**< The index of each expression. */
+  int n;			/**< The number of them. */
+};
+
+static void
+set_add (struct gvn_set *set, int e)
+{
+  set->e = xnrealloc (set->e, set->n + 1, sizeof *set->e);
+  set->e[set->n++] = e;
+}
+
+/**
+ * Remove the expressions from @c set that read something in @c kill
+ * or that have been thrown away.
+ *
+ * @param set The set.
+ * @param kill What has been changed.
+ */
+static void
+set_kill (struct gvn_set *set, const char *kill)
+{
+  int i, n = 0;
+  for (i = 0; i < set->n; i++)
+    {
+      const struct gvn_expr *e = exprs[set->e[i]];
+      if ((e->first != NULL || e->temp != NULL || e->load != NULL)
+	  && !overlaps (e->deps, kill))
+	set->e[n++] = set->e[i];
+    }
+  set->n = n;
+}
+
+/**
+ * Number the expression at @c ss, reusing the value of an earlier one
+ * if it is available.
+ *
+ * @param ss A reference to the expression.
+ * @param avail The expressions that are available.
+ * @param b The block that it is in.
+ * @param stmt The statement that it is in.
+ * @param kill What the statement changes.
+ * @param branch Whether it is only evaluated on one side of a
+ * conditional move, and so can't be saved for later.
+ */
+static void
+number (struct ast **ss, struct gvn_set *avail, int b, struct ast *stmt,
+	const char *kill, int branch)
+{
+  struct ast *s = *ss;
+  char *deps = xzalloc (width);
+  read_deps (s, deps);
+  if (overlaps (deps, kill))
+    {
+      FREE (deps);
+      return;
+    }
+
+  int i;
+  for (i = 0; i < avail->n; i++)
+    {
+      struct gvn_expr *e = exprs[avail->e[i]];
+      if (e->load != NULL ? !same_tree (e->load, s)
+	  : e->first == NULL || !same_tree (e->first, s))
+	continue;
+      FREE (deps);
+      reuse (e, ss);
+      return;
+    }
+
+  if (branch)
+    {
+      FREE (deps);
+      return;
+    }
+  struct gvn_expr *e = xzalloc (sizeof *e);
+  e->first = s;
+  e->slot = ss;
+  e->stmt = stmt;
+  e->block = b;
+  e->deps = deps;
+  exprs = xnrealloc (exprs, nexprs + 1, sizeof *exprs);
+  exprs[nexprs] = e;
+  set_add (avail, nexprs++);
+}
+
+/**
+ * Number the expressions inside of @c s from the bottom up.
+ *
+ * @param ss A reference to the expression.
+ * @param avail The expressions that are available.
+ * @param b The block that it is in.
+ * @param stmt The statement that it is in.
+ * @param kill What the statement changes.
+ * @param branch Whether it is only evaluated on one side of a
+ * conditional move.
+ * @param fixed Whether @c s itself has to stay where it is, because
+ * it is a statement or an argument.
+ */
+static void
+visit (struct ast **ss, struct gvn_set *avail, int b, struct ast *stmt,
+       const char *kill, int branch, int fixed)
+{
+  struct ast *s = *ss;
+  int j;
+  switch (s->type)
+    {
+    case binary_type:
+      if (s->op.binary.op == '=')
+	{
+	  /* The address that is stored to is read, but not what it
+	     holds. */
+	  struct ast *l = s->ops[0];
+	  if (l->type != variable_type)
+	    for (j = 0; j < l->num_ops; j++)
+	      visit (&l->ops[j], avail, b, stmt, kill, branch, 0);
+	  visit (&s->ops[1], avail, b, stmt, kill, branch, 0);
+	  return;
+	}
+      break;
+
+    case unary_type:
+      if (s->op.unary.op == '&')
+	return;
+      if (s->op.unary.op == INC || s->op.unary.op == DEC)
+	{
+	  struct ast *l = s->ops[0];
+	  if (l->type != variable_type)
+	    for (j = 0; j < l->num_ops; j++)
+	      visit (&l->ops[j], avail, b, stmt, kill, branch, 0);
+	  return;
+	}
+      break;
+
+    case ternary_type:
+      visit (&s->ops[0], avail, b, stmt, kill, branch, 0);
+      visit (&s->ops[1], avail, b, stmt, kill, 1, 0);
+      visit (&s->ops[2], avail, b, stmt, kill, 1, 0);
+      return;
+
+    case function_call_type:
+      {
+	struct ast *i;
+	for (i = s->ops[1]; i != NULL; i = i->next)
+	  if (i->type != block_type)
+	    visit (&i, avail, b, stmt, kill, branch, 1);
+	return;
+      }
+
+    case variable_type:
+      /* A load of a variable whose address is taken can use the
+	 value that was last stored to it. */
+      if (!fixed && !s->noreturnint && cfg_slot (graph, s) >= 0
+	  && !kill[graph->nvars + 1 + cfg_slot (graph, s)])
+	for (j = 0; j < avail->n; j++)
+	  {
+	    struct gvn_expr *e = exprs[avail->e[j]];
+	    if (e->load != NULL && same_tree (e->load, s))
+	      {
+		reuse (e, ss);
+		return;
+	      }
+	  }
+      return;
+
+    default:
+      return;
+    }
+
+  for (j = 0; j < s->num_ops; j++)
+    visit (&s->ops[j], avail, b, stmt, kill, branch, 0);
+  if (!fixed && worth_saving (s))
+    number (ss, avail, b, stmt, kill, branch);
+}
+
+/**
+ * Find what can be changed on the way from block @c d to block @c b,
+ * not counting either of them unless the way loops through @c b.
+ *
+ * @param d The block that dominates @c b.
+ * @param b The block.
+ * @param kills What each block changes.
+ * @param kill The set to add to.
+ */
+static void
+between_kills (int d, int b, const char *kills, char *kill)
+{
+  const struct cfg_block *blk = &graph->blocks[b];
+  if (blk->npreds == 1 && blk->preds[0] == d)
+    return;
+
+  int n = width, depth = 0, i, v;
+  int *stack = xcalloc (graph->nblocks, sizeof *stack);
+  char *seen = xzalloc (graph->nblocks);
+  for (i = 0; i < blk->npreds; i++)
+    if (!seen[blk->preds[i]] && blk->preds[i] != d)
+      {
+	seen[blk->preds[i]] = 1;
+	stack[depth++] = blk->preds[i];
+      }
+  while (depth > 0)
+    {
+      int x = stack[--depth];
+      for (v = 0; v < n; v++)
+	kill[v] |= kills[x * n + v];
+      const struct cfg_block *p = &graph->blocks[x];
+      for (i = 0; i < p->npreds; i++)
+	if (!seen[p->preds[i]] && p->preds[i] != d)
+	  {
+	    seen[p->preds[i]] = 1;
+	    stack[depth++] = p->preds[i];
+	  }
+    }
+  FREE (seen);
+  FREE (stack);
+}
+
+/**
+ * Make the value that the statement @c s stores known for the loads
+ * of the same place, if it stores to a variable whose address is
+ * taken or through a pointer.
+ *
+ * @param s The statement.
+ * @param avail The expressions that are available after it.
+ * @param b The block that it is in.
+ * @param kill What the statement changes.
+ */
+static void
+forward (struct ast *s, struct gvn_set *avail, int b, const char *kill)
+{
+  if (s->type != binary_type || s->op.binary.op != '=')
+    return;
+  struct ast *l = s->ops[0], *v = s->ops[1];
+  if (l->type == variable_type ? cfg_slot (graph, l) < 0
+      : !((l->type == unary_type && l->op.unary.op == '*')
+	  || (l->type == binary_type && l->op.binary.op == '[')))
+    return;
+
+  /* The place has to be the same one once the store is done. */
+  char *deps = xzalloc (width);
+  int j;
+  for (j = 0; j < l->num_ops; j++)
+    read_deps (l->ops[j], deps);
+  if (has_side_effects (l) || overlaps (deps, kill))
+    {
+      FREE (deps);
+      return;
+    }
+  read_deps (l, deps);
+  if (v->type == variable_type)
+    read_deps (v, deps);
+
+  struct gvn_expr *e = xzalloc (sizeof *e);
+  e->slot = &s->ops[1];
+  e->stmt = s;
+  e->block = b;
+  e->deps = deps;
+  e->load = l;
+  exprs = xnrealloc (exprs, nexprs + 1, sizeof *exprs);
+  exprs[nexprs] = e;
+  set_add (avail, nexprs++);
+}
+
+static void
+gvn_function (struct ast *f)
+{
+  struct cfg *g = cfg_build (f);
+  graph = g;
+  width = g->nvars + 1 + g->nslots;
+  int nb = g->nblocks, n = width, b, k;
+  if (nb == 0)
+    {
+      cfg_free (g);
+      return;
+    }
+  cfg_dominators (g);
+
+  char *kills = xzalloc ((size_t) nb * n);
+  for (b = 0; b < nb; b++)
+    {
+      struct ast *s;
+      CFG_FOREACH_STMT (s, &g->blocks[b])
+	{
+	  struct ast *e = cfg_stmt_expr (s);
+	  if (e != NULL)
+	    kills_of (e, &kills[b * n]);
+	}
+    }
+
+  /* Walk down the dominator tree, which the blocks are in the order
+     of as long as every block comes after its immediate dominator. */
+  int *order = xcalloc (nb, sizeof *order);
+  char *done = xzalloc (nb);
+  int norder = 0;
+  order[norder++] = 0;
+  done[0] = 1;
+  for (k = 0; k < norder; k++)
+    for (b = 0; b < nb; b++)
+      if (!done[b] && g->blocks[b].idom == order[k])
+	{
+	  done[b] = 1;
+	  order[norder++] = b;
+	}
+
+  struct gvn_set *outs = xcalloc (nb, sizeof *outs);
+  char *kill = xzalloc (n);
+  for (k = 0; k < norder; k++)
+    {
+      b = order[k];
+      struct gvn_set avail = { NULL, 0 };
+      if (b != 0)
+	{
+	  int d = g->blocks[b].idom;
+	  memset (kill, 0, n);
+	  between_kills (d, b, kills, kill);
+	  int i;
+	  for (i = 0; i < outs[d].n; i++)
+	    set_add (&avail, outs[d].e[i]);
+	  set_kill (&avail, kill);
+	}
+
+      struct ast *s;
+      CFG_FOREACH_STMT (s, &g->blocks[b])
+	{
+	  struct ast **e;
+	  switch (s->type)
+	    {
+	    case cond_type:
+	    case ret_type:
+	      e = &s->ops[0];
+	      break;
+
+	    case binary_type:
+	    case unary_type:
+	    case function_call_type:
+	    case ternary_type:
+	      e = NULL;
+	      break;
+
+	    default:
+	      continue;
+	    }
+	  if (e != NULL && *e == NULL)
+	    continue;
+	  memset (kill, 0, n);
+	  kills_of (e != NULL ? *e : s, kill);
+	  if (e != NULL)
+	    visit (e, &avail, b, s, kill, 0, 0);
+	  else
+	    visit (&s, &avail, b, s, kill, 0, 1);
+	  set_kill (&avail, kill);
+	  forward (s, &avail, b, kill);
+	}
+      outs[b] = avail;
+    }
+
+  for (b = 0; b < nb; b++)
+    FREE (outs[b].e);
+  FREE (outs);
+  FREE (kill);
+  FREE (done);
+  FREE (order);
+  FREE (kills);
+  for (k = 0; k < nexprs; k++)
+    {
+      FREE (exprs[k]->deps);
+      AST_FREE (exprs[k]->temp);
+      FREE (exprs[k]);
+    }
+  FREE (exprs);
+  nexprs = 0;
+  cfg_free (g);
+  graph = NULL;
+}
+
+int
+gvn (struct ast *s)
+{
+  if (optimize < 1)
+    return 0;
+  for (; s != NULL; s = s->next)
+    if (s->type == function_type)
+      gvn_function (s);
+  return 0;
+}
@@ -0,0 +1,423 @@
+/**
+ * @file   ifconv.c
+ * @author Kieran Colford <colfordk@gmail.com>
+ *
+ * @brief This is the if-conversion pass.
+ *
+ * Copyright (C) 2014, 2015 Kieran Colford
+ *
+ * This file is part of Mongoose.
+ *
+ * Mongoose is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mongoose is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mongoose; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * @note An if statement whose arms each store to the same variable,
+ * or each return, becomes a single store or return of a ternary,
+ * which is generated as a conditional move instead of a branch.  The
+ * shapes that are looked for are the diamond
+ *
+ * @code
+ * if (c) goto else; x = a; goto end; else: x = b; end:
+ * @endcode
+ *
+ * which becomes x = c ? b : a, the triangle
+ *
+ * @code
+ * if (c) goto end; x = a; end:
+ * @endcode
+ *
+ * which becomes x = c ? x : a, and the same two with returns in
+ * place of the stores, which is how min, max, abs and clamp are
+ * usually written.  A ternary works out both of its arms, so they
+ * can't have side effects or fault, and the condition can't have
+ * side effects since it is now worked out after them.  The arms have
+ * to be cheap too, since a branch that is predicted well costs less
+ * than doing the work of both.  Each conversion can make another one
+ * around it possible, so the pass is repeated until nothing more
+ * changes.
+ *
+ */
+
+#include "config.h"
+
+#include "ast.h"
+#include "ast_util.h"
+#include "cfg.h"
+#include "compiler.h"
+#include "free.h"
+#include "lib.h"
+#include "parse.h"
+#include "xalloc.h"
+
+#define MAX_COST 8		/**< The most that both arms together can
+				   cost. */
+
+static struct ast *function;	/**< The function being worked on. */
+
+/**
+ * Work out what it costs to compute @c s when both arms of a ternary
+ * are always run.
+ *
+ * @param s The expression.
+ * @param test Whether @c s is the condition of a ternary, which can
+ * be a comparison or can be negated.
+ *
+ * @return The cost, or -1 if it can't be run unconditionally.
+ */
+static int
+cost (const struct ast *s, int test)
+{
+  int c, d;
+  if (s->boolean_not && !test)
+    return -1;
+  switch (s->type)
+    {
+    case integer_type:
+      return 1;
+
+    case variable_type:
+      return s->op.variable.type == NULL ? 1 : -1;
+
+    case unary_type:
+      switch (s->op.unary.op)
+	{
+	case '-':
+	case '~':
+	  c = cost (s->ops[0], 0);
+	  return c < 0 ? -1 : 1 + c;
+
+	case '&':
+	  return (s->ops[0]->type == string_type
+		  || s->ops[0]->type == variable_type) ? 1 : -1;
+
+	default:
+	  return -1;
+	}
+
+    case binary_type:
+      switch (s->op.binary.op)
+	{
+	case '+':
+	case '-':
+	case '&':
+	case '|':
+	case '^':
+	case LS:
+	case RS:
+	case '*':
+	  break;
+
+	case EQ:
+	case '<':
+	case '>':
+	case LE:
+	case GE:
+	  if (test)
+	    break;
+	  return -1;
+
+	default:
+	  return -1;
+	}
+      c = cost (s->ops[0], 0);
+      d = cost (s->ops[1], 0);
+      if (c < 0 || d < 0)
+	return -1;
+      return (s->op.binary.op == '*' ? 3 : 1) + c + d;
+
+    case ternary_type:
+      c = cost (s->ops[0], 1);
+      if (c < 0)
+	return -1;
+      d = cost (s->ops[1], 0);
+      if (d < 0)
+	return -1;
+      c += d;
+      d = cost (s->ops[2], 0);
+      return d < 0 ? -1 : 1 + c + d;
+
+    default:
+      return -1;
+    }
+}
+
+/**
+ * Count the jumps and conditional gotos of the function to the label
+ * @c l, and one more if its address is taken.
+ *
+ * @param l The label.
+ *
+ * @return The number of them.
+ */
+static int
+uses (const struct ast *l)
+{
+  const struct ast *s;
+  int n = takes_label_address (function->ops[1], l->loc->base);
+  for (s = function->ops[1]->ops[0]; s != NULL; s = s->next)
+    if ((s->type == jump_type || s->type == cond_type)
+	&& STREQ (s->loc->base, l->loc->base))
+      n++;
+  return n;
+}
+
+/**
+ * Check if @c s is the label that only the jump or conditional goto
+ * @c j goes to.
+ *
+ * @param s The statement.
+ * @param j The jump.
+ *
+ * @return true if it is, false otherwise.
+ */
+static int
+only_target (const struct ast *s, const struct ast *j)
+{
+  return (s != NULL && s->type == label_type
+	  && STREQ (s->loc->base, j->loc->base) && uses (s) == 1);
+}
+
+/**
+ * Check if @c s stores a value to a plain variable.
+ *
+ * @param s The statement.
+ *
+ * @return true if it does, false otherwise.
+ */
+static int
+is_store (const struct ast *s)
+{
+  return (s != NULL && s->type == binary_type && s->op.binary.op == '='
+	  && s->ops[0]->type == variable_type
+	  && s->ops[0]->op.variable.type == NULL
+	  && IS_MEMORY (s->ops[0]->loc));
+}
+
+/**
+ * Check if selecting between @c a and @c b on the condition @c c is
+ * cheaper than branching.
+ *
+ * @param c The condition.
+ * @param a One arm.
+ * @param b The other arm.
+ *
+ * @return true if it is, false otherwise.
+ */
+static int
+worth_converting (const struct ast *c, const struct ast *a,
+		  const struct ast *b)
+{
+  if (has_side_effects (c))
+    return 0;
+  int x = cost (a, 0), y = cost (b, 0);
+  return x >= 0 && y >= 0 && x + y <= MAX_COST;
+}
+
+/**
+ * Point the jumps and conditional gotos to the label @c from at the
+ * label @c to instead.
+ *
+ * @param from The old label.
+ * @param to The new label.
+ */
+static void
+retarget (const struct ast *from, const struct ast *to)
+{
+  struct ast *s;
+  for (s = function->ops[1]->ops[0]; s != NULL; s = s->next)
+    if ((s->type == jump_type || s->type == cond_type)
+	&& STREQ (s->loc->base, from->loc->base))
+      {
+	FREE (s->loc->base);
+	s->loc->base = xstrdup (to->loc->base);
+      }
+}
+
+/**
+ * Drop the statements that can't be reached after a jump or a return
+ * and the jumps to the labels right after them, and merge each run of
+ * labels into the first one.  The inliner and nested if statements
+ * leave these behind, and they hide the shapes that are looked for.
+ */
+static void
+tidy (void)
+{
+  struct ast **ss, *s, *t;
+  for (ss = &function->ops[1]->ops[0]; *ss != NULL;)
+    {
+      s = *ss;
+      if (s->type == jump_type)
+	{
+	  for (t = s->next; t != NULL && t->type == label_type; t = t->next)
+	    if (STREQ (t->loc->base, s->loc->base))
+	      break;
+	  if (t != NULL && t->type == label_type)
+	    {
+	      *ss = s->next;
+	      s->next = NULL;
+	      AST_FREE (s);
+	      continue;
+	    }
+	}
+      t = s->next;
+      if ((s->type == jump_type || s->type == ret_type) && t != NULL
+	  && t->type != label_type)
+	{
+	  s->next = t->next;
+	  t->next = NULL;
+	  AST_FREE (t);
+	  continue;
+	}
+      if (s->type == label_type && t != NULL && t->type == label_type
+	  && !takes_label_address (function->ops[1], t->loc->base))
+	{
+	  retarget (t, s);
+	  if (t->unroll)
+	    s->unroll = t->unroll;
+	  s->next = t->next;
+	  t->next = NULL;
+	  AST_FREE (t);
+	  continue;
+	}
+      ss = &s->next;
+    }
+}
+
+/**
+ * Take the statements from @c s up to but not including @c end out
+ * of the list and free them.
+ *
+ * @param s The first statement.
+ * @param end The statement after the last one.
+ */
+static void
+drop (struct ast *s, struct ast *end)
+{
+  while (s != end)
+    {
+      struct ast *n = s->next;
+      s->next = NULL;
+      AST_FREE (s);
+      s = n;
+    }
+}
+
+/**
+ * Turn the if statement that starts at @c ss into a ternary if it has
+ * one of the shapes that this pass looks for.
+ *
+ * @param ss A reference to the conditional goto.
+ *
+ * @return true if it was converted, false otherwise.
+ */
+static int
+convert (struct ast **ss)
+{
+  struct ast *c = *ss, *a = c->next, *j, *l, *b, *e;
+  if (c->type != cond_type || a == NULL)
+    return 0;
+
+  if (is_store (a))
+    {
+      /* The triangle. */
+      l = a->next;
+      if (only_target (l, c)
+	  && worth_converting (c->ops[0], a->ops[0], a->ops[1]))
+	{
+	  struct ast *x = make_variable (NULL,
+					 xstrdup (a->ops[0]->op.variable.name));
+	  x->loc = loc_dup (a->ops[0]->loc);
+	  a->ops[1] = make_ternary (c->ops[0], x, a->ops[1]);
+	  c->ops[0] = NULL;
+	  a->next = l->next;
+	  l->next = NULL;
+	  AST_FREE (l);
+	  c->next = NULL;
+	  AST_FREE (c);
+	  *ss = a;
+	  return 1;
+	}
+
+      /* The diamond. */
+      j = a->next;
+      if (j == NULL || j->type != jump_type)
+	return 0;
+      l = j->next;
+      b = l == NULL ? NULL : l->next;
+      e = b == NULL ? NULL : b->next;
+      if (!only_target (l, c) || !is_store (b) || e == NULL
+	  || e->type != label_type || STRNEQ (e->loc->base, j->loc->base)
+	  || !same_tree (a->ops[0], b->ops[0])
+	  || !worth_converting (c->ops[0], a->ops[1], b->ops[1]))
+	return 0;
+      b->ops[1] = make_ternary (c->ops[0], b->ops[1], a->ops[1]);
+      c->ops[0] = NULL;
+      a->ops[1] = NULL;
+      /* Other arms can still be leaving through the end. */
+      if (uses (e) == 1)
+	{
+	  b->next = e->next;
+	  e->next = NULL;
+	  AST_FREE (e);
+	}
+      drop (c, b);
+      *ss = b;
+      return 1;
+    }
+
+  /* The same with returns, where the jump past the else arm can't be
+     reached. */
+  if (a->type != ret_type || a->ops[0] == NULL)
+    return 0;
+  l = a->next;
+  if (l != NULL && l->type == jump_type)
+    l = l->next;
+  b = l == NULL ? NULL : l->next;
+  if (!only_target (l, c) || b == NULL || b->type != ret_type
+      || b->ops[0] == NULL
+      || !worth_converting (c->ops[0], a->ops[0], b->ops[0]))
+    return 0;
+  b->ops[0] = make_ternary (c->ops[0], b->ops[0], a->ops[0]);
+  c->ops[0] = NULL;
+  a->ops[0] = NULL;
+  drop (c, b);
+  *ss = b;
+  return 1;
+}
+
+int
+ifconv (struct ast *s)
+{
+  if (optimize < 1)
+    return 0;
+  for (; s != NULL; s = s->next)
+    if (s->type == function_type)
+      {
+	/* The statements have to be seen all at the same level. */
+	cfg_free (cfg_build (s));
+	function = s;
+	tidy ();
+	int changed;
+	do
+	  {
+	    struct ast **ss;
+	    changed = 0;
+	    for (ss = &s->ops[1]->ops[0]; *ss != NULL; ss = &(*ss)->next)
+	      changed |= convert (ss);
+	  }
+	while (changed);
+	function = NULL;
+      }
+  return 0;
+}
@@ -0,0 +1,654 @@
+/**
+ * @file   inliner.c
+ * @author Kieran Colford <colfordk@gmail.com>
+ *
+ * @brief This is the function inlining pass.
+ *
+ * Copyright (C) 2014, 2015 Kieran Colford
+ *
+ * This file is part of Mongoose.
+ *
+ * Mongoose is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mongoose is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mongoose; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * @note A call to a function that is defined in the same file is
+ * replaced by a copy of its body, so that
+ *
+ * @code
+ * x = f (a, b);
+ * @endcode
+ *
+ * becomes
+ *
+ * @code
+ * p = a; q = b; body of f, with each return v as t = v; goto end;
+ * end: x = t;
+ * @endcode
+ *
+ * where the parameters @c p and @c q, the locals of @c f and @c t get
+ * new slots at the bottom of the caller's frame.  A call that is
+ * returned is replaced by the copy with its returns left alone.  The
+ * functions are done from the bottom of the call graph up, so that
+ * whatever a function calls has already had its own calls inlined,
+ * and a call back into a function that is still being worked on,
+ * which is recursion, is left alone.
+ *
+ * Whether a call is worth it is decided by the size of the function
+ * against what the call costs, with literal arguments counting in
+ * favour since they can be folded into the copy.  A tiny function
+ * that was declared static inline is always inlined.  A static
+ * function that is only called once is allowed to be much bigger,
+ * since the original can then be dropped.  Each caller can only grow
+ * by so much.  Only the calls that are run whenever their statement
+ * is, and not the ones in the arms of a ternary or on the right of
+ * an && or ||, are inlined.
+ *
+ */
+
+#include "config.h"
+
+#include "ast.h"
+#include "ast_util.h"
+#include "cfg.h"
+#include "compiler.h"
+#include "free.h"
+#include "lib.h"
+#include "my_printf.h"
+#include "parse.h"
+#include "xalloc.h"
+
+#define TINY_SIZE 16		/**< The size of a static inline function
+				   that is always inlined. */
+#define CALL_COST 6		/**< What a call costs, besides its
+				   arguments. */
+#define LITERAL_BONUS 4		/**< What a literal argument is worth. */
+#define INLINE_LIMIT 40		/**< How much bigger than the call a
+				   function can be. */
+#define ONCE_LIMIT 200		/**< How much bigger than the call a
+				   static function that is only called
+				   once can be. */
+#define GROWTH_LIMIT 400	/**< How much a caller can grow. */
+
+enum
+  {
+    NOT_VISITED,		/**< Not reached yet. */
+    VISITING,			/**< Its callees are being done. */
+    DONE			/**< Its calls have been inlined. */
+  };
+
+static struct ast **funcs;	/**< The functions of the file. */
+static int nfuncs;		/**< The number of them. */
+static int *state;		/**< How far along each function is. */
+static int *sizes;		/**< The size of each function that is
+				   done. */
+static int *ncalls;		/**< The number of calls to each
+				   function in the file. */
+static int growth;		/**< How much the current caller has
+				   grown by. */
+static int labelno = 1;		/**< The number of the next label. */
+static int tempno = 0;		/**< The number of the next result. */
+
+/**
+ * Find the function called @c name.
+ *
+ * @param name The name.
+ *
+ * @return Its index in @c funcs, or -1.
+ */
+static int
+find_function (const char *name)
+{
+  int i;
+  for (i = 0; i < nfuncs; i++)
+    if (STREQ (funcs[i]->op.function.name, name))
+      return i;
+  return -1;
+}
+
+/**
+ * Find the function that the call @c s is to.
+ *
+ * @param s The call.
+ *
+ * @return Its index in @c funcs, or -1.
+ */
+static int
+callee (const struct ast *s)
+{
+  if (s->ops[0]->type != variable_type)
+    return -1;
+  return find_function (s->ops[0]->op.variable.name);
+}
+
+/**
+ * Count the nodes of the list @c s.
+ *
+ * @param s The list.
+ *
+ * @return The number of them.
+ */
+static int
+tree_size (const struct ast *s)
+{
+  int n = 0, j;
+  for (; s != NULL; s = s->next)
+    {
+      n++;
+      for (j = 0; j < s->num_ops; j++)
+	n += tree_size (s->ops[j]);
+    }
+  return n;
+}
+
+/**
+ * Get the size of the frame of the function @c f, less anything that
+ * is allocated at run time.
+ *
+ * @param f The function.
+ *
+ * @return The size in bytes.
+ */
+static int
+frame_size (const struct ast *f)
+{
+  int size = 0;
+  const struct ast *i;
+  for (i = f->ops[0]; i != NULL; i = i->next)
+    if (i->type == variable_type)
+      size += i->op.variable.alloc;
+  for (i = f->ops[1]->ops[0]; i != NULL; i = i->next)
+    if (i->type == alloc_type && i->throw_away && i->ops[0] != NULL
+	&& i->ops[0]->type == integer_type)
+      size += i->ops[0]->op.integer.i;
+  return size;
+}
+
+/**
+ * Check if the list @c s allocates memory at run time.
+ *
+ * @param s The list.
+ *
+ * @return true if it does, false otherwise.
+ */
+static int
+is_dynamic (const struct ast *s)
+{
+  int j;
+  for (; s != NULL; s = s->next)
+    {
+      if (s->type == alloc_type && s->ops[0] != NULL
+	  && (!s->throw_away || s->ops[0]->type != integer_type))
+	return 1;
+      for (j = 0; j < s->num_ops; j++)
+	if (is_dynamic (s->ops[j]))
+	  return 1;
+    }
+  return 0;
+}
+
+/**
+ * Check if the function @c f can be copied into another one.  Its
+ * parameters all have to come in registers, since the ones on the
+ * stack are above its frame, it can't move the stack pointer, and the
+ * addresses of its labels can't be taken, since they would still be
+ * those of the original.
+ *
+ * @param f The function.
+ *
+ * @return true if it can, false otherwise.
+ */
+static int
+can_inline (const struct ast *f)
+{
+  const struct ast *i;
+  for (i = f->ops[0]; i != NULL; i = i->next)
+    if (i->type == variable_type && i->loc->offset > 0)
+      return 0;
+  return !is_dynamic (f->ops[1]) && !takes_label_address (f->ops[1], NULL);
+}
+
+/**
+ * Decide if the call @c s should be inlined.
+ *
+ * @param s The call.
+ *
+ * @return true if it should, false otherwise.
+ */
+static int
+worth_inlining (const struct ast *s)
+{
+  int k = callee (s);
+  if (k < 0 || state[k] != DONE || !can_inline (funcs[k]))
+    return 0;
+
+  /* The arguments have to line up with the parameters. */
+  const struct ast *f = funcs[k], *i, *j;
+  int nargs = 0, literals = 0;
+  for (i = s->ops[1], j = f->ops[0]; i != NULL; i = i->next, j = j->next)
+    {
+      while (j != NULL && j->type != variable_type)
+	j = j->next;
+      if (i->type == block_type || j == NULL)
+	return 0;
+      nargs++;
+      literals += i->type == integer_type;
+    }
+  while (j != NULL && j->type != variable_type)
+    j = j->next;
+  if (j != NULL)
+    return 0;
+
+  if (f->static_decl && f->inline_decl && sizes[k] <= TINY_SIZE)
+    return 1;
+  int limit = f->static_decl && ncalls[k] == 1 ? ONCE_LIMIT : INLINE_LIMIT;
+  int cost = sizes[k] - CALL_COST - nargs - LITERAL_BONUS * literals;
+  return cost <= limit && growth + sizes[k] <= GROWTH_LIMIT;
+}
+
+/**
+ * Find the first call in the expression at @c ss that should be
+ * inlined, in the order that they are run.
+ *
+ * @param ss A reference to the expression.
+ *
+ * @return A reference to the call, or NULL.
+ */
+static struct ast **
+find_call (struct ast **ss)
+{
+  struct ast *s = *ss, **c, **i;
+  int j;
+  switch (s->type)
+    {
+    case function_call_type:
+      for (i = &s->ops[1]; *i != NULL; i = &(*i)->next)
+	if ((*i)->type != block_type && (c = find_call (i)) != NULL)
+	  return c;
+      return worth_inlining (s) ? ss : NULL;
+
+    case ternary_type:
+      return find_call (&s->ops[0]);
+
+    case binary_type:
+      if (s->op.binary.op == AND || s->op.binary.op == OR)
+	return find_call (&s->ops[0]);
+      break;
+
+    case alloc_type:
+      return NULL;
+
+    default:
+      break;
+    }
+  for (j = 0; j < s->num_ops; j++)
+    if (s->ops[j] != NULL && (c = find_call (&s->ops[j])) != NULL)
+      return c;
+  return NULL;
+}
+
+/**
+ * Move the slots of the frame that the list @c s uses down by @c
+ * dist bytes.
+ *
+ * @param s The list.
+ * @param dist How far to move them.
+ */
+static void
+rebase (struct ast *s, int dist)
+{
+  int j;
+  for (; s != NULL; s = s->next)
+    {
+      if (IS_MEMORY (s->loc) && STREQ (s->loc->base, "%rbp"))
+	s->loc->offset -= dist;
+      for (j = 0; j < s->num_ops; j++)
+	rebase (s->ops[j], dist);
+    }
+}
+
+/**
+ * Make a new label.
+ *
+ * @return The label.
+ */
+static struct ast *
+new_label (void)
+{
+  char *name = my_printf (".LI%d", labelno++);
+  struct ast *l = make_label (xstrdup (name));
+  MAKE_BASE_LOC (l->loc, symbol_loc, name);
+  return l;
+}
+
+/**
+ * Replace the call at @c cc, which is in the statement at @c ss of
+ * the function @c f, with a copy of the function that it calls.
+ *
+ * @param f The caller.
+ * @param ss A reference to the statement.
+ * @param cc A reference to the call.
+ *
+ * @return A reference to what is left of the statement.
+ */
+static struct ast **
+inline_call (struct ast *f, struct ast **ss, struct ast **cc)
+{
+  struct ast *call = *cc, *g = funcs[callee (call)];
+  int base = frame_size (f), size = frame_size (g);
+  int tail = (*ss)->type == ret_type && cc == &(*ss)->ops[0];
+  int want = call != *ss && !tail;
+  struct ast *out = NULL, *t = NULL, *i, *j;
+  growth += sizes[callee (call)];
+
+  /* Make room for the copy in the caller's frame. */
+  if (size + 8 * want > 0)
+    {
+      struct ast *a = make_alloc (make_integer (size + 8 * want));
+      a->throw_away = 1;
+      a->next = f->ops[1]->ops[0];
+      if (ss == &f->ops[1]->ops[0])
+	ss = &a->next;
+      f->ops[1]->ops[0] = a;
+    }
+  if (want)
+    {
+      t = make_variable (NULL, my_printf ("inl.%d", tempno++));
+      MAKE_BASE_LOC (t->loc, memory_loc, xstrdup ("%rbp"));
+      t->loc->offset = -(base + size + 8);
+    }
+
+  /* Store the arguments into the parameters. */
+  struct ast *args = call->ops[1];
+  call->ops[1] = NULL;
+  for (j = g->ops[0]; args != NULL; j = j->next)
+    {
+      if (j->type != variable_type)
+	continue;
+      struct ast *p = make_variable (NULL, xstrdup (j->op.variable.name));
+      p->loc = loc_dup (j->loc);
+      p->loc->offset -= base;
+      i = args;
+      args = args->next;
+      i->next = NULL;
+      struct ast *st = make_binary ('=', p, i);
+      st->throw_away = 1;
+      out = ast_cat (out, st);
+    }
+
+  /* Give the labels of the copy new names. */
+  const char **from = NULL;
+  char **to = NULL;
+  int nlabels = 0, k;
+  for (i = g->ops[1]->ops[0]; i != NULL; i = i->next)
+    if (i->type == label_type)
+      {
+	from = xnrealloc (from, nlabels + 1, sizeof *from);
+	to = xnrealloc (to, nlabels + 1, sizeof *to);
+	from[nlabels] = i->loc->base;
+	to[nlabels++] = my_printf (".LI%d", labelno++);
+      }
+  struct ast *end = tail ? NULL : new_label ();
+
+  /* Copy the body. */
+  for (i = g->ops[1]->ops[0]; i != NULL; i = i->next)
+    {
+      if (i->type == alloc_type)
+	continue;
+      struct ast *n = i->next;
+      i->next = NULL;
+      struct ast *c = ast_dup (i);
+      i->next = n;
+      rebase (c, base);
+      if (c->type == label_type || c->type == jump_type
+	  || c->type == cond_type)
+	for (k = 0; k < nlabels; k++)
+	  if (STREQ (c->loc->base, from[k]))
+	    {
+	      FREE (c->loc->base);
+	      c->loc->base = xstrdup (to[k]);
+	      break;
+	    }
+      if (c->type == ret_type && !tail)
+	{
+	  struct ast *v = c->ops[0];
+	  c->ops[0] = NULL;
+	  AST_FREE (c);
+	  if (v != NULL && want)
+	    v = make_binary ('=', ast_dup (t), v);
+	  if (v != NULL)
+	    {
+	      v->throw_away = 1;
+	      out = ast_cat (out, v);
+	    }
+	  /* The last return falls through to the end anyway. */
+	  if (n == NULL)
+	    continue;
+	  c = make_jump (xstrdup (end->loc->base));
+	  c->loc = loc_dup (end->loc);
+	}
+      out = ast_cat (out, c);
+    }
+  out = ast_cat (out, end);
+  for (k = 0; k < nlabels; k++)
+    FREE (to[k]);
+  FREE (to);
+  FREE (from);
+
+  /* Put the copy in front of the statement, and its result in place
+     of the call.  When the call is returned the copy returns by
+     itself, which keeps the calls that it returns in tail position,
+     so it takes the place of the whole statement. */
+  struct ast *last = out;
+  while (last->next != NULL)
+    last = last->next;
+  if (tail)
+    {
+      struct ast *r = *ss;
+      r->ops[0] = NULL;
+      last->next = r->next;
+      r->next = NULL;
+      AST_FREE (r);
+    }
+  else if (want)
+    {
+      t->next = call->next;
+      t->boolean_not = call->boolean_not;
+      *cc = t;
+      last->next = *ss;
+    }
+  else
+    last->next = call->next;
+  call->next = NULL;
+  *ss = out;
+  AST_FREE (call);
+  return &last->next;
+}
+
+/**
+ * Inline the calls of the function @c f that are worth it.
+ *
+ * @param f The function.
+ */
+static void
+inline_function (struct ast *f)
+{
+  /* The statements have to be seen all at the same level. */
+  cfg_free (cfg_build (f));
+  growth = 0;
+
+  struct ast **ss = &f->ops[1]->ops[0];
+  while (*ss != NULL)
+    {
+      struct ast *s = *ss, **e = ss, **c;
+      switch (s->type)
+	{
+	case cond_type:
+	case ret_type:
+	  e = &s->ops[0];
+	  break;
+
+	case label_type:
+	case jump_type:
+	case alloc_type:
+	  e = NULL;
+	  break;
+
+	default:
+	  break;
+	}
+      if (e != NULL && *e != NULL && (c = find_call (e)) != NULL)
+	ss = inline_call (f, ss, c);
+      else
+	ss = &s->next;
+    }
+}
+
+/**
+ * Note the calls in the list @c s to functions of the file.
+ *
+ * @param s The list.
+ * @param count Whether to count the calls in @c ncalls, rather than
+ * visit the functions that they are to.
+ */
+static void visit_calls (const struct ast *s, int count);
+
+/**
+ * Inline the calls of the function @c k, after doing the ones of
+ * every function that it calls.
+ *
+ * @param k The index of the function.
+ */
+static void
+visit (int k)
+{
+  state[k] = VISITING;
+  visit_calls (funcs[k]->ops[1], 0);
+  inline_function (funcs[k]);
+  sizes[k] = tree_size (funcs[k]->ops[1]);
+  state[k] = DONE;
+}
+
+static void
+visit_calls (const struct ast *s, int count)
+{
+  int j;
+  for (; s != NULL; s = s->next)
+    {
+      if (s->type == function_call_type)
+	{
+	  int k = callee (s);
+	  if (k >= 0 && count)
+	    ncalls[k]++;
+	  else if (k >= 0 && state[k] == NOT_VISITED)
+	    visit (k);
+	}
+      for (j = 0; j < s->num_ops; j++)
+	visit_calls (s->ops[j], count);
+    }
+}
+
+/**
+ * Check if the list @c s refers to the function called @c name.
+ *
+ * @param s The list.
+ * @param name The name.
+ *
+ * @return true if it does, false otherwise.
+ */
+static int
+refers_to (const struct ast *s, const char *name)
+{
+  int j;
+  for (; s != NULL; s = s->next)
+    {
+      if (s->type == variable_type && !IS_MEMORY (s->loc)
+	  && STREQ (s->op.variable.name, name))
+	return 1;
+      for (j = 0; j < s->num_ops; j++)
+	if (refers_to (s->ops[j], name))
+	  return 1;
+    }
+  return 0;
+}
+
+/**
+ * Take the first static function that no other function refers to
+ * out of the list @c ss.
+ *
+ * @param ss A reference to the list.
+ *
+ * @return true if one was taken out, false otherwise.
+ */
+static int
+drop_dead (struct ast **ss)
+{
+  int i, k;
+  for (; *ss != NULL; ss = &(*ss)->next)
+    {
+      struct ast *s = *ss;
+      if (s->type != function_type || !s->static_decl)
+	continue;
+      for (i = 0; i < nfuncs; i++)
+	if (funcs[i] != s && refers_to (funcs[i]->ops[1],
+					s->op.function.name))
+	  break;
+      if (i < nfuncs)
+	continue;
+
+      for (k = 0; k < nfuncs; k++)
+	if (funcs[k] == s)
+	  funcs[k] = funcs[--nfuncs];
+      *ss = s->next;
+      s->next = NULL;
+      AST_FREE (s);
+      return 1;
+    }
+  return 0;
+}
+
+int
+inliner (struct ast **ss)
+{
+  if (optimize < 1)
+    return 0;
+
+  struct ast *s;
+  int k;
+  for (s = *ss; s != NULL; s = s->next)
+    if (s->type == function_type)
+      {
+	funcs = xnrealloc (funcs, nfuncs + 1, sizeof *funcs);
+	funcs[nfuncs++] = s;
+      }
+  state = xcalloc (nfuncs + 1, sizeof *state);
+  sizes = xcalloc (nfuncs + 1, sizeof *sizes);
+  ncalls = xcalloc (nfuncs + 1, sizeof *ncalls);
+  for (k = 0; k < nfuncs; k++)
+    visit_calls (funcs[k]->ops[1], 1);
+  for (k = 0; k < nfuncs; k++)
+    if (state[k] == NOT_VISITED)
+      visit (k);
+
+  /* Drop the static functions that nothing else calls anymore,
+     which can leave others that only they called. */
+  while (drop_dead (ss))
+    ;
+
+  FREE (ncalls);
+  FREE (sizes);
+  FREE (state);
+  FREE (funcs);
+  nfuncs = 0;
+  return 0;
+}
@@ -0,0 +1,400 @@
+/**
+ * @file   insn.c
+ * @author Kieran Colford <colfordk@gmail.com>
+ *
+ * @brief These are the instruction lists that functions are generated
+ * into, and the peephole optimizer that cleans them up.
+ *
+ * Copyright (C) 2014, 2015 Kieran Colford
+ *
+ * This file is part of Mongoose.
+ *
+ * Mongoose is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mongoose is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mongoose; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * @note The rules of the peephole optimizer are written in
+ * peephole.def and are turned into a table by autogen.  This file
+ * only knows how to match them and carry them out.
+ *
+ */
+
+#include "config.h"
+
+#include "free.h"
+#include "gl_array_list.h"
+#include "insn.h"
+#include "lib.h"
+#include "peephole.h"
+#include "xalloc.h"
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdarg.h>
+#include <string.h>
+
+/**
+ * The number of variables that a rule can use, one for each lower
+ * case letter.
+ */
+#define PEEPHOLE_VARS 26
+
+/**
+ * The most instructions that a rule can match.
+ */
+#define PEEPHOLE_WINDOW 8
+
+static unsigned fired[PEEPHOLE_NRULES]; /**< The number of times that
+					   each rule fired. */
+
+static void
+insn_free (const void *p)
+{
+  struct insn *i = (struct insn *) p;
+  int j;
+  FREE (i->op);
+  for (j = 0; j < i->nargs; j++)
+    FREE (i->args[j]);
+  FREE (i);
+}
+
+static struct insn *
+insn_dup (const struct insn *i)
+{
+  struct insn *out = xmemdup (i, sizeof *i);
+  int j;
+  out->op = xstrdup (i->op);
+  for (j = 0; j < i->nargs; j++)
+    out->args[j] = xstrdup (i->args[j]);
+  return out;
+}
+
+gl_list_t
+insn_list_create (void)
+{
+  return gl_list_create_empty (GL_ARRAY_LIST, NULL, NULL, insn_free, 1);
+}
+
+void
+insn_emit (gl_list_t l, int label, const char *op, int nargs, ...)
+{
+  assert (nargs <= INSN_MAX_ARGS);
+  struct insn *i = xzalloc (sizeof *i);
+  i->label = label;
+  i->op = xstrdup (op);
+  i->nargs = nargs;
+  va_list ap;
+  va_start (ap, nargs);
+  int j;
+  for (j = 0; j < nargs; j++)
+    i->args[j] = xstrdup (va_arg (ap, const char *));
+  va_end (ap);
+  gl_list_add_last (l, i);
+}
+
+void
+insn_list_print (FILE *f, gl_list_t l)
+{
+  size_t i;
+  for (i = 0; i < gl_list_size (l); i++)
+    {
+      const struct insn *in = gl_list_get_at (l, i);
+      if (in->label)
+	{
+	  fprintf (f, "%s:\n", in->op);
+	  continue;
+	}
+      fprintf (f, "\t%s", in->op);
+      int j;
+      for (j = 0; j < in->nargs; j++)
+	fprintf (f, "%s%s", j == 0 ? "\t" : ", ", in->args[j]);
+      fprintf (f, "\n");
+    }
+}
+
+/**
+ * Parse an instruction written in the syntax of peephole.def.
+ *
+ * @param s The text of the instruction.
+ *
+ * @return The instruction, with the patterns left in place.
+ */
+static struct insn *
+insn_parse (const char *s)
+{
+  struct insn *out = xzalloc (sizeof *out);
+  size_t n = strcspn (s, " \t");
+  if (s[n] == '\0' && n > 0 && s[n - 1] == ':')
+    {
+      out->label = 1;
+      out->op = xstrndup (s, n - 1);
+      return out;
+    }
+  out->op = xstrndup (s, n);
+  s += n;
+  s += strspn (s, " \t");
+  while (*s != '\0')
+    {
+      assert (out->nargs < INSN_MAX_ARGS);
+      const char *e = strstr (s, ", ");
+      n = e != NULL ? (size_t) (e - s) : strlen (s);
+      out->args[out->nargs++] = xstrndup (s, n);
+      s += n;
+      if (*s != '\0')
+	s += 2;
+    }
+  return out;
+}
+
+/**
+ * Check if the opcode @c op is one of the alternatives in @c pat.
+ *
+ * @param pat The alternatives, separated by |.
+ * @param op The opcode to check.
+ *
+ * @return true if @c op matches, false otherwise.
+ */
+static int
+match_op (const char *pat, const char *op)
+{
+  while (1)
+    {
+      size_t n = strcspn (pat, "|");
+      if (n > 0 && pat[n - 1] == '*')
+	{
+	  if (strncmp (pat, op, n - 1) == 0)
+	    return 1;
+	}
+      else if (strlen (op) == n && strncmp (pat, op, n) == 0)
+	return 1;
+      if (pat[n] == '\0')
+	return 0;
+      pat += n + 1;
+    }
+}
+
+/**
+ * Get the index of the variable named by the pattern @c pat.
+ *
+ * @param pat The pattern.
+ *
+ * @return The index of the variable, or -1 if @c pat isn't one.
+ */
+static int
+pattern_var (const char *pat)
+{
+  if (pat[0] == '@' && islower ((unsigned char) pat[1]) && pat[2] == '\0')
+    return pat[1] - 'a';
+  return -1;
+}
+
+/**
+ * Match the operand @c text against the pattern @c pat, binding the
+ * variable that it names if it isn't already bound.
+ *
+ * @param pat The pattern.
+ * @param text The operand.
+ * @param vars The values of the variables.
+ * @param regs The variables that must be registers.
+ *
+ * @return true if @c text matches, false otherwise.
+ */
+static int
+match_operand (const char *pat, const char *text, const char **vars,
+	       const char *regs)
+{
+  int v = pattern_var (pat);
+  if (v < 0)
+    return STREQ (pat, text);
+  if (vars[v] != NULL)
+    return STREQ (vars[v], text);
+  if (strchr (regs, pat[1]) != NULL && text[0] != '%')
+    return 0;
+  vars[v] = text;
+  return 1;
+}
+
+static int
+match_insn (const struct insn *pat, const struct insn *in,
+	    const char **vars, const char *regs)
+{
+  if (pat->label || in->label)
+    return pat->label && in->label && match_operand (pat->op, in->op,
+						     vars, regs);
+  if (STREQ (pat->op, "*"))
+    return in->op[0] != '.';
+  if (!match_op (pat->op, in->op) || pat->nargs != in->nargs)
+    return 0;
+  int j;
+  for (j = 0; j < in->nargs; j++)
+    if (!match_operand (pat->args[j], in->args[j], vars, regs))
+      return 0;
+  return 1;
+}
+
+/**
+ * Fill in the variables of the pattern @c pat.
+ *
+ * @param pat The pattern to fill in.
+ * @param vars The values of the variables.
+ *
+ * @return The new text.
+ */
+static char *
+substitute (const char *pat, const char **vars)
+{
+  int v = pattern_var (pat);
+  if (v < 0)
+    return xstrdup (pat);
+  assert (vars[v] != NULL);
+  return xstrdup (vars[v]);
+}
+
+/**
+ * Try the rule @c r on the instructions of @c l starting at @c at,
+ * replacing them if it matches.
+ *
+ * @param l The list of instructions.
+ * @param at Where the window starts.
+ * @param r The rule to try.
+ * @param match The parsed instructions that @c r matches.
+ * @param replace The parsed instructions that replace them.
+ *
+ * @return true if the rule fired, false otherwise.
+ */
+static int
+peephole_apply (gl_list_t l, size_t at, const struct peephole_rule *r,
+		struct insn **match, struct insn **replace)
+{
+  const char *vars[PEEPHOLE_VARS] = { NULL };
+  const struct insn *window[PEEPHOLE_WINDOW];
+  size_t n;
+  for (n = 0; match[n] != NULL; n++)
+    {
+      if (at + n >= gl_list_size (l))
+	return 0;
+      window[n] = gl_list_get_at (l, at + n);
+      if (!match_insn (match[n], window[n], vars, r->regs))
+	return 0;
+    }
+
+  const char *p;
+  for (p = r->apart; p[0] != '\0' && p[1] != '\0'; p += 2)
+    {
+      const char *a = vars[p[0] - 'a'], *b = vars[p[1] - 'a'];
+      if (a != NULL && b != NULL && (strstr (a, b) || strstr (b, a)))
+	return 0;
+    }
+
+  /* Build the replacement before the window is freed, since the
+     variables point into it. */
+  struct insn *out[PEEPHOLE_WINDOW];
+  size_t k;
+  for (k = 0; replace[k] != NULL; k++)
+    {
+      const struct insn *t = replace[k];
+      if (!t->label && t->op[0] == '@' && isdigit ((unsigned char) t->op[1]))
+	{
+	  size_t w = t->op[1] - '1';
+	  assert (w < n);
+	  out[k] = insn_dup (window[w]);
+	  continue;
+	}
+      out[k] = xzalloc (sizeof *out[k]);
+      out[k]->label = t->label;
+      out[k]->op = t->label ? substitute (t->op, vars) : xstrdup (t->op);
+      out[k]->nargs = t->nargs;
+      int j;
+      for (j = 0; j < t->nargs; j++)
+	out[k]->args[j] = substitute (t->args[j], vars);
+    }
+
+  while (n-- > 0)
+    gl_list_remove_at (l, at);
+  while (k-- > 0)
+    gl_list_add_at (l, at, out[k]);
+  return 1;
+}
+
+/**
+ * Parse a list of instructions written in the syntax of peephole.def.
+ *
+ * @param s The instructions, terminated by NULL.
+ *
+ * @return The parsed instructions, terminated by NULL.
+ */
+static struct insn **
+parse_rule (const char *const *s)
+{
+  size_t n;
+  for (n = 0; s[n] != NULL; n++)
+    ;
+  assert (n <= PEEPHOLE_WINDOW);
+  struct insn **out = xcalloc (n + 1, sizeof *out);
+  size_t i;
+  for (i = 0; i < n; i++)
+    out[i] = insn_parse (s[i]);
+  return out;
+}
+
+static void
+free_rule (struct insn **s)
+{
+  size_t i;
+  for (i = 0; s[i] != NULL; i++)
+    insn_free (s[i]);
+  FREE (s);
+}
+
+void
+peephole (gl_list_t l)
+{
+  struct insn **match[PEEPHOLE_NRULES], **replace[PEEPHOLE_NRULES];
+  int r;
+  for (r = 0; r < PEEPHOLE_NRULES; r++)
+    {
+      match[r] = parse_rule (peephole_rules[r].match);
+      replace[r] = parse_rule (peephole_rules[r].replace);
+    }
+
+  int changed;
+  do
+    {
+      changed = 0;
+      size_t i;
+      for (i = 0; i < gl_list_size (l); i++)
+	for (r = 0; r < PEEPHOLE_NRULES; r++)
+	  if (peephole_apply (l, i, &peephole_rules[r], match[r], replace[r]))
+	    {
+	      fired[r]++;
+	      changed = 1;
+	    }
+    }
+  while (changed);
+
+  for (r = 0; r < PEEPHOLE_NRULES; r++)
+    {
+      free_rule (match[r]);
+      free_rule (replace[r]);
+    }
+}
+
+void
+peephole_report (FILE *f)
+{
+  int r;
+  for (r = 0; r < PEEPHOLE_NRULES; r++)
+    if (fired[r] > 0)
+      fprintf (f, _("peephole: %s fired %u times\n"), peephole_rules[r].name,
+	       fired[r]);
+}
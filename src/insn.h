@@ -0,0 +1,95 @@
+/**
+ * @file   insn.h
+ * @author Kieran Colford <colfordk@gmail.com>
+ *
+ * @brief This is the header file for the instruction lists that
+ * functions are generated into.
+ *
+ * Copyright (C) 2014, 2015 Kieran Colford
+ *
+ * This file is part of Mongoose.
+ *
+ * Mongoose is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mongoose is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mongoose; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef INSN_H
+#define INSN_H
+
+#include "gl_xlist.h"
+
+#include <stdio.h>
+
+/**
+ * The most operands that an instruction can have.
+ */
+#define INSN_MAX_ARGS 3
+
+/**
+ * A single line of assembly.
+ *
+ */
+
+struct insn
+{
+  char *op;			/**< The opcode, the directive or the
+				   name of the label. */
+  char *args[INSN_MAX_ARGS];	/**< The operands. */
+  int nargs;			/**< The number of operands. */
+  unsigned label: 1;		/**< Whether this is a label. */
+};
+
+/**
+ * Create an empty list of instructions.
+ *
+ * @return The new list.
+ */
+extern gl_list_t insn_list_create (void);
+
+/**
+ * Append an instruction to the list @c l.
+ *
+ * @param l The list to append to.
+ * @param label Whether the instruction is a label.
+ * @param op The opcode, directive or name of the label.
+ * @param nargs The number of operands that follow.
+ */
+extern void insn_emit (gl_list_t l, int label, const char *op,
+		       int nargs, ...);
+
+/**
+ * Print out the instructions in @c l.
+ *
+ * @param f The stream to print to.
+ * @param l The list to print.
+ */
+extern void insn_list_print (FILE *f, gl_list_t l);
+
+/**
+ * Rewrite the instructions in @c l with the rules of the peephole
+ * optimizer until none of them apply.
+ *
+ * @param l The list to optimize.
+ */
+extern void peephole (gl_list_t l);
+
+/**
+ * Report how many times each rule of the peephole optimizer fired.
+ *
+ * @param f The stream to report to.
+ */
+extern void peephole_report (FILE *f);
+
+#endif
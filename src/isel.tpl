@@ -0,0 +1,136 @@
+[+ AutoGen5 template
+h
+c
++]
+
+/**
+ * @file
+ * @author Kieran Colford <colfordk@gmail.com>
+ *
+ * @brief This file contains the rules that the instruction selector
+ * chooses from.
+ *
+ * Copyright (C) 2014, 2015 Kieran Colford
+ *
+ * This file is part of Mongoose.
+ *
+ * Mongoose is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mongoose is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mongoose; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+[+ CASE (suffix) +]
+
+[+ == h +]
+#ifndef ISEL_H
+#define ISEL_H
+
+[+added_code+]
+
+/**
+ * The classes of operands that an instruction can accept.  These are
+ * bit flags so that a rule can accept any combination of them.
+ *
+ */
+enum isel_class {
+  [+ FOR classes ',
+  ' +]isel_[+name+] = 1 << [+ (for-index) +] /**< [+doc+] */[+ ENDFOR classes +]
+};
+
+/**
+ * The ways that the code for a rule can be emitted.
+ *
+ */
+enum isel_form {
+  [+ FOR forms ',
+  ' +]isel_[+name+] /**< [+doc+] */[+ ENDFOR forms +]
+};
+
+/**
+ * Whether the operands of a rule can be swapped to make them fit.
+ *
+ */
+enum isel_swap {
+  [+ FOR swaps ',
+  ' +]isel_[+name+] /**< [+doc+] */[+ ENDFOR swaps +]
+};
+
+/**
+ * A single rule of the machine description.
+ *
+ */
+struct isel_rule
+{
+  int op;			/**< The operator that the rule
+				   implements. */
+  enum isel_form form;		/**< How the code is emitted. */
+  const char *insn;		/**< The instruction to emit. */
+  unsigned dst;			/**< The classes accepted as the
+				   destination operand. */
+  unsigned src;			/**< The classes accepted as the source
+				   operand. */
+  enum isel_swap swap;		/**< Whether the operands can be
+				   swapped. */
+  const char *tree;		/**< The tree pattern that the rule
+				   covers, or NULL if it only covers
+				   its operator. */
+  const char *reg;		/**< The register that the result is
+				   left in. */
+  unsigned cost;		/**< The cost of the rule, not counting
+				   the moves needed to fit its
+				   operands. */
+};
+
+/**
+ * The rules of the machine description, in the order that they were
+ * written.  When two rules cost the same, the first one is chosen.
+ */
+extern const struct isel_rule isel_rules[];
+
+/**
+ * The number of rules in the machine description.  A rule that lists
+ * several operators becomes one rule for each of them.
+ */
+extern const int isel_nrules;
+
+#endif
+[+ == c +]
+#include "config.h"
+
+#include "isel.h"
+#include "parse.h"
+
+#include <stdlib.h>
+
+const struct isel_rule isel_rules[] = {
+  [+ FOR rule +][+ FOR op +]
+  { [+op+], isel_[+form+],
+    [+ IF (exist? "insn") +]"[+insn+]"[+ ELSE +]NULL[+ ENDIF +],
+    [+ IF (exist? "dst") +][+ FOR dst " | " +]isel_[+dst+][+ ENDFOR dst +][+ ELSE +]0[+ ENDIF +],
+    [+ IF (exist? "src") +][+ FOR src " | " +]isel_[+src+][+ ENDFOR src +][+ ELSE +]0[+ ENDIF +],
+    [+ IF (exist? "swap") +]isel_[+swap+][+ ELSE +]isel_fixed[+ ENDIF +],
+    [+ IF (exist? "tree") +]"[+tree+]"[+ ELSE +]NULL[+ ENDIF +],
+    [+ IF (exist? "reg") +]"[+reg+]"[+ ELSE +]NULL[+ ENDIF +],
+    [+cost+] },[+ ENDFOR op +][+ ENDFOR rule +]
+};
+
+const int isel_nrules = sizeof isel_rules / sizeof isel_rules[0];
+
+[+ ESAC +]
+
+/* Hey Emacs!
+Local Variables:
+mode: c
+End:
+*/
@@ -0,0 +1,527 @@
+/**
+ * @file   ivsr.c
+ * @author Kieran Colford <colfordk@gmail.com>
+ *
+ * @brief This is the induction variable strength reduction pass.
+ *
+ * Copyright (C) 2014, 2015 Kieran Colford
+ *
+ * This file is part of Mongoose.
+ *
+ * Mongoose is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mongoose is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mongoose; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * @note An induction variable is one that the loop changes in just
+ * one statement, which adds a literal to it once on every trip
+ * around.  Each array that doesn't change in the loop and is indexed
+ * by one gets a pointer that is set to the address of the element
+ * before the loop and stepped along with the variable, so that
+ *
+ * @code
+ * for (i = 0; i < n; i++) a[i] = 0;
+ * @endcode
+ *
+ * becomes
+ *
+ * @code
+ * for (i = 0, p = &a[i]; i < n; i++, p = p + 8) *p = 0;
+ * @endcode
+ *
+ * When the only other thing that the variable is used for in the
+ * loop is to compare it to something that doesn't change, the test
+ * compares the pointer to the address that the variable would have
+ * indexed instead.  Then the variable isn't needed in the loop, and
+ * the dead code pass takes it out if it isn't needed after it either.
+ *
+ */
+
+#include "config.h"
+
+#include "ast.h"
+#include "ast_util.h"
+#include "cfg.h"
+#include "compiler.h"
+#include "free.h"
+#include "lib.h"
+#include "my_printf.h"
+#include "parse.h"
+#include "xalloc.h"
+
+#include <string.h>
+
+static struct cfg *graph;	/**< The function being worked on. */
+static struct ast *preheader;	/**< The statement to put the setup of
+				   the pointers after. */
+static const char *kill;	/**< What the loop changes. */
+static int iv;			/**< The induction variable being
+				   reduced. */
+static struct ast **ptrs;	/**< The pointer into each of the
+				   arrays, by the variable that holds
+				   the array. */
+static struct ast **arrays;	/**< The variable that holds each of
+				   the arrays. */
+
+/**
+ * Check if nothing that @c s reads is changed by the loop, where @c s
+ * is a variable or a literal.
+ *
+ * @param s The AST to check.
+ *
+ * @return true if it is invariant, false otherwise.
+ */
+static int
+invariant (const struct ast *s)
+{
+  if (s->type == integer_type)
+    return 1;
+  int v = cfg_var (graph, s);
+  return v >= 0 && !kill[v];
+}
+
+/**
+ * Put the statement @c s into the preheader.
+ *
+ * @param s The statement.
+ */
+static void
+setup (struct ast *s)
+{
+  s->throw_away = 1;
+  s->next = preheader->next;
+  preheader->next = s;
+  preheader = s;
+}
+
+/**
+ * Make a new slot in the frame.
+ *
+ * @return A variable that refers to it.
+ */
+static struct ast *
+new_temp (void)
+{
+  static int tempno = 0;
+  return cfg_new_temp (graph, my_printf ("iv.%d", tempno++));
+}
+
+/**
+ * Check if @c s indexes an array that doesn't change in the loop with
+ * the induction variable.
+ *
+ * @param s The expression.
+ *
+ * @return The number of the variable that holds the array, or -1.
+ */
+static int
+indexed_array (const struct ast *s)
+{
+  if (s->type != binary_type || s->op.binary.op != '['
+      || cfg_var (graph, s->ops[1]) != iv || !invariant (s->ops[0]))
+    return -1;
+  return cfg_var (graph, s->ops[0]);
+}
+
+/**
+ * Replace the elements of arrays indexed by the induction variable
+ * inside of @c s with the pointers to them.
+ *
+ * @param ss A reference to the expression.
+ */
+static void
+rewrite (struct ast **ss)
+{
+  struct ast *s = *ss;
+  int a = indexed_array (s), j;
+  if (a >= 0)
+    {
+      if (ptrs[a] == NULL)
+	{
+	  ptrs[a] = new_temp ();
+	  arrays[a] = ast_dup (s->ops[0]);
+	  setup (make_binary ('=', ast_dup (ptrs[a]),
+			      make_unary ('&', make_binary
+					  ('[', ast_dup (s->ops[0]),
+					   ast_dup (s->ops[1])))));
+	}
+      struct ast *t = make_unary ('*', ast_dup (ptrs[a]));
+      t->next = s->next;
+      t->boolean_not = s->boolean_not;
+      t->noreturnint = s->noreturnint;
+      t->throw_away = s->throw_away;
+      s->next = NULL;
+      AST_FREE (s);
+      *ss = t;
+      return;
+    }
+  for (j = 0; j < s->num_ops; j++)
+    {
+      struct ast **i;
+      for (i = &s->ops[j]; *i != NULL; i = &(*i)->next)
+	rewrite (i);
+    }
+}
+
+/**
+ * Count the uses of the induction variable inside of @c s.
+ *
+ * @param s The expression.
+ *
+ * @return The number of uses.
+ */
+static int
+count_uses (const struct ast *s)
+{
+  if (cfg_var (graph, s) == iv)
+    return 1;
+  int n = 0, j;
+  for (j = 0; j < s->num_ops; j++)
+    {
+      const struct ast *i;
+      for (i = s->ops[j]; i != NULL; i = i->next)
+	n += count_uses (i);
+    }
+  return n;
+}
+
+/**
+ * Check if the conditional goto @c s compares the induction variable
+ * to something that doesn't change in the loop.
+ *
+ * @param s The statement.
+ *
+ * @return The side of the comparison that the variable is on, or -1.
+ */
+static int
+exit_test (const struct ast *s)
+{
+  if (s->type != cond_type || s->ops[0]->type != binary_type)
+    return -1;
+  const struct ast *e = s->ops[0];
+  switch (e->op.binary.op)
+    {
+    case '<':
+    case '>':
+    case LE:
+    case GE:
+    case EQ:
+      break;
+
+    default:
+      return -1;
+    }
+  int j;
+  for (j = 0; j < 2; j++)
+    if (cfg_var (graph, e->ops[j]) == iv && invariant (e->ops[!j]))
+      return j;
+  return -1;
+}
+
+/**
+ * Check if the induction variable could be read after the loop is
+ * left, before it is set again.
+ *
+ * @param body The blocks of the loop.
+ *
+ * @return true if it could, false otherwise.
+ */
+static int
+read_after (const char *body)
+{
+  int nb = graph->nblocks, depth = 0, live = 0, b, k;
+  int *stack = xcalloc (nb, sizeof *stack);
+  char *seen = xzalloc (nb);
+  for (b = 0; b < nb; b++)
+    if (body[b])
+      for (k = 0; k < 2; k++)
+	{
+	  int t = graph->blocks[b].succ[k];
+	  if (t >= 0 && !body[t] && !seen[t])
+	    {
+	      seen[t] = 1;
+	      stack[depth++] = t;
+	    }
+	}
+  while (depth > 0 && !live)
+    {
+      const struct cfg_block *blk = &graph->blocks[stack[--depth]];
+      struct ast *s;
+      int set = 0;
+      CFG_FOREACH_STMT (s, blk)
+	{
+	  const struct ast *e = cfg_stmt_expr (s);
+	  if (e == NULL)
+	    continue;
+	  if (e->type == binary_type && e->op.binary.op == '='
+	      && cfg_var (graph, e->ops[0]) == iv)
+	    {
+	      live = count_uses (e->ops[1]) > 0;
+	      set = 1;
+	      break;
+	    }
+	  if (count_uses (e) > 0)
+	    {
+	      live = 1;
+	      break;
+	    }
+	}
+      if (live || set)
+	continue;
+      for (k = 0; k < 2; k++)
+	{
+	  int t = blk->succ[k];
+	  if (t >= 0 && !seen[t])
+	    {
+	      seen[t] = 1;
+	      stack[depth++] = t;
+	    }
+	}
+    }
+  FREE (seen);
+  FREE (stack);
+  return live;
+}
+
+/**
+ * Reduce the induction variable @c v of a loop.
+ *
+ * @param body The blocks of the loop.
+ * @param v The variable.
+ * @param inc The statement that steps it.
+ * @param step What it is stepped by.
+ *
+ * @return true if anything was changed, false otherwise.
+ */
+static int
+reduce (const char *body, int v, struct ast *inc, long long step)
+{
+  int nb = graph->nblocks, b, a;
+  struct ast *s;
+  iv = v;
+  ptrs = xcalloc (graph->nvars, sizeof *ptrs);
+  arrays = xcalloc (graph->nvars, sizeof *arrays);
+  for (b = 0; b < nb; b++)
+    if (body[b])
+      CFG_FOREACH_STMT (s, &graph->blocks[b])
+	if (s != inc)
+	  {
+	    int j;
+	    for (j = 0; j < s->num_ops; j++)
+	      {
+		struct ast **i;
+		for (i = &s->ops[j]; *i != NULL; i = &(*i)->next)
+		  rewrite (i);
+	      }
+	  }
+
+  /* Step the pointers along with the variable. */
+  struct ast *first = NULL, *array = NULL;
+  for (a = 0; a < graph->nvars; a++)
+    if (ptrs[a] != NULL)
+      {
+	struct ast *p = ptrs[a];
+	struct ast *t = make_binary ('=', ast_dup (p),
+				     make_binary ('+', ast_dup (p),
+						  make_integer (step * 8)));
+	t->throw_away = 1;
+	t->next = inc->next;
+	inc->next = t;
+	if (first == NULL)
+	  {
+	    first = p;
+	    array = arrays[a];
+	  }
+	else
+	  {
+	    AST_FREE (p);
+	    AST_FREE (arrays[a]);
+	  }
+      }
+  FREE (arrays);
+  FREE (ptrs);
+  if (first == NULL)
+    return 0;
+
+  /* Test the pointer instead when nothing else needs the
+     variable. */
+  int other = 0, tested = 0;
+  for (b = 0; b < nb; b++)
+    if (body[b])
+      CFG_FOREACH_STMT (s, &graph->blocks[b])
+	if (s != inc && exit_test (s) < 0)
+	  other += count_uses (s);
+  for (b = 0; b < nb && other == 0; b++)
+    if (body[b])
+      CFG_FOREACH_STMT (s, &graph->blocks[b])
+	{
+	  int j = exit_test (s);
+	  if (j < 0)
+	    continue;
+	  struct ast *e = s->ops[0], *lim = new_temp ();
+	  setup (make_binary ('=', ast_dup (lim),
+			      make_unary ('&', make_binary
+					  ('[', ast_dup (array),
+					   e->ops[!j]))));
+	  e->ops[!j] = lim;
+	  AST_FREE (e->ops[j]);
+	  e->ops[j] = ast_dup (first);
+	  tested = 1;
+	}
+  AST_FREE (array);
+  AST_FREE (first);
+
+  /* Then the variable doesn't have to be counted anymore. */
+  if (tested && !read_after (body))
+    {
+      struct ast **ss = &graph->function->ops[1]->ops[0];
+      while (*ss != inc)
+	ss = &(*ss)->next;
+      *ss = inc->next;
+      inc->next = NULL;
+      AST_FREE (inc);
+    }
+  return 1;
+}
+
+/**
+ * Reduce an induction variable of the first loop of the function @c f
+ * that hasn't been done yet.
+ *
+ * @param f The function.
+ * @param done The labels of the headers of the loops that have been
+ * done.
+ * @param ndone The number of them.
+ *
+ * @return true if there was a loop left to do, false otherwise.
+ */
+static int
+ivsr_once (struct ast *f, char ***done, int *ndone)
+{
+  struct cfg *g = cfg_build (f);
+  graph = g;
+  int nb = g->nblocks, n = g->nvars, b, h, i, v;
+  cfg_dominators (g);
+
+  char *body = xzalloc (nb + 1);
+  for (h = 0; h < nb; h++)
+    {
+      const struct ast *l = g->blocks[h].first;
+      if (g->blocks[h].idom < 0 || l->type != label_type)
+	continue;
+      for (i = 0; i < *ndone; i++)
+	if (STREQ ((*done)[i], l->loc->base))
+	  break;
+      if (i == *ndone && cfg_loop (g, h, body) > 0)
+	break;
+    }
+  if (h == nb)
+    {
+      FREE (body);
+      cfg_free (g);
+      graph = NULL;
+      return 0;
+    }
+  int reduced = 0;
+  if (cfg_preheader (g, h, body))
+    {
+      /* Find the one statement that changes each variable, leaving
+	 out the inner loops, which don't run once per trip. */
+      char *changed = xzalloc (n + 1), *inner = xzalloc (nb + 1);
+      char *k = xzalloc (n + 1);
+      int *stores = xcalloc (n + 1, sizeof *stores);
+      struct ast **stmts = xcalloc (n + 1, sizeof *stmts);
+      int *blocks = xcalloc (n + 1, sizeof *blocks);
+      for (b = 0; b < nb; b++)
+	if (body[b] && b != h)
+	  cfg_loop (g, b, inner);
+      for (b = 0; b < nb; b++)
+	{
+	  struct ast *s;
+	  if (!body[b])
+	    continue;
+	  CFG_FOREACH_STMT (s, &g->blocks[b])
+	    {
+	      memset (k, 0, n + 1);
+	      cfg_kills (g, s, k);
+	      for (v = 0; v < n; v++)
+		if (k[v])
+		  {
+		    changed[v] = 1;
+		    stores[v]++;
+		    stmts[v] = s;
+		    blocks[v] = b;
+		  }
+	    }
+	}
+      kill = changed;
+      preheader = g->blocks[h - 1].last;
+
+      for (v = 0; v < n; v++)
+	{
+	  long long step;
+	  if (stores[v] != 1 || inner[blocks[v]]
+	      || !cfg_step (g, stmts[v], v, &step))
+	    continue;
+	  const struct cfg_block *hdr = &g->blocks[h];
+	  for (i = 0; i < hdr->npreds; i++)
+	    if (body[hdr->preds[i]]
+		&& !cfg_dominates (g, blocks[v], hdr->preds[i]))
+	      break;
+	  if (i == hdr->npreds && reduce (body, v, stmts[v], step))
+	    {
+	      reduced = 1;
+	      break;
+	    }
+	}
+
+      kill = NULL;
+      preheader = NULL;
+      FREE (blocks);
+      FREE (stmts);
+      FREE (stores);
+      FREE (k);
+      FREE (inner);
+      FREE (changed);
+    }
+
+  /* The statements have changed, so the loop is done again with a
+     new graph. */
+  if (!reduced)
+    {
+      *done = xnrealloc (*done, *ndone + 1, sizeof **done);
+      (*done)[(*ndone)++] = xstrdup (g->blocks[h].first->loc->base);
+    }
+  FREE (body);
+  cfg_free (g);
+  graph = NULL;
+  return 1;
+}
+
+int
+ivsr (struct ast *s)
+{
+  if (optimize < 1)
+    return 0;
+  for (; s != NULL; s = s->next)
+    if (s->type == function_type)
+      {
+	char **done = NULL;
+	int ndone = 0, i;
+	while (ivsr_once (s, &done, &ndone))
+	  ;
+	for (i = 0; i < ndone; i++)
+	  FREE (done[i]);
+	FREE (done);
+      }
+  return 0;
+}
@@ -0,0 +1,370 @@
+/**
+ * @file   licm.c
+ * @author Kieran Colford <colfordk@gmail.com>
+ *
+ * @brief This is the loop invariant code motion pass.
+ *
+ * Copyright (C) 2014, 2015 Kieran Colford
+ *
+ * This file is part of Mongoose.
+ *
+ * Mongoose is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mongoose is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mongoose; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * @note A loop is found from a jump back to a block that dominates
+ * it, which is the header, and is made of every block that can get
+ * back to the jump without going through the header.  It can only
+ * be worked on when the only way into it from outside is by falling
+ * through into the header, since then the statements just before the
+ * header's label are run once each time the loop is entered.  After
+ * the rotate pass this is where the guard of a while loop leaves off.
+ *
+ * An expression is invariant when nothing that it reads is changed
+ * anywhere in the loop, with memory tracked as a whole like in the
+ * value numbering pass.  It is saved into a new slot of the frame
+ * before the loop, and the loop loads the slot instead.  Loads and
+ * divisions can fault, so they are only moved when they would have
+ * been run anyway before the loop could be left.  The loops are done
+ * from the outside in, so that an expression goes as far out as it
+ * can.
+ *
+ */
+
+#include "config.h"
+
+#include "ast.h"
+#include "ast_util.h"
+#include "cfg.h"
+#include "compiler.h"
+#include "free.h"
+#include "lib.h"
+#include "my_printf.h"
+#include "parse.h"
+#include "xalloc.h"
+
+#include <string.h>
+
+static struct cfg *graph;	/**< The function being worked on. */
+static struct ast *preheader;	/**< The statement to put the hoisted
+				   expressions after. */
+static const char *kill;	/**< What the loop changes. */
+
+/**
+ * Check if nothing that @c s reads is changed by the loop.
+ *
+ * @param s The expression.
+ *
+ * @return true if it is invariant, false otherwise.
+ */
+static int
+invariant (const struct ast *s)
+{
+  int j;
+  switch (s->type)
+    {
+    case variable_type:
+      j = cfg_var (graph, s);
+      return !kill[j >= 0 ? j : graph->nvars];
+
+    case integer_type:
+    case string_type:
+    case label_value_type:
+      return 1;
+
+    case binary_type:
+      if (s->op.binary.op == '[' && kill[graph->nvars])
+	return 0;
+      break;
+
+    case unary_type:
+      if (s->op.unary.op == '&' && s->ops[0]->type == variable_type)
+	return 1;
+      if (s->op.unary.op == '*' && kill[graph->nvars])
+	return 0;
+      break;
+
+    default:
+      return 0;
+    }
+  for (j = 0; j < s->num_ops; j++)
+    if (!invariant (s->ops[j]))
+      return 0;
+  return 1;
+}
+
+/**
+ * Check if evaluating @c s could fault.
+ *
+ * @param s The expression.
+ *
+ * @return true if it could, false otherwise.
+ */
+static int
+may_fault (const struct ast *s)
+{
+  if (s->type == binary_type && (s->op.binary.op == '['
+				 || s->op.binary.op == '/'
+				 || s->op.binary.op == '%'))
+    return 1;
+  if (s->type == unary_type && s->op.unary.op == '*')
+    return 1;
+  int j;
+  for (j = 0; j < s->num_ops; j++)
+    if (s->ops[j] != NULL && may_fault (s->ops[j]))
+      return 1;
+  return 0;
+}
+
+/**
+ * Move the expression at @c ss out of the loop.
+ *
+ * @param ss A reference to the expression.
+ */
+static void
+hoist (struct ast **ss)
+{
+  static int tempno = 0;
+  struct ast *t = cfg_new_temp (graph, my_printf ("licm.%d", tempno++));
+  struct ast *h = make_binary ('=', ast_dup (t), *ss);
+  h->throw_away = 1;
+  *ss = t;
+  h->next = preheader->next;
+  preheader->next = h;
+  preheader = h;
+}
+
+/**
+ * Move the largest invariant expressions inside of @c s out of the
+ * loop.
+ *
+ * @param ss A reference to the expression.
+ * @param safe Whether @c s is run every time that the loop is
+ * entered, so that it can be run before the loop even if it could
+ * fault.
+ * @param fixed Whether @c s itself has to stay where it is, because
+ * it is a statement or an argument.
+ */
+static void
+visit (struct ast **ss, int safe, int fixed)
+{
+  struct ast *s = *ss;
+  int j;
+  if (!fixed && worth_saving (s) && invariant (s)
+      && (safe || !may_fault (s)))
+    {
+      hoist (ss);
+      return;
+    }
+
+  switch (s->type)
+    {
+    case binary_type:
+      if (s->op.binary.op == '=')
+	{
+	  struct ast *l = s->ops[0];
+	  if (l->type != variable_type)
+	    for (j = 0; j < l->num_ops; j++)
+	      visit (&l->ops[j], safe, 0);
+	  visit (&s->ops[1], safe, 0);
+	  return;
+	}
+      break;
+
+    case unary_type:
+      if (s->op.unary.op == '&')
+	return;
+      if (s->op.unary.op == INC || s->op.unary.op == DEC)
+	{
+	  struct ast *l = s->ops[0];
+	  if (l->type != variable_type)
+	    for (j = 0; j < l->num_ops; j++)
+	      visit (&l->ops[j], safe, 0);
+	  return;
+	}
+      break;
+
+    case ternary_type:
+      visit (&s->ops[0], safe, 0);
+      visit (&s->ops[1], 0, 0);
+      visit (&s->ops[2], 0, 0);
+      return;
+
+    case function_call_type:
+      {
+	struct ast *i;
+	for (i = s->ops[1]; i != NULL; i = i->next)
+	  if (i->type != block_type)
+	    visit (&i, safe, 1);
+	return;
+      }
+
+    default:
+      return;
+    }
+
+  for (j = 0; j < s->num_ops; j++)
+    visit (&s->ops[j], safe, 0);
+}
+
+/**
+ * Move the invariant expressions out of the outermost loop of the
+ * function @c f that hasn't been done yet.
+ *
+ * @param f The function.
+ * @param done The labels of the headers of the loops that have been
+ * done.
+ * @param ndone The number of them.
+ *
+ * @return true if there was a loop left to do, false otherwise.
+ */
+static int
+licm_once (struct ast *f, char ***done, int *ndone)
+{
+  struct cfg *g = cfg_build (f);
+  graph = g;
+  int nb = g->nblocks, b, h, best = -1, size = 0, i;
+  cfg_dominators (g);
+
+  /* Pick the largest loop that is left. */
+  char *body = xzalloc (nb + 1);
+  for (h = 0; h < nb; h++)
+    {
+      const struct ast *l = g->blocks[h].first;
+      if (g->blocks[h].idom < 0 || l->type != label_type)
+	continue;
+      for (i = 0; i < *ndone; i++)
+	if (STREQ ((*done)[i], l->loc->base))
+	  break;
+      if (i < *ndone)
+	continue;
+      memset (body, 0, nb);
+      int n = cfg_loop (g, h, body);
+      if (n > size)
+	{
+	  best = h;
+	  size = n;
+	}
+    }
+  if (best < 0)
+    {
+      FREE (body);
+      cfg_free (g);
+      graph = NULL;
+      return 0;
+    }
+  h = best;
+  *done = xnrealloc (*done, *ndone + 1, sizeof **done);
+  (*done)[(*ndone)++] = xstrdup (g->blocks[h].first->loc->base);
+  memset (body, 0, nb);
+  cfg_loop (g, h, body);
+
+  if (cfg_preheader (g, h, body))
+    {
+      /* Find what the loop changes, and the blocks that it can be
+	 left from. */
+      char *changed = xzalloc (g->nvars + 1);
+      char *exits = xzalloc (nb);
+      int nexits = 0;
+      for (b = 0; b < nb; b++)
+	{
+	  if (!body[b])
+	    continue;
+	  struct ast *s;
+	  CFG_FOREACH_STMT (s, &g->blocks[b])
+	    cfg_kills (g, s, changed);
+	  const struct cfg_block *blk = &g->blocks[b];
+	  int k;
+	  for (k = 0; k < 2; k++)
+	    if (blk->succ[k] >= 0 && !body[blk->succ[k]])
+	      exits[b] = 1;
+	  if (blk->last->type == ret_type)
+	    exits[b] = 1;
+	  nexits += exits[b];
+	}
+      kill = changed;
+      preheader = g->blocks[h - 1].last;
+
+      for (b = 0; b < nb; b++)
+	{
+	  if (!body[b])
+	    continue;
+	  /* A block is run every time that the loop is entered when
+	     it comes before every way out of it. */
+	  int safe = b == h, e;
+	  if (nexits > 0)
+	    {
+	      safe = 1;
+	      for (e = 0; e < nb; e++)
+		if (exits[e] && !cfg_dominates (g, b, e))
+		  safe = 0;
+	    }
+	  struct ast *s, *last = g->blocks[b].last;
+	  for (s = g->blocks[b].first; s != NULL;
+	       s = s == last ? NULL : s->next)
+	    {
+	      struct ast **e = NULL;
+	      switch (s->type)
+		{
+		case cond_type:
+		case ret_type:
+		  e = &s->ops[0];
+		  break;
+
+		case label_type:
+		case jump_type:
+		case alloc_type:
+		  continue;
+
+		default:
+		  break;
+		}
+	      if (e != NULL && *e == NULL)
+		continue;
+	      if (e != NULL)
+		visit (e, safe, 0);
+	      else
+		visit (&s, safe, 1);
+	    }
+	}
+
+      kill = NULL;
+      preheader = NULL;
+      FREE (exits);
+      FREE (changed);
+    }
+
+  FREE (body);
+  cfg_free (g);
+  graph = NULL;
+  return 1;
+}
+
+int
+licm (struct ast *s)
+{
+  if (optimize < 1)
+    return 0;
+  for (; s != NULL; s = s->next)
+    if (s->type == function_type)
+      {
+	char **done = NULL;
+	int ndone = 0, i;
+	while (licm_once (s, &done, &ndone))
+	  ;
+	for (i = 0; i < ndone; i++)
+	  FREE (done[i]);
+	FREE (done);
+      }
+  return 0;
+}
@@ -29,56 +29,508 @@
 #include "ast.h"
 #include "ast_util.h"
 #include "compiler.h"
+#include "free.h"
 #include "lib.h"
 #include "parse.h"
+#include "simplify.h"
+#include "xalloc.h"
 
 #include <assert.h>
+#include <ctype.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The number of variables that a rule of simplify.def can use, one
+ * for each lower case letter.
+ */
+#define SIMPLIFY_VARS 26
+
+/**
+ * A tree of operators in a rule of simplify.def.
+ *
+ */
+struct pattern
+{
+  int op;			/**< The operator, or 0 for a leaf. */
+  int var;			/**< The letter of the variable, or 0
+				   for a literal. */
+  long long i;			/**< The value of the literal. */
+  int num_ops;			/**< The number of operands. */
+  struct pattern *ops[2];	/**< The operands. */
+};
+
+static struct pattern *match[SIMPLIFY_NRULES]; /**< The parsed trees
+						  that the rules
+						  match. */
+static struct pattern *replace[SIMPLIFY_NRULES]; /**< The parsed trees
+						    that they are
+						    replaced with. */
+static unsigned fired[SIMPLIFY_NRULES]; /**< The number of times that
+					   each rule fired. */
+
+static void optimizer_r (struct ast **ss);
 
 /** 
  * Fold a unary operator on a constant integer into a single integer.
- * 
- * @param OP The operator to fold on.
  */
-#define FOLD_INTEGER_UNI(OP) do {		\
-    if (s->ops[0]->type == integer_type)	\
-      {						\
-	long long a = s->ops[0]->op.integer.i;	\
-	AST_FREE (s);				\
-	s = make_integer (OP a);		\
-      }						\
+#define FOLD_INTEGER_UNI() do {						\
+    long long res;							\
+    if (s->ops[0]->type == integer_type					\
+	&& fold_unary (s->op.unary.op, s->ops[0]->op.integer.i, &res))	\
+      {									\
+	struct ast *t = make_integer (res);				\
+	t->boolean_not = s->boolean_not;				\
+	SWAP_AST (s, t);						\
+	AST_FREE (t);							\
+	fold_not (s);							\
+      }									\
   } while (0)
 
 /** 
  * Fold up expressions involving constant integer expressions into a
  * single constant integer.
- * 
- * @param OP The operator to fold on.
  */
-#define FOLD_INTEGER_BIN(OP) do {		\
-    if (s->ops[0]->type == integer_type &&	\
-	s->ops[1]->type == integer_type)	\
-      {						\
-	long long l = s->ops[0]->op.integer.i;	\
-	long long r = s->ops[1]->op.integer.i;	\
-	long long res = l OP r;			\
-	if (s->boolean_not)			\
-	  res = !res;				\
-	struct ast *t = make_integer (res);	\
-	SWAP_AST (s, t);			\
-	AST_FREE (t);				\
-      }						\
+#define FOLD_INTEGER_BIN() do {				\
+    long long res;					\
+    if (s->ops[0]->type == integer_type			\
+	&& s->ops[1]->type == integer_type		\
+	&& fold_binary (s->op.binary.op,		\
+			s->ops[0]->op.integer.i,	\
+			s->ops[1]->op.integer.i, &res))	\
+      {							\
+	if (s->boolean_not)				\
+	  res = !res;					\
+	struct ast *t = make_integer (res);		\
+	SWAP_AST (s, t);				\
+	AST_FREE (t);					\
+      }							\
   } while (0)
 
-/** 
- * Convience macro for declaring how to fold up each binary operator.
- * 
- * @param CASE 
- * @param OP 
+int
+fold_binary (int op, long long l, long long r, long long *res)
+{
+  /* Do the arithmetic unsigned so that it wraps around like the
+     machine does. */
+  unsigned long long ul = l, ur = r;
+  switch (op)
+    {
+    case '+':
+      *res = ul + ur;
+      break;
+
+    case '-':
+      *res = ul - ur;
+      break;
+
+    case '*':
+      *res = ul * ur;
+      break;
+
+    case '/':
+    case '%':
+      /* Leave these to trap at run time, like they would have. */
+      if (r == 0 || (l == LLONG_MIN && r == -1))
+	return 0;
+      *res = op == '/' ? l / r : l % r;
+      break;
+
+    case '&':
+      *res = l & r;
+      break;
+
+    case '|':
+      *res = l | r;
+      break;
+
+    case '^':
+      *res = l ^ r;
+      break;
+
+    case LS:
+      *res = ul << (r & 63);
+      break;
+
+    case RS:
+      *res = l >> (r & 63);
+      break;
+
+    case '<':
+      *res = l < r;
+      break;
+
+    case '>':
+      *res = l > r;
+      break;
+
+    case LE:
+      *res = l <= r;
+      break;
+
+    case GE:
+      *res = l >= r;
+      break;
+
+    case EQ:
+      *res = l == r;
+      break;
+
+    case NE:
+      *res = l != r;
+      break;
+
+    case AND:
+      *res = l && r;
+      break;
+
+    case OR:
+      *res = l || r;
+      break;
+
+    default:
+      return 0;
+    }
+  return 1;
+}
+
+int
+fold_unary (int op, long long a, long long *res)
+{
+  switch (op)
+    {
+    case '-':
+      *res = -(unsigned long long) a;
+      return 1;
+
+    case '~':
+      *res = ~a;
+      return 1;
+
+    default:
+      return 0;
+    }
+}
+
+/**
+ * Apply the boolean NOT that is on the integer @c s to its value.
+ *
+ * @param s The AST to fold.
+ */
+static void
+fold_not (struct ast *s)
+{
+  if (s->type == integer_type && s->boolean_not)
+    {
+      s->op.integer.i = !s->op.integer.i;
+      s->boolean_not = 0;
+    }
+}
+
+int
+has_side_effects (const struct ast *s)
+{
+  switch (s->type)
+    {
+    case function_call_type:
+    case alloc_type:
+      return 1;
+
+    case binary_type:
+      if (s->op.binary.op == '=')
+	return 1;
+      break;
+
+    case unary_type:
+      if (s->op.unary.op == INC || s->op.unary.op == DEC)
+	return 1;
+      break;
+
+    default:
+      break;
+    }
+  int j;
+  for (j = 0; j < s->num_ops; j++)
+    {
+      const struct ast *i;
+      for (i = s->ops[j]; i != NULL; i = i->next)
+	if (has_side_effects (i))
+	  return 1;
+    }
+  return 0;
+}
+
+int
+takes_label_address (const struct ast *s, const char *base)
+{
+  for (; s != NULL; s = s->next)
+    {
+      if (s->type == label_value_type
+	  && (base == NULL || STREQ (s->loc->base, base)))
+	return 1;
+      int j;
+      for (j = 0; j < s->num_ops; j++)
+	if (takes_label_address (s->ops[j], base))
+	  return 1;
+    }
+  return 0;
+}
+
+int
+same_tree (const struct ast *a, const struct ast *b)
+{
+  if (a->type != b->type || a->boolean_not != b->boolean_not)
+    return 0;
+  switch (a->type)
+    {
+    case integer_type:
+      return a->op.integer.i == b->op.integer.i;
+
+    case variable_type:
+      /* Two variables in different scopes can have the same name. */
+      if (IS_MEMORY (a->loc) && IS_MEMORY (b->loc))
+	return (a->loc->offset == b->loc->offset
+		&& STREQ (a->loc->base, b->loc->base)
+		&& a->loc->index == NULL && b->loc->index == NULL);
+      return STREQ (a->op.variable.name, b->op.variable.name);
+
+    case binary_type:
+      return (a->op.binary.op == b->op.binary.op
+	      && same_tree (a->ops[0], b->ops[0])
+	      && same_tree (a->ops[1], b->ops[1]));
+
+    case unary_type:
+      return (a->op.unary.op == b->op.unary.op
+	      && same_tree (a->ops[0], b->ops[0]));
+
+    default:
+      return 0;
+    }
+}
+
+/**
+ * Parse a tree written in the syntax of simplify.def.
+ *
+ * @param sp A reference to the text, which is left just after the
+ * tree.
+ *
+ * @return The tree.
+ */
+static struct pattern *
+parse_pattern (const char **sp)
+{
+  const char *s = *sp;
+  struct pattern *p = xzalloc (sizeof *p);
+  if (islower ((unsigned char) *s))
+    p->var = *s++;
+  else if (isdigit ((unsigned char) *s)
+	   || (*s == '-' && isdigit ((unsigned char) s[1])))
+    {
+      char *end;
+      p->i = strtoll (s, &end, 10);
+      s = end;
+    }
+  else
+    {
+      size_t n = strcspn (s, "(");
+      assert (n == 1 || (n == 2 && s[0] == s[1]));
+      p->op = n == 1 ? s[0] : s[0] == '<' ? LS : RS;
+      s += n + 1;
+      do
+	{
+	  assert (p->num_ops < 2);
+	  p->ops[p->num_ops++] = parse_pattern (&s);
+	}
+      while (*s++ == ',');
+    }
+  *sp = s;
+  return p;
+}
+
+static void
+free_pattern (struct pattern *p)
+{
+  int j;
+  for (j = 0; j < p->num_ops; j++)
+    free_pattern (p->ops[j]);
+  FREE (p);
+}
+
+/**
+ * Count how many times each variable appears in @c p.
+ *
+ * @param p The tree.
+ * @param count The counts, indexed by letter.
+ */
+static void
+count_vars (const struct pattern *p, int *count)
+{
+  if (p->var != 0)
+    count[p->var - 'a']++;
+  int j;
+  for (j = 0; j < p->num_ops; j++)
+    count_vars (p->ops[j], count);
+}
+
+/**
+ * Check if the expression at @c ss matches the tree @c p, binding the
+ * variables of the tree to the operands that they match.
+ *
+ * @param p The tree.
+ * @param ss A reference to the expression.
+ * @param vars Where each variable is bound, indexed by letter.
+ * @param root Whether this is the top of the expression.  A NOT can
+ * only be carried over from the top.
+ *
+ * @return true if it matches, false otherwise.
+ */
+static int
+match_pattern (const struct pattern *p, struct ast **ss,
+	       struct ast ***vars, int root)
+{
+  struct ast *s = *ss;
+  if (s->boolean_not && !root)
+    return 0;
+  if (p->var != 0)
+    {
+      struct ast ***v = &vars[p->var - 'a'];
+      if ((p->var == 'c' || p->var == 'd') && s->type != integer_type)
+	return 0;
+      if (*v == NULL)
+	{
+	  *v = ss;
+	  return 1;
+	}
+      return same_tree (**v, s);
+    }
+  if (p->op == 0)
+    return s->type == integer_type && s->op.integer.i == p->i;
+  if (p->num_ops == 2)
+    return (s->type == binary_type && s->op.binary.op == p->op
+	    && match_pattern (p->ops[0], &s->ops[0], vars, 0)
+	    && match_pattern (p->ops[1], &s->ops[1], vars, 0));
+  return (s->type == unary_type && s->op.unary.op == p->op
+	  && match_pattern (p->ops[0], &s->ops[0], vars, 0));
+}
+
+/**
+ * Build the expression for the tree @c p, moving the operands that its
+ * variables are bound to out of the matched expression.
+ *
+ * @param p The tree.
+ * @param vars Where each variable is bound, indexed by letter.
+ *
+ * @return The new expression.
+ */
+static struct ast *
+build_pattern (const struct pattern *p, struct ast ***vars)
+{
+  if (p->var == 'c' || p->var == 'd')
+    return make_integer ((*vars[p->var - 'a'])->op.integer.i);
+  if (p->var != 0)
+    {
+      struct ast **ss = vars[p->var - 'a'];
+      struct ast *s = *ss;
+      assert (s != NULL);
+      *ss = NULL;
+      return s;
+    }
+  if (p->op == 0)
+    return make_integer (p->i);
+  if (p->num_ops == 2)
+    {
+      struct ast *l = build_pattern (p->ops[0], vars);
+      return make_binary (p->op, l, build_pattern (p->ops[1], vars));
+    }
+  return make_unary (p->op, build_pattern (p->ops[0], vars));
+}
+
+/**
+ * Try to rewrite the expression at @c ss with rule @c r of
+ * simplify.def.
+ *
+ * @param ss A reference to the expression.
+ * @param r The number of the rule.
+ *
+ * @return true if the rule fired, false otherwise.
+ */
+static int
+simplify_apply (struct ast **ss, int r)
+{
+  struct ast **vars[SIMPLIFY_VARS] = { NULL };
+  if (!match_pattern (match[r], ss, vars, 1))
+    return 0;
+
+  /* An operand that is evaluated a different number of times than it
+     was has to be free of side effects. */
+  int uses[SIMPLIFY_VARS] = { 0 }, keeps[SIMPLIFY_VARS] = { 0 };
+  count_vars (match[r], uses);
+  count_vars (replace[r], keeps);
+  int v;
+  for (v = 0; v < SIMPLIFY_VARS; v++)
+    if (vars[v] != NULL && (uses[v] > 1 || keeps[v] == 0)
+	&& has_side_effects (*vars[v]))
+      return 0;
+
+  struct ast *t = build_pattern (replace[r], vars);
+  t->boolean_not ^= (*ss)->boolean_not;
+  t->throw_away = (*ss)->throw_away;
+  SWAP_AST (*ss, t);
+  AST_FREE (t);
+  return 1;
+}
+
+/**
+ * Apply the first rule of simplify.def that matches the expression at
+ * @c ss, then optimize what it was rewritten to.
+ *
+ * @param ss A reference to the expression.
+ */
+static void
+simplify (struct ast **ss)
+{
+  struct ast *s = *ss;
+  if (s->type == binary_type && s->ops[0]->type == integer_type
+      && s->ops[1]->type != integer_type)
+    switch (s->op.binary.op)
+      {
+      case '+':
+      case '*':
+      case '&':
+      case '|':
+      case '^':
+	SWAP (s->ops[0], s->ops[1]);
+	break;
+      }
+
+  int r;
+  for (r = 0; r < SIMPLIFY_NRULES; r++)
+    if (simplify_apply (ss, r))
+      {
+	fired[r]++;
+	struct ast *next = (*ss)->next;
+	(*ss)->next = NULL;
+	optimizer_r (ss);
+	(*ss)->next = next;
+	return;
+      }
+}
+
+/**
+ * Report how many times each rule of simplify.def fired.
+ *
+ * @param f The file to write the report to.
  */
-#define FOLD_INT_BIN(CASE, OP)			\
-  case CASE:					\
-  FOLD_INTEGER_BIN (OP);			\
-  break
+static void
+simplify_report (FILE *f)
+{
+  int r;
+  for (r = 0; r < SIMPLIFY_NRULES; r++)
+    if (fired[r] > 0)
+      fprintf (f, _("simplify: %s fired %u times\n"), simplify_rules[r].name,
+	       fired[r]);
+}
 
 /** 
  * Recursive version of the optimizer.
@@ -143,41 +595,43 @@ optimizer_r (struct ast **ss)
       optimizer_r (&s->ops[0]);
       optimizer_r (&s->ops[1]);
       if (optimize > 0)
-	{
-	  switch (s->op.binary.op)
-	    {
-	      FOLD_INT_BIN ('+', +);
-	      FOLD_INT_BIN ('-', -);
-	      FOLD_INT_BIN ('*', *);
-	      FOLD_INT_BIN ('/', /);
-	      FOLD_INT_BIN ('%', %);
-	      FOLD_INT_BIN ('>', >);
-	      FOLD_INT_BIN ('<', <);
-	      FOLD_INT_BIN (GE, >=);
-	      FOLD_INT_BIN (LE, <=);
-	      FOLD_INT_BIN (EQ, ==);
-	      FOLD_INT_BIN (NE, !=);
-	      FOLD_INT_BIN (RS, >>);
-	      FOLD_INT_BIN (LS, <<);
-	    default:
-	      break;
-	    }
-	}
+	FOLD_INTEGER_BIN ();
+      if (optimize > 0 && s->type == binary_type)
+	simplify (ss);
       break;
 
       /* Fold up constant expressions. */
     case unary_type:
       optimizer_r (&s->ops[0]);
       if (optimize > 0)
+	FOLD_INTEGER_UNI ();
+      if (optimize > 0 && s->type == unary_type)
+	simplify (ss);
+      break;
+
+      /* The NOT of a literal is a literal. */
+    case integer_type:
+      fold_not (s);
+      break;
+
+      /* Pick the side of a conditional move whose condition is known,
+	 as long as the other side didn't need to be evaluated. */
+    case ternary_type:
+      optimizer_r (&s->ops[0]);
+      optimizer_r (&s->ops[1]);
+      optimizer_r (&s->ops[2]);
+      if (optimize > 0 && s->ops[0]->type == integer_type)
 	{
-	  switch (s->op.unary.op)
+	  int k = s->ops[0]->op.integer.i ? 1 : 2;
+	  if (!has_side_effects (s->ops[3 - k]))
 	    {
-	    case '-':
-	      FOLD_INTEGER_UNI (-);
-	      break;
-
-	    default:
-	      break;
+	      struct ast *t = s->ops[k];
+	      s->ops[k] = NULL;
+	      t->boolean_not ^= s->boolean_not;
+	      t->throw_away = s->throw_away;
+	      SWAP_AST (s, t);
+	      AST_FREE (t);
+	      fold_not (s);
 	    }
 	}
       break;
@@ -194,6 +648,23 @@ optimizer_r (struct ast **ss)
 int
 optimizer (struct ast **ss)
 {
+  int r;
+  for (r = 0; r < SIMPLIFY_NRULES; r++)
+    {
+      const char *m = simplify_rules[r].match;
+      const char *p = simplify_rules[r].replace;
+      match[r] = parse_pattern (&m);
+      replace[r] = parse_pattern (&p);
+    }
+
   optimizer_r (ss);
+
+  for (r = 0; r < SIMPLIFY_NRULES; r++)
+    {
+      free_pattern (match[r]);
+      free_pattern (replace[r]);
+    }
+  if (verbose)
+    simplify_report (stderr);
   return 0;
 }
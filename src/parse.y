@@ -38,6 +38,7 @@
 #include "lib.h"
 #include "my_printf.h"
 #include "place_holder.h"
+#include "switch.h"
 #include "xalloc.h"
 
 #include <stdlib.h>
@@ -53,6 +54,7 @@ struct ast *make_whileloop (struct ast *, struct ast *);
 struct ast *make_array (char *, char *, struct ast *);
 struct ast *make_forloop (struct ast *, struct ast *, struct ast *, struct ast *);
 struct ast *make_ifelse (struct ast *, struct ast *, struct ast *);
+struct ast *make_unrolled (struct ast *, long long);
 
 #ifndef YYDEBUG
 #define YYDEBUG 1
@@ -105,6 +107,7 @@ struct ast *make_ifelse (struct ast *, struct ast *, struct ast *);
 
 %union { long long i; }
 %token <i> INT
+%token <i> UNROLL "#pragma unroll"
 
 %union { char *str; }
 %token <str> STR STRING
@@ -149,8 +152,9 @@ def:		STR STR '(' defargs ')' scoped_body { $$ = make_function ($1, $2, $4, $6);
 	;
 
 qualdef:	STATIC def { $$ = $2; $$->static_decl = 1; }
-	|	INLINE def { $$ = $2; $$->static_decl = 1; }
-	|	EXTERN INLINE def { $$ = $3; }
+	|	STATIC INLINE def { $$ = $3; $$->static_decl = $$->inline_decl = 1; }
+	|	INLINE def { $$ = $2; $$->static_decl = $$->inline_decl = 1; }
+	|	EXTERN INLINE def { $$ = $3; $$->inline_decl = 1; }
 	|	EXTERN def { $$ = $2; }
 	|	def        { $$ = $1; }
 	;
@@ -166,8 +170,7 @@ body:		/* empty */         { $$ = NULL; }
 scoped_body:    '{' body '}' { $$ = make_block ($2); }
         ;
 
-sub_body:       scoped_body { $$ = $1; }
-	|	statement   { $$ = $1; }
+sub_body:       statement   { $$ = $1; }
         ;
 
 maybe_expr:     /* empty */ { $$ = NULL; }
@@ -176,6 +179,7 @@ maybe_expr:     /* empty */ { $$ = NULL; }
 
 /* Code statements. */
 statement:	';'                             { $$ = NULL; }
+	|	scoped_body                     { $$ = $1; }
 	|	STR STR ';'                     { $$ = make_variable ($1, $2); }
 	|	STR STR '[' expr ']' ';'        { $$ = make_array ($1, $2, $4); }
 	|	STR STR '=' expr ';'            { $$ = make_binary ('=', make_variable ($1, $2), $4); $$->throw_away = 1; }
@@ -184,10 +188,16 @@ statement:	';'                             { $$ = NULL; }
 	|	IF '(' expr ')' sub_body ELSE sub_body { $$ = make_ifelse ($3, $5, $7); }
 	|	STR ':' statement               { $$ = ast_cat (make_label ($1), $3); }
 	|	GOTO STR ';'                    { $$ = make_jump ($2); }
+	|	GOTO '*' expr ';'               { $$ = make_computed_jump ($3); }
 	|	WHILE '(' expr ')' sub_body     { $$ = make_whileloop ($3, $5); }
 	|	DO sub_body WHILE '(' expr ')' ';' { $$ = make_dowhileloop ($5, $2); }
 	|	FOR '(' maybe_expr ';' expr ';' maybe_expr ')' sub_body { $$ = make_forloop ($3, $5, $7, $9); }
 	|	FOR '(' maybe_expr ';' ';' maybe_expr ')' sub_body { $$ = make_forloop ($3, make_integer (1), $6, $8); }
+	|	SWITCH '(' expr ')' { switch_begin (); } sub_body { $$ = switch_end ($3, $6); if ($$ == NULL) YYERROR; }
+	|	CASE expr ':' statement         { $$ = switch_case ($2, $4); if ($$ == NULL) YYERROR; }
+	|	DEFAULT ':' statement           { $$ = switch_default ($3); if ($$ == NULL) YYERROR; }
+	|	BREAK ';'                       { $$ = make_jump (xstrdup (BREAK_LABEL)); }
+	|	UNROLL statement                { $$ = make_unrolled ($2, $1); }
 	|	RETURN ';'                      { $$ = make_ret (NULL); }
 	|	RETURN expr ';'                 { $$ = make_ret ($2); }
 	;
@@ -234,7 +244,10 @@ expr:		STR                   { $$ = make_variable (NULL, $1); }
 	|	expr GE expr          { $$ = make_binary (GE, $1, $3); }
 	|	expr RS expr          { $$ = make_binary (RS, $1, $3); }
 	|	expr LS expr          { $$ = make_binary (LS, $1, $3); }
+	|	expr AND expr         { $$ = make_binary (AND, $1, $3); }
+	|	expr OR expr          { $$ = make_binary (OR, $1, $3); }
 	|	'&'expr %prec SIZEOF  { $$ = make_unary ('&', $2); }
+	|	AND STR %prec SIZEOF  { $$ = make_label_value ($2); }
 	|	'*'expr %prec SIZEOF  { $$ = make_unary ('*', $2); }
 	|	'~'expr               { $$ = make_unary ('~', $2); }
 	|	'!'expr %prec SIZEOF  { $$ = $2; $$->boolean_not ^= 1; }
@@ -284,14 +297,15 @@ struct ast *
 make_dowhileloop (struct ast *cond, struct ast *body)
 {
   char *t = place_holder (), *tt = xstrdup (t);
-  return ast_cat (make_label (t), ast_cat (body, make_cond (tt, cond)));
+  return breakable (ast_cat (make_label (t),
+			     ast_cat (body, make_cond (tt, cond))));
 }
 
 struct ast *
 make_whileloop (struct ast *cond, struct ast *body)
 {
   char *t = place_holder (), *tt = xstrdup (t);
-  return ast_cat (make_label (t), make_ifstatement (cond, ast_cat (body, make_jump (tt))));
+  return breakable (ast_cat (make_label (t), make_ifstatement (cond, ast_cat (body, make_jump (tt)))));
 }
 
 struct ast *
@@ -323,3 +337,69 @@ make_ifelse (struct ast *cond, struct ast *body, struct ast *elsebody)
   out = ast_cat (make_ifstatement (cond, body), out);
   return out;
 }
+
+/** 
+ * Check if a jump after the label @c l goes back to it.
+ * 
+ * @param l The label.
+ * 
+ * @return true if one does, false otherwise.
+ */
+static int
+jumps_back (const struct ast *l)
+{
+  const struct ast *s;
+  for (s = l->next; s != NULL; s = s->next)
+    if ((s->type == jump_type && STREQ (s->op.jump.name, l->op.label.name))
+	|| (s->type == cond_type && STREQ (s->op.cond.name, l->op.label.name)))
+      return 1;
+  return 0;
+}
+
+/** 
+ * Find the label that the loop at the start of @c s jumps back to.
+ * This looks through blocks and through the statements that come
+ * before the loop, such as the initializer of a for loop, but not
+ * past any other control flow.
+ * 
+ * @param s The statements.
+ * 
+ * @return The label, or NULL if @c s doesn't start with a loop.
+ */
+static struct ast *
+loop_label (struct ast *s)
+{
+  for (; s != NULL; s = s->next)
+    switch (s->type)
+      {
+      case block_type:
+	return loop_label (s->ops[0]);
+
+      case label_type:
+	if (jumps_back (s))
+	  return s;
+	break;
+
+      case cond_type:
+      case jump_type:
+      case computed_jump_type:
+      case ret_type:
+	return NULL;
+
+      default:
+	break;
+      }
+  return NULL;
+}
+
+struct ast *
+make_unrolled (struct ast *loop, long long n)
+{
+  struct ast *l = loop_label (loop);
+  if (l != NULL)
+    l->unroll = n;
+  else
+    error_at_line (0, 0, file_name, yylineno,
+		   _("#pragma unroll is not followed by a loop"));
+  return loop;
+}
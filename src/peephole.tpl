@@ -0,0 +1,100 @@
+[+ AutoGen5 template
+h
+c
++]
+
+/**
+ * @file
+ * @author Kieran Colford <colfordk@gmail.com>
+ *
+ * @brief This file contains the rewrite rules of the peephole
+ * optimizer.
+ *
+ * Copyright (C) 2014, 2015 Kieran Colford
+ *
+ * This file is part of Mongoose.
+ *
+ * Mongoose is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mongoose is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mongoose; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+[+ CASE (suffix) +]
+
+[+ == h +]
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+/**
+ * A rewrite rule of the peephole optimizer.
+ *
+ */
+struct peephole_rule
+{
+  const char *name;		/**< The name that the rule is
+				   reported under. */
+  const char *const *match;	/**< The instructions that the rule
+				   matches, terminated by NULL. */
+  const char *const *replace;	/**< The instructions that they are
+				   replaced with, terminated by
+				   NULL. */
+  const char *regs;		/**< The variables that must be
+				   registers. */
+  const char *apart;		/**< The pairs of variables that must
+				   not contain each other. */
+};
+
+/**
+ * The rules of the peephole optimizer, in the order that they are
+ * tried.
+ */
+extern const struct peephole_rule peephole_rules[];
+
+/**
+ * The number of rules of the peephole optimizer.
+ */
+#define PEEPHOLE_NRULES [+ (count "rule") +]
+
+#endif
+[+ == c +]
+#include "config.h"
+
+#include "peephole.h"
+
+#include <stdlib.h>
+
+[+ FOR rule +]
+/* [+doc+] */
+static const char *const match_[+ (for-index) +][] = {
+  [+ FOR match +]"[+match+]", [+ ENDFOR match +]NULL
+};
+static const char *const replace_[+ (for-index) +][] = {
+  [+ FOR replace +]"[+replace+]", [+ ENDFOR replace +]NULL
+};
+[+ ENDFOR rule +]
+
+const struct peephole_rule peephole_rules[] = {
+  [+ FOR rule ',
+  ' +]{ "[+name+]", match_[+ (for-index) +], replace_[+ (for-index) +],
+    "[+ FOR reg +][+reg+][+ ENDFOR reg +]",
+    "[+ FOR apart +][+apart+][+ ENDFOR apart +]" }[+ ENDFOR rule +]
+};
+
+[+ ESAC +]
+
+/* Hey Emacs!
+Local Variables:
+mode: c
+End:
+*/
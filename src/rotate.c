@@ -0,0 +1,138 @@
+/**
+ * @file   rotate.c
+ * @author Kieran Colford <colfordk@gmail.com>
+ *
+ * @brief This is the loop rotation pass.
+ *
+ * Copyright (C) 2014, 2015 Kieran Colford
+ *
+ * This file is part of Mongoose.
+ *
+ * Mongoose is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mongoose is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mongoose; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * @note The parser lowers a while loop, and so a for loop, to
+ *
+ * @code
+ * top: if (!cond) goto end; body; goto top; end:
+ * @endcode
+ *
+ * which takes two branches on every trip around.  This pass turns it
+ * into
+ *
+ * @code
+ * if (!cond) goto end; body: body; top: if (cond) goto body; end:
+ * @endcode
+ *
+ * which is the shape of a do while loop behind a guard.  The
+ * condition is evaluated exactly as many times as before, so it may
+ * have side effects.  The old label stays in front of the test at
+ * the bottom, since anything else that jumps to it wants the
+ * condition checked again.
+ *
+ */
+
+#include "config.h"
+
+#include "ast.h"
+#include "ast_util.h"
+#include "cfg.h"
+#include "compiler.h"
+#include "free.h"
+#include "lib.h"
+#include "my_printf.h"
+#include "xalloc.h"
+
+static int labelno = 1;		/**< The number of the next label. */
+
+/**
+ * Find the jump back to the label @c top that sits right before the
+ * label @c end, looking through the list of statements that starts
+ * at @c ss.
+ *
+ * @param ss A reference to the list.
+ * @param top The label at the top of the loop.
+ * @param end The label that the loop exits to.
+ *
+ * @return A reference to the jump, or NULL.
+ */
+static struct ast **
+find_back_edge (struct ast **ss, const struct loc *top, const struct loc *end)
+{
+  for (; *ss != NULL; ss = &(*ss)->next)
+    {
+      const struct ast *s = *ss;
+      if (s->type == jump_type && STREQ (s->loc->base, top->base)
+	  && s->next != NULL && s->next->type == label_type
+	  && STREQ (s->next->loc->base, end->base))
+	return ss;
+    }
+  return NULL;
+}
+
+/**
+ * Rotate each of the loops in the function @c f.
+ *
+ * @param f The function.
+ */
+static void
+rotate_function (struct ast *f)
+{
+  /* The loops have to be seen all at the same level. */
+  cfg_free (cfg_build (f));
+
+  struct ast **ss;
+  for (ss = &f->ops[1]->ops[0]; *ss != NULL; ss = &(*ss)->next)
+    {
+      struct ast *top = *ss, *c = top->next;
+      if (top->type != label_type || c == NULL || c->type != cond_type)
+	continue;
+      struct ast **jj = find_back_edge (&c->next, top->loc, c->loc);
+      if (jj == NULL)
+	continue;
+
+      struct ast *j = *jj, *end = j->next;
+      char *name = my_printf (".LR%d", labelno++);
+      struct ast *body = make_label (xstrdup (name));
+      MAKE_BASE_LOC (body->loc, symbol_loc, name);
+      body->unroll = top->unroll;
+      top->unroll = 0;
+      struct ast *test = make_cond (xstrdup (name), ast_dup (c->ops[0]));
+      test->ops[0]->boolean_not ^= 1;
+      test->loc = loc_dup (body->loc);
+
+      /* Put the old label and the new test in place of the jump,
+	 then the new label after the guard. */
+      *jj = top;
+      top->next = test;
+      test->next = end;
+      body->next = c->next;
+      c->next = body;
+      *ss = c;
+
+      j->next = NULL;
+      AST_FREE (j);
+    }
+}
+
+int
+rotate (struct ast *s)
+{
+  if (optimize < 1)
+    return 0;
+  for (; s != NULL; s = s->next)
+    if (s->type == function_type)
+      rotate_function (s);
+  return 0;
+}
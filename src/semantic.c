@@ -27,9 +27,13 @@
 #include "config.h"
 
 #include "ast.h"
+#include "ast_util.h"
 #include "compiler.h"
 #include "lib.h"
 #include "parse.h"
+#include "switch.h"
+
+#include <assert.h>
 
 /** 
  * An error macro for making life easier in this semantic pass.
@@ -79,10 +83,29 @@ is_lval (struct ast *s)
 #define CHECK_LVAL(VAL)							\
   ERROR (is_lval (VAL), _("WARNING: operand is not an lval"))
 
-static int check_return = 0;	/**< Global variable that tells the
-				   semantic pass whether or not to
-				   make sure the function has a return
-				   statement. */
+/**
+ * Check if there is an AST of the type @c type in @c s or the ASTs
+ * after it.
+ *
+ * @param s The AST to look through.
+ * @param type The type.
+ *
+ * @return true if there is, false otherwise.
+ */
+static int
+has_type (const struct ast *s, enum ast_code type)
+{
+  for (; s != NULL; s = s->next)
+    {
+      if (s->type == type)
+	return 1;
+      int i;
+      for (i = 0; i < s->num_ops; i++)
+	if (has_type (s->ops[i], type))
+	  return 1;
+    }
+  return 0;
+}
 
 /** 
  * Recursive version of @c semantic to walk over the entire tree.
@@ -100,11 +123,23 @@ semantic_r (struct ast *s)
   switch (s->type)
     {
     case function_type:
-      check_return = 1;
+      /* Make sure that control can't run off the end of the
+	 function. */
+      assert (s->ops[1]->type == block_type);
+      struct ast *t = s->ops[1]->ops[0];
+      while (t != NULL && t->next != NULL)
+	t = t->next;
+      if (t == NULL || t->type != ret_type)
+	s->ops[1]->ops[0] = ast_cat (s->ops[1]->ops[0], make_ret (NULL));
+      /* A computed goto can only go to a label of its own function. */
+      ERROR (!has_type (s->ops[1], computed_jump_type)
+	     || has_type (s->ops[1], label_value_type),
+	     _("computed goto in a function that takes no label addresses"));
       break;
 
-    case ret_type:
-      check_return = 0;
+    case jump_type:
+      ERROR (STRNEQ (s->op.jump.name, BREAK_LABEL),
+	     _("break statement not within a loop or switch"));
       break;
 
     case binary_type:
@@ -122,14 +157,7 @@ semantic_r (struct ast *s)
     }
   int i;
   for (i = 0; i < s->num_ops; i++)
-    {
-      int return_save = check_return;
-      check_return = 0;
-      ret = ret || semantic_r (s->ops[i]);
-      check_return = return_save;
-    }
-  if (s->next == NULL && check_return)
-      s->next = make_ret (NULL);
+    ret = ret || semantic_r (s->ops[i]);
   ret = ret || semantic_r (s->next);
   return ret;
 }
@@ -137,7 +165,5 @@ semantic_r (struct ast *s)
 int
 semantic (struct ast *s)
 {
-  check_return = 0;
-  
   return semantic_r (s);
 }
@@ -0,0 +1,81 @@
+[+ AutoGen5 template
+h
+c
++]
+
+/**
+ * @file
+ * @author Kieran Colford <colfordk@gmail.com>
+ *
+ * @brief This file contains the algebraic rewrite rules of the
+ * optimizer.
+ *
+ * Copyright (C) 2014, 2015 Kieran Colford
+ *
+ * This file is part of Mongoose.
+ *
+ * Mongoose is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mongoose is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mongoose; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+[+ CASE (suffix) +]
+
+[+ == h +]
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
+/**
+ * An algebraic rewrite rule of the optimizer.
+ *
+ */
+struct simplify_rule
+{
+  const char *name;		/**< The name that the rule is
+				   reported under. */
+  const char *match;		/**< The tree that the rule
+				   matches. */
+  const char *replace;		/**< The tree that it is replaced
+				   with. */
+};
+
+/**
+ * The algebraic rewrite rules, in the order that they are tried.
+ */
+extern const struct simplify_rule simplify_rules[];
+
+/**
+ * The number of algebraic rewrite rules.
+ */
+#define SIMPLIFY_NRULES [+ (count "rule") +]
+
+#endif
+[+ == c +]
+#include "config.h"
+
+#include "simplify.h"
+
+const struct simplify_rule simplify_rules[] = {
+  [+ FOR rule ',
+  ' +]/* [+doc+] */
+  { "[+name+]", "[+match+]", "[+replace+]" }[+ ENDFOR rule +]
+};
+
+[+ ESAC +]
+
+/* Hey Emacs!
+Local Variables:
+mode: c
+End:
+*/
@@ -0,0 +1,281 @@
+/**
+ * @file   slots.c
+ * @author Kieran Colford <colfordk@gmail.com>
+ *
+ * @brief This is the stack slot coloring pass.
+ *
+ * Copyright (C) 2014, 2015 Kieran Colford
+ *
+ * This file is part of Mongoose.
+ *
+ * Mongoose is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mongoose is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mongoose; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * @note The de-alias pass only lets the variables of scopes that
+ * don't overlap share their slots in the frame.  Once the other
+ * passes are done, this one works out where each of the local
+ * variables that are tracked is live, and two of them interfere when
+ * one is stored to while the other is live.  The ones that don't
+ * interfere are given the same slot, which is like coloring a graph
+ * whose nodes are the variables and whose edges are the
+ * interferences, and the frame shrinks to the slots that are left.
+ * The parameters and the variables whose address is taken keep the
+ * slots that they have.
+ *
+ */
+
+#include "config.h"
+
+#include "ast.h"
+#include "ast_util.h"
+#include "cfg.h"
+#include "compiler.h"
+#include "free.h"
+#include "lib.h"
+#include "parse.h"
+#include "xalloc.h"
+
+#include <string.h>
+
+static struct cfg *graph;	/**< The function being worked on. */
+static char *conflicts;		/**< Whether each pair of tracked
+				   variables interferes. */
+
+/**
+ * Note that the tracked variables that are set in @c a interfere with
+ * the ones that are set in @c b.
+ *
+ * @param a The first set.
+ * @param b The second set.
+ */
+static void
+interfere (const char *a, const char *b)
+{
+  int n = graph->nvars, i, j;
+  for (i = 0; i < n; i++)
+    if (a[i])
+      for (j = 0; j < n; j++)
+	if (b[j] && i != j)
+	  {
+	    conflicts[i * n + j] = 1;
+	    conflicts[j * n + i] = 1;
+	  }
+}
+
+/**
+ * Note the interferences of the statement @c s, given the variables
+ * that are live after it, and then move the set to before it.  A
+ * store of a value that doesn't store to anything else can share its
+ * slot with a variable that it reads, since that is read first.
+ * Anything else has to keep what it stores apart from everything
+ * that is live around it.
+ *
+ * @param s The statement.
+ * @param live The live variables.
+ */
+static void
+scan_stmt (const struct ast *s, char *live)
+{
+  const struct ast *e = cfg_stmt_expr ((struct ast *) s);
+  if (e == NULL)
+    return;
+  int n = graph->nvars;
+  char *kill = xzalloc (n + 1), *around = xzalloc (n + 1);
+  cfg_kills (graph, e, kill);
+  memcpy (around, live, n);
+  cfg_transfer (graph, s, live);
+
+  int v = -1, i, stores = 0;
+  for (i = 0; i < n; i++)
+    stores += kill[i];
+  if (e->type == binary_type && e->op.binary.op == '=')
+    v = cfg_var (graph, e->ops[0]);
+  if (v < 0 || stores > 1)
+    {
+      for (i = 0; i < n; i++)
+	around[i] |= live[i] | kill[i];
+    }
+  interfere (kill, around);
+  FREE (around);
+  FREE (kill);
+}
+
+/**
+ * Point every location in @c s at the frame offset @c from to the
+ * offset @c to instead.
+ *
+ * @param s The AST to rewrite.
+ * @param from The old offset.
+ * @param to The new offset.
+ */
+static void
+move_slot (struct ast *s, int from, int to)
+{
+  for (; s != NULL; s = s->next)
+    {
+      if (IS_MEMORY (s->loc) && s->loc->index == NULL
+	  && STREQ (s->loc->base, "%rbp") && s->loc->offset == from)
+	s->loc->offset = to;
+      int i;
+      for (i = 0; i < s->num_ops; i++)
+	move_slot (s->ops[i], from, to);
+    }
+}
+
+/**
+ * Check if the frame offset @c off belongs to a variable whose
+ * address is taken.
+ *
+ * @param off The offset.
+ *
+ * @return true if it does, false otherwise.
+ */
+static int
+is_fixed (int off)
+{
+  int i;
+  for (i = 0; i < graph->nslots; i++)
+    if (graph->slots[i] == off)
+      return 1;
+  return 0;
+}
+
+/**
+ * Color the slots of the variables of the function @c f and shrink
+ * its frame to fit them.
+ *
+ * @param f The function.
+ */
+static void
+slots_function (struct ast *f)
+{
+  struct cfg *g = cfg_build (f);
+  graph = g;
+  int nb = g->nblocks, n = g->nvars, b, i, j;
+  if (nb == 0 || n == 0)
+    {
+      cfg_free (g);
+      return;
+    }
+
+  int params = 0, locals = 0;
+  struct ast *s;
+  for (s = f->ops[0]; s != NULL; s = s->next)
+    if (s->type == variable_type)
+      params += s->op.variable.alloc;
+  for (s = f->ops[1]->ops[0]; s != NULL; s = s->next)
+    if (s->type == alloc_type && s->throw_away && s->ops[0] != NULL
+	&& s->ops[0]->type == integer_type)
+      locals += s->ops[0]->op.integer.i;
+
+  /* Find where the variables interfere. */
+  char *ins = xzalloc ((size_t) nb * n + 1);
+  char *outs = xzalloc ((size_t) nb * n + 1);
+  char *live = xzalloc (n + 1);
+  conflicts = xzalloc ((size_t) n * n + 1);
+  cfg_liveness (g, ins, outs);
+  for (b = 0; b < nb; b++)
+    {
+      int m;
+      struct ast **all = cfg_block_stmts (&g->blocks[b], &m);
+      memcpy (live, &outs[b * n], n);
+      for (i = m - 1; i >= 0; i--)
+	scan_stmt (all[i], live);
+      FREE (all);
+    }
+  /* Whatever is read before it is stored to holds what was left in
+     its slot, so it can't share it. */
+  memset (live, 1, n);
+  interfere (ins, live);
+
+  /* Hand out the slots below the parameters in order, skipping the
+     ones of the variables whose address is taken. */
+  int *color = xcalloc (n, sizeof *color), top = 0;
+  for (i = 0; i < g->nslots; i++)
+    if (-g->slots[i] - params > top)
+      top = -g->slots[i] - params;
+  for (i = 0; i < n; i++)
+    {
+      color[i] = 0;
+      if (g->vars[i] > -params - 8 || g->vars[i] < -params - locals)
+	continue;
+      int off;
+      for (off = -params - 8;; off -= 8)
+	{
+	  if (is_fixed (off))
+	    continue;
+	  for (j = 0; j < i; j++)
+	    if (color[j] == off && conflicts[i * n + j])
+	      break;
+	  if (j == i)
+	    break;
+	}
+      color[i] = off;
+      if (-off - params > top)
+	top = -off - params;
+    }
+
+  /* Move them, going through offsets that nothing uses so that two
+     variables that trade places don't end up in the same one. */
+  if (top < locals)
+    {
+      for (i = 0; i < n; i++)
+	if (color[i] != 0)
+	  move_slot (f->ops[1], g->vars[i], g->vars[i] - locals - 8);
+      for (i = 0; i < n; i++)
+	if (color[i] != 0)
+	  move_slot (f->ops[1], g->vars[i] - locals - 8, color[i]);
+
+      struct ast **ss;
+      for (ss = &f->ops[1]->ops[0]; *ss != NULL;)
+	{
+	  s = *ss;
+	  if (s->type == alloc_type && s->throw_away && s->ops[0] != NULL
+	      && s->ops[0]->type == integer_type)
+	    {
+	      *ss = s->next;
+	      s->next = NULL;
+	      AST_FREE (s);
+	      continue;
+	    }
+	  ss = &s->next;
+	}
+      if (top > 0)
+	{
+	  s = make_alloc (make_integer (top));
+	  s->throw_away = 1;
+	  s->next = f->ops[1]->ops[0];
+	  f->ops[1]->ops[0] = s;
+	}
+    }
+
+  FREE (color);
+  FREE (conflicts);
+  FREE (live);
+  FREE (outs);
+  FREE (ins);
+  cfg_free (g);
+  graph = NULL;
+}
+
+int
+slots (struct ast *s)
+{
+  if (optimize < 1)
+    return 0;
+  for (; s != NULL; s = s->next)
+    if (s->type == function_type)
+      slots_function (s);
+  return 0;
+}
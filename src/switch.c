@@ -0,0 +1,571 @@
+/**
+ * @file   switch.c
+ * @author Kieran Colford <colfordk@gmail.com>
+ *
+ * @brief This is where switch statements are lowered.
+ *
+ * Copyright (C) 2014, 2015 Kieran Colford
+ *
+ * This file is part of Mongoose.
+ *
+ * Mongoose is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mongoose is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mongoose; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * @note A switch statement becomes a store of its value to a new
+ * variable, the code that dispatches on it, and then its body with a
+ * label for each case.  The cases are sorted and grouped into
+ * clusters, each of which is one of
+ *
+ * - a run of cases that are close enough together to be a jump
+ *   table, which is a conditional goto for each of them and a jump to
+ *   the default, all marked so that the code generator can turn them
+ *   into a bounds check and an indirect jump,
+ *
+ * - a handful of cases that go to at most a few places and fit in a
+ *   64 bit mask, which are tested with a shift and an and for each
+ *   place,
+ *
+ * - or a single case on its own.
+ *
+ * The clusters are found with a binary search on the value, so the
+ * ranges that each one has to check for itself shrink as the search
+ * goes down.  Everything is still an ordinary conditional goto to the
+ * rest of the compiler, which keeps the optimizer honest about where
+ * control can go.
+ *
+ */
+
+#include "config.h"
+
+#include "ast.h"
+#include "ast_util.h"
+#include "compiler.h"
+#include "free.h"
+#include "lib.h"
+#include "parse.h"
+#include "place_holder.h"
+#include "switch.h"
+#include "xalloc.h"
+
+#include <limits.h>
+
+#define TABLE_MIN 4		/**< The fewest cases that are worth a
+				   jump table. */
+#define TABLE_DENSITY 40	/**< The percentage of the values that
+				   a jump table covers that have to be
+				   cases. */
+#define BIT_TEST_MIN 3		/**< The fewest cases that are worth a
+				   bit test. */
+#define BIT_TEST_TARGETS 3	/**< The most places that one bit test
+				   can go to. */
+#define BIT_TEST_WIDTH 64	/**< The widest range of values that a
+				   bit test can cover. */
+#define LINEAR_MAX 3		/**< The most single cases that are
+				   compared one after the other instead
+				   of being searched. */
+
+/**
+ * A case of a switch statement.
+ */
+struct case_label
+{
+  long long val;		/**< The value of the case. */
+  char *label;			/**< The label that it goes to. */
+};
+
+/**
+ * The cases of a switch statement that is being parsed.
+ */
+struct cases
+{
+  struct case_label *v;		/**< The cases. */
+  size_t n;			/**< How many there are. */
+  char *dflt;			/**< The label of the default case, or
+				   NULL if there isn't one. */
+};
+
+/**
+ * The kinds of clusters that the cases are grouped into.
+ */
+enum cluster_kind
+  {
+    single_cluster,
+    table_cluster,
+    bit_test_cluster
+  };
+
+/**
+ * A run of neighbouring cases that are dispatched on together.
+ */
+struct cluster
+{
+  enum cluster_kind kind;	/**< How they are dispatched on. */
+  size_t first;			/**< The first of the cases. */
+  size_t n;			/**< How many of them there are. */
+  long long lo;			/**< The smallest value. */
+  long long hi;			/**< The largest value. */
+};
+
+static struct cases *stack = NULL; /**< The switch statements that
+				      haven't ended yet. */
+static size_t depth = 0;	/**< How many of them there are. */
+
+static const struct case_label *cases; /**< The sorted cases of the
+					  switch being lowered. */
+static size_t ncases;		/**< How many there are. */
+static const char *var;		/**< The variable holding its value. */
+static const char *dflt;	/**< Where to go if no case matches. */
+
+/**
+ * Point the break statements in @c s that aren't inside of a nested
+ * loop or switch at the label @c label.  The nested ones were already
+ * pointed somewhere else when they were parsed.
+ *
+ * @param s The statements.
+ * @param label The label.
+ *
+ * @return The number of break statements that were found.
+ */
+static int
+bind_breaks (struct ast *s, const char *label)
+{
+  int n = 0;
+  for (; s != NULL; s = s->next)
+    {
+      if (s->type == jump_type && STREQ (s->op.jump.name, BREAK_LABEL))
+	{
+	  FREE (s->op.jump.name);
+	  s->op.jump.name = xstrdup (label);
+	  n++;
+	}
+      int i;
+      for (i = 0; i < s->num_ops; i++)
+	n += bind_breaks (s->ops[i], label);
+    }
+  return n;
+}
+
+struct ast *
+breakable (struct ast *s)
+{
+  char *l = place_holder ();
+  if (bind_breaks (s, l))
+    return ast_cat (s, make_label (l));
+  FREE (l);
+  return s;
+}
+
+/**
+ * Work out the value of the constant expression @c s.
+ *
+ * @param s The expression.
+ * @param v Where to put its value.
+ *
+ * @return true if it is a constant, false otherwise.
+ */
+static int
+constant (const struct ast *s, long long *v)
+{
+  long long a, b;
+  switch (s->type)
+    {
+    case integer_type:
+      *v = s->op.integer.i;
+      break;
+
+    case unary_type:
+      if (!constant (s->ops[0], &a) || !fold_unary (s->op.unary.op, a, v))
+	return 0;
+      break;
+
+    case binary_type:
+      if (!constant (s->ops[0], &a) || !constant (s->ops[1], &b)
+	  || !fold_binary (s->op.binary.op, a, b, v))
+	return 0;
+      break;
+
+    default:
+      return 0;
+    }
+  if (s->boolean_not)
+    *v = !*v;
+  return 1;
+}
+
+void
+switch_begin (void)
+{
+  stack = xnrealloc (stack, depth + 1, sizeof *stack);
+  struct cases *c = &stack[depth++];
+  c->v = NULL;
+  c->n = 0;
+  c->dflt = NULL;
+}
+
+struct ast *
+switch_case (struct ast *val, struct ast *s)
+{
+  long long v;
+  if (depth == 0)
+    {
+      error_at_line (0, 0, file_name, yylineno,
+		     _("case label not within a switch statement"));
+      return NULL;
+    }
+  if (!constant (val, &v))
+    {
+      error_at_line (0, 0, file_name, yylineno,
+		     _("case label does not reduce to an integer constant"));
+      return NULL;
+    }
+  AST_FREE (val);
+
+  struct cases *c = &stack[depth - 1];
+  size_t i;
+  for (i = 0; i < c->n; i++)
+    if (c->v[i].val == v)
+      {
+	error_at_line (0, 0, file_name, yylineno,
+		       _("duplicate case value %lld"), v);
+	return NULL;
+      }
+  c->v = xnrealloc (c->v, c->n + 1, sizeof *c->v);
+  c->v[c->n].val = v;
+  c->v[c->n].label = place_holder ();
+  return ast_cat (make_label (xstrdup (c->v[c->n++].label)), s);
+}
+
+struct ast *
+switch_default (struct ast *s)
+{
+  if (depth == 0)
+    {
+      error_at_line (0, 0, file_name, yylineno,
+		     _("default label not within a switch statement"));
+      return NULL;
+    }
+  struct cases *c = &stack[depth - 1];
+  if (c->dflt != NULL)
+    {
+      error_at_line (0, 0, file_name, yylineno,
+		     _("multiple default labels in one switch"));
+      return NULL;
+    }
+  c->dflt = place_holder ();
+  return ast_cat (make_label (xstrdup (c->dflt)), s);
+}
+
+/**
+ * Replace the label @c from with @c to among the cases of @c c.
+ *
+ * @param c The cases.
+ * @param from The old label.
+ * @param to The new label.
+ */
+static void
+rename_case (struct cases *c, const char *from, const char *to)
+{
+  size_t i;
+  for (i = 0; i < c->n; i++)
+    if (STREQ (c->v[i].label, from))
+      {
+	FREE (c->v[i].label);
+	c->v[i].label = xstrdup (to);
+      }
+  if (c->dflt != NULL && STREQ (c->dflt, from))
+    {
+      FREE (c->dflt);
+      c->dflt = xstrdup (to);
+    }
+}
+
+/**
+ * Send the cases whose labels come right after another label to that
+ * one instead, so that the cases that share their code also share
+ * their label.
+ *
+ * @param s The body of the switch.
+ * @param c Its cases.
+ */
+static void
+merge_labels (const struct ast *s, struct cases *c)
+{
+  const struct ast *head = NULL;
+  for (; s != NULL; s = s->next)
+    {
+      if (s->type != label_type)
+	{
+	  head = NULL;
+	  int i;
+	  for (i = 0; i < s->num_ops; i++)
+	    merge_labels (s->ops[i], c);
+	}
+      else if (head == NULL)
+	head = s;
+      else
+	rename_case (c, s->op.label.name, head->op.label.name);
+    }
+}
+
+/**
+ * Compare two cases by their values for @c qsort.
+ *
+ * @param a One case.
+ * @param b The other case.
+ *
+ * @return Which one comes first.
+ */
+static int
+compare_cases (const void *a, const void *b)
+{
+  const struct case_label *x = a, *y = b;
+  return (x->val > y->val) - (x->val < y->val);
+}
+
+/**
+ * Find the largest jump table that starts with the case @c i.
+ *
+ * @param i The first case.
+ *
+ * @return One past its last case, or @c i if there isn't one.
+ */
+static size_t
+table_end (size_t i)
+{
+  size_t j, end = i;
+  for (j = i + TABLE_MIN - 1; j < ncases; j++)
+    {
+      unsigned long long span = ((unsigned long long) cases[j].val
+				 - cases[i].val);
+      if (span / 100 < ncases
+	  && (j - i + 1) * 100 >= TABLE_DENSITY * (span + 1))
+	end = j + 1;
+    }
+  return end;
+}
+
+/**
+ * Find the largest bit test that starts with the case @c i.
+ *
+ * @param i The first case.
+ *
+ * @return One past its last case, or @c i if there isn't one.
+ */
+static size_t
+bit_test_end (size_t i)
+{
+  const char *targets[BIT_TEST_TARGETS];
+  int ntargets = 0;
+  size_t j;
+  for (j = i; j < ncases; j++)
+    {
+      if ((unsigned long long) cases[j].val - cases[i].val
+	  >= BIT_TEST_WIDTH)
+	break;
+      int k;
+      for (k = 0; k < ntargets; k++)
+	if (STREQ (targets[k], cases[j].label))
+	  break;
+      if (k == ntargets)
+	{
+	  if (ntargets == BIT_TEST_TARGETS)
+	    break;
+	  targets[ntargets++] = cases[j].label;
+	}
+    }
+  return j - i >= BIT_TEST_MIN ? j : i;
+}
+
+/**
+ * Make a comparison of the value being switched on with @c v.
+ *
+ * @param op The comparison.
+ * @param v The value.
+ *
+ * @return The comparison.
+ */
+static struct ast *
+compare (int op, long long v)
+{
+  return make_binary (op, make_variable (NULL, xstrdup (var)),
+		      make_integer (v));
+}
+
+/**
+ * Make the dispatch for the cluster @c c, knowing that the value is
+ * between @c lo and @c hi.
+ *
+ * @param c The cluster.
+ * @param lo The smallest that the value can be.
+ * @param hi The largest that the value can be.
+ *
+ * @return The statements that dispatch on it.
+ */
+static struct ast *
+lower_cluster (const struct cluster *c, long long lo, long long hi)
+{
+  const struct case_label *k = &cases[c->first];
+  struct ast *out = NULL, *t;
+  size_t i, j;
+  switch (c->kind)
+    {
+    case single_cluster:
+      if (lo == hi)
+	return make_jump (xstrdup (k->label));
+      out = make_cond (xstrdup (k->label), compare (EQ, k->val));
+      break;
+
+    case table_cluster:
+      /* The code generator checks the bounds itself. */
+      for (i = 0; i < c->n; i++)
+	{
+	  t = make_cond (xstrdup (k[i].label), compare (EQ, k[i].val));
+	  t->jump_table = 1;
+	  out = ast_cat (out, t);
+	}
+      t = make_jump (xstrdup (dflt));
+      t->jump_table = 1;
+      return ast_cat (out, t);
+
+    case bit_test_cluster:
+      if (c->lo > lo)
+	out = make_cond (xstrdup (dflt), compare ('<', c->lo));
+      if (c->hi < hi)
+	out = ast_cat (out, make_cond (xstrdup (dflt), compare ('>', c->hi)));
+      for (i = 0; i < c->n; i++)
+	{
+	  /* Only the first case that goes to each place makes the
+	     test for all of them. */
+	  for (j = 0; j < i; j++)
+	    if (STREQ (k[j].label, k[i].label))
+	      break;
+	  if (j < i)
+	    continue;
+	  unsigned long long mask = 0;
+	  for (j = i; j < c->n; j++)
+	    if (STREQ (k[j].label, k[i].label))
+	      mask |= 1ULL << (k[j].val - c->lo);
+	  struct ast *x = make_variable (NULL, xstrdup (var));
+	  if (c->lo != 0)
+	    x = make_binary ('-', x, make_integer (c->lo));
+	  t = make_binary ('&', make_binary (RS, make_integer ((long long) mask),
+						 x),
+			   make_integer (1));
+	  out = ast_cat (out, make_cond (xstrdup (k[i].label), t));
+	}
+      break;
+    }
+  return ast_cat (out, make_jump (xstrdup (dflt)));
+}
+
+/**
+ * Make a binary search for the value over the clusters @c c, knowing
+ * that it is between @c lo and @c hi.
+ *
+ * @param c The clusters.
+ * @param n How many there are.
+ * @param lo The smallest that the value can be.
+ * @param hi The largest that the value can be.
+ *
+ * @return The statements that do the search.
+ */
+static struct ast *
+search (const struct cluster *c, size_t n, long long lo, long long hi)
+{
+  size_t i;
+  if (n == 0)
+    return make_jump (xstrdup (dflt));
+  if (n == 1)
+    return lower_cluster (c, lo, hi);
+
+  /* A few single cases are compared one after the other. */
+  for (i = 0; i < n; i++)
+    if (c[i].kind != single_cluster)
+      break;
+  if (i == n && n <= LINEAR_MAX)
+    {
+      struct ast *out = NULL;
+      for (i = 0; i < n; i++)
+	out = ast_cat (out, make_cond (xstrdup (cases[c[i].first].label),
+				       compare (EQ, c[i].lo)));
+      return ast_cat (out, make_jump (xstrdup (dflt)));
+    }
+
+  size_t m = n / 2;
+  char *l = place_holder ();
+  struct ast *out = make_cond (xstrdup (l), compare (GE, c[m].lo));
+  out = ast_cat (out, search (c, m, lo, c[m].lo - 1));
+  out = ast_cat (out, make_label (l));
+  return ast_cat (out, search (c + m, n - m, c[m].lo, hi));
+}
+
+struct ast *
+switch_end (struct ast *val, struct ast *body)
+{
+  struct cases *c = &stack[--depth];
+  char *end = place_holder (), *v = place_holder ();
+  bind_breaks (body, end);
+  merge_labels (body, c);
+  qsort (c->v, c->n, sizeof *c->v, compare_cases);
+  cases = c->v;
+  ncases = c->n;
+  var = v;
+  dflt = c->dflt != NULL ? c->dflt : end;
+
+  /* Group the cases into clusters, taking whichever of a jump table
+     or a bit test covers the most of them. */
+  struct cluster *clusters = NULL;
+  size_t nclusters = 0, i = 0;
+  while (i < ncases)
+    {
+      size_t t = table_end (i), b = bit_test_end (i);
+      clusters = xnrealloc (clusters, nclusters + 1, sizeof *clusters);
+      struct cluster *cl = &clusters[nclusters++];
+      cl->first = i;
+      if (b > i && b >= t)
+	{
+	  cl->kind = bit_test_cluster;
+	  i = b;
+	}
+      else if (t > i)
+	{
+	  cl->kind = table_cluster;
+	  i = t;
+	}
+      else
+	{
+	  cl->kind = single_cluster;
+	  i++;
+	}
+      cl->n = i - cl->first;
+      cl->lo = cases[cl->first].val;
+      cl->hi = cases[i - 1].val;
+    }
+
+  struct ast *out = make_binary ('=', make_variable (xstrdup ("int"),
+						     xstrdup (v)), val);
+  out->throw_away = 1;
+  out = ast_cat (out, search (clusters, nclusters, LLONG_MIN, LLONG_MAX));
+  out = ast_cat (out, ast_cat (body, make_label (end)));
+
+  FREE (clusters);
+  for (i = 0; i < c->n; i++)
+    FREE (c->v[i].label);
+  FREE (c->v);
+  FREE (c->dflt);
+  FREE (v);
+  cases = NULL;
+  var = dflt = NULL;
+  return out;
+}
@@ -0,0 +1,90 @@
+/**
+ * @file   switch.h
+ * @author Kieran Colford <colfordk@gmail.com>
+ *
+ * @brief This is the header file for the switch statements and the
+ * break statements that leave them and loops.
+ *
+ * Copyright (C) 2014, 2015 Kieran Colford
+ *
+ * This file is part of Mongoose.
+ *
+ * Mongoose is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mongoose is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mongoose; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SWITCH_H
+#define SWITCH_H
+
+#include "ast.h"
+
+/**
+ * The name of the label that a break statement jumps to until the
+ * loop or switch around it is known.  It is a keyword, so it can't be
+ * the name of any other label.
+ */
+#define BREAK_LABEL "break"
+
+/**
+ * Point the break statements in @c s that aren't inside of a nested
+ * loop or switch at a new label placed after it.
+ *
+ * @param s The loop.
+ *
+ * @return The loop followed by the label, if it needs one.
+ */
+extern struct ast *breakable (struct ast *s);
+
+/**
+ * Start collecting the cases of a switch statement.  Switch
+ * statements nest, so each case belongs to the innermost one that
+ * hasn't ended yet.
+ */
+extern void switch_begin (void);
+
+/**
+ * Add a case to the innermost switch statement.
+ *
+ * @param val The value of the case, which must be a constant.
+ * @param s The statement after it.
+ *
+ * @return The label of the case followed by @c s, or NULL if there
+ * was an error.
+ */
+extern struct ast *switch_case (struct ast *val, struct ast *s);
+
+/**
+ * Add the default case to the innermost switch statement.
+ *
+ * @param s The statement after it.
+ *
+ * @return The label of the default case followed by @c s, or NULL
+ * if there was an error.
+ */
+extern struct ast *switch_default (struct ast *s);
+
+/**
+ * End the innermost switch statement and lower it into conditional
+ * gotos on its value.
+ *
+ * @param val The value being switched on.
+ * @param body The body with the cases in it.
+ *
+ * @return The lowered switch statement, or NULL if there was an
+ * error.
+ */
+extern struct ast *switch_end (struct ast *val, struct ast *body);
+
+#endif
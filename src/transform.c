@@ -30,8 +30,11 @@
 #include "ast.h"
 #include "ast_util.h"
 #include "compiler.h"
+#include "free.h"
 #include "lib.h"
 #include "parse.h"
+#include "place_holder.h"
+#include "xalloc.h"
 
 #include <assert.h>
 
@@ -39,6 +42,366 @@
   ((A)->ops[0]->type == variable_type				\
    && STREQ ((A)->ops[0]->op.variable.name, BUILTIN (B)))
 
+static char **labels = NULL;	/**< The labels of the current function
+				   whose addresses are taken. */
+static size_t nlabels = 0;	/**< How many there are. */
+
+/**
+ * Forget the labels whose addresses were taken.
+ */
+static void
+free_labels (void)
+{
+  size_t i;
+  for (i = 0; i < nlabels; i++)
+    FREE (labels[i]);
+  FREE (labels);
+  nlabels = 0;
+}
+
+/**
+ * Collect the labels whose addresses are taken in @c s.
+ *
+ * @param s The AST to look through.
+ */
+static void
+collect_labels (const struct ast *s)
+{
+  for (; s != NULL; s = s->next)
+    {
+      if (s->type == label_value_type)
+	{
+	  size_t i;
+	  for (i = 0; i < nlabels; i++)
+	    if (STREQ (labels[i], s->op.label_value.name))
+	      break;
+	  if (i == nlabels)
+	    {
+	      labels = xnrealloc (labels, nlabels + 1, sizeof *labels);
+	      labels[nlabels++] = xstrdup (s->op.label_value.name);
+	    }
+	}
+      int j;
+      for (j = 0; j < s->num_ops; j++)
+	collect_labels (s->ops[j]);
+    }
+}
+
+/**
+ * Lower the computed goto @c s to a store of the address to a new
+ * variable and a conditional goto to each label whose address is
+ * taken when it is the one.  These are marked as a jump table so that
+ * the code generator makes a single indirect jump out of them, but
+ * until then the passes know everywhere that it can go.
+ *
+ * @param s The computed goto.
+ *
+ * @return The statements that replace it.
+ */
+static struct ast *
+lower_computed_jump (struct ast *s)
+{
+  char *t = place_holder ();
+  struct ast *out = make_binary ('=', make_variable (xstrdup ("int"),
+						     xstrdup (t)), s->ops[0]);
+  out->throw_away = 1;
+  s->ops[0] = NULL;
+
+  /* The last label is the only place left to go. */
+  size_t i;
+  for (i = 0; i < nlabels; i++)
+    {
+      struct ast *j;
+      if (i + 1 < nlabels)
+	j = make_cond (xstrdup (labels[i]),
+		       make_binary (EQ, make_variable (NULL, xstrdup (t)),
+				    make_label_value (xstrdup (labels[i]))));
+      else
+	j = make_jump (xstrdup (labels[i]));
+      j->jump_table = 1;
+      out = ast_cat (out, j);
+    }
+  FREE (t);
+
+  out = ast_cat (out, s->next);
+  s->next = NULL;
+  AST_FREE (s);
+  return out;
+}
+
+/**
+ * Check if @c s is a logical and or a logical or.
+ *
+ * @param s The expression.
+ *
+ * @return true if it is, false otherwise.
+ */
+static int
+is_logical (const struct ast *s)
+{
+  return (s != NULL && s->type == binary_type
+	  && (s->op.binary.op == AND || s->op.binary.op == OR));
+}
+
+/**
+ * Push the negation of the logical and or logical or @c s onto its
+ * operands, so that the operator itself is never negated.
+ *
+ * @param s The expression.
+ */
+static void
+push_not (struct ast *s)
+{
+  if (!s->boolean_not)
+    return;
+  s->boolean_not = 0;
+  s->op.binary.op = s->op.binary.op == AND ? OR : AND;
+  s->ops[0]->boolean_not ^= 1;
+  s->ops[1]->boolean_not ^= 1;
+}
+
+/**
+ * Lower the conditional goto @c s on a logical and or a logical or to
+ * one conditional goto on each operand, so that the right one is only
+ * worked out when the left one doesn't decide where to go.  The new
+ * conditional gotos are lowered again if their operands are logical
+ * too.
+ *
+ * @param s The conditional goto.
+ *
+ * @return The statements that replace it.
+ */
+static struct ast *
+lower_logical_cond (struct ast *s)
+{
+  struct ast *e = s->ops[0];
+  push_not (e);
+  struct ast *a = e->ops[0];
+  s->ops[0] = e->ops[1];
+  e->ops[0] = e->ops[1] = NULL;
+  int op = e->op.binary.op;
+  AST_FREE (e);
+
+  if (op == OR)
+    return ast_cat (make_cond (xstrdup (s->op.cond.name), a), s);
+
+  /* Skip the right operand when the left one is false. */
+  char *l = place_holder ();
+  a->boolean_not ^= 1;
+  struct ast *out = make_cond (xstrdup (l), a);
+  struct ast *skip = make_label (l);
+  skip->next = s->next;
+  s->next = skip;
+  return ast_cat (out, s);
+}
+
+/**
+ * Turn @c s into 0 or 1 depending on whether it is true.
+ *
+ * @param s The expression.
+ *
+ * @return The new expression.
+ */
+static struct ast *
+truth (struct ast *s)
+{
+  if (is_logical (s))
+    return s;
+  if (s->type == binary_type)
+    switch (s->op.binary.op)
+      {
+      case EQ:
+      case NE:
+      case '<':
+      case '>':
+      case LE:
+      case GE:
+	return s;
+      }
+  if (!s->boolean_not)
+    return make_binary (NE, s, make_integer (0));
+  s->boolean_not = 0;
+  return make_binary (EQ, s, make_integer (0));
+}
+
+/**
+ * Replace the logical and or logical or at @c ss, whose value is
+ * needed, with a new variable.  It starts out with the value that the
+ * left operand decides, and a conditional goto on the left operand
+ * skips setting it from the right operand, which is done with a setcc.
+ *
+ * @param ss A reference to the expression.
+ *
+ * @return The statements that work out the variable.
+ */
+static struct ast *
+lower_logical_value (struct ast **ss)
+{
+  struct ast *e = *ss;
+  push_not (e);
+  char *t = place_holder (), *l = place_holder ();
+  int op = e->op.binary.op;
+  struct ast *out = make_binary ('=', make_variable (xstrdup ("int"),
+						     xstrdup (t)),
+				 make_integer (op == OR));
+  out->throw_away = 1;
+  if (op == AND)
+    e->ops[0]->boolean_not ^= 1;
+  out = ast_cat (out, make_cond (xstrdup (l), e->ops[0]));
+  struct ast *set = make_binary ('=', make_variable (NULL, xstrdup (t)),
+				 truth (e->ops[1]));
+  set->throw_away = 1;
+  out = ast_cat (out, ast_cat (set, make_label (l)));
+
+  *ss = make_variable (NULL, t);
+  (*ss)->next = e->next;
+  e->next = NULL;
+  e->ops[0] = e->ops[1] = NULL;
+  AST_FREE (e);
+  return out;
+}
+
+/**
+ * Check if there is a logical and or a logical or anywhere in @c s.
+ *
+ * @param s The expression.
+ *
+ * @return true if there is, false otherwise.
+ */
+static int
+has_logical (const struct ast *s)
+{
+  if (is_logical (s))
+    return 1;
+  int i;
+  for (i = 0; i < s->num_ops; i++)
+    {
+      const struct ast *j;
+      for (j = s->ops[i]; j != NULL; j = j->next)
+	if (has_logical (j))
+	  return 1;
+    }
+  return 0;
+}
+
+/**
+ * Check if @c s is a ternary with a logical and or a logical or in
+ * one of its arms.  Only one of the arms is worked out, so those
+ * can't be worked out ahead of it.
+ *
+ * @param s The expression.
+ *
+ * @return true if it is, false otherwise.
+ */
+static int
+is_guarded_logical (const struct ast *s)
+{
+  return (s->type == ternary_type
+	  && (has_logical (s->ops[1]) || has_logical (s->ops[2])));
+}
+
+/**
+ * Replace the ternary at @c ss with a new variable that is set from
+ * one arm or the other after a conditional goto on its condition, so
+ * that the logical ands and logical ors in the arms are lowered
+ * where they are worked out.
+ *
+ * @param ss A reference to the ternary.
+ *
+ * @return The statements that work out the variable.
+ */
+static struct ast *
+lower_ternary_value (struct ast **ss)
+{
+  struct ast *e = *ss;
+  char *t = place_holder (), *l = place_holder (), *end = place_holder ();
+  struct ast *a = make_binary ('=', make_variable (NULL, xstrdup (t)),
+			       e->ops[1]);
+  struct ast *b = make_binary ('=', make_variable (NULL, xstrdup (t)),
+			       e->ops[2]);
+  a->throw_away = 1;
+  b->throw_away = 1;
+  struct ast *out = make_variable (xstrdup ("int"), xstrdup (t));
+  out = ast_cat (out, make_cond (xstrdup (l), e->ops[0]));
+  out = ast_cat (out, ast_cat (b, make_jump (xstrdup (end))));
+  out = ast_cat (out, ast_cat (make_label (l), a));
+  out = ast_cat (out, make_label (end));
+
+  *ss = make_variable (NULL, t);
+  (*ss)->boolean_not = e->boolean_not;
+  (*ss)->next = e->next;
+  e->next = NULL;
+  e->ops[0] = e->ops[1] = e->ops[2] = NULL;
+  AST_FREE (e);
+  return out;
+}
+
+/**
+ * Take the logical ands and logical ors whose values are needed out
+ * of the expressions in the list @c s and put the statements that
+ * work them out in @c pre.  Their operands are left to be lowered
+ * when those statements are.  A ternary with one in an arm is taken
+ * out as a whole instead.
+ *
+ * @param ss A reference to the list.
+ * @param pre A reference to the statements.
+ */
+static void
+hoist_logical (struct ast **ss, struct ast **pre)
+{
+  for (; *ss != NULL; ss = &(*ss)->next)
+    if (is_logical (*ss))
+      *pre = ast_cat (*pre, lower_logical_value (ss));
+    else if (is_guarded_logical (*ss))
+      *pre = ast_cat (*pre, lower_ternary_value (ss));
+    else
+      {
+	int i;
+	for (i = 0; i < (*ss)->num_ops; i++)
+	  hoist_logical (&(*ss)->ops[i], pre);
+      }
+}
+
+/**
+ * Lower the logical ands and logical ors in the statements of a block
+ * to conditional gotos.  A conditional goto on one is split up into
+ * a chain of them, and the value of one that is used anywhere else is
+ * worked out by the statements before the one that uses it.
+ *
+ * @param ss A reference to the statements.
+ */
+static void
+lower_logical (struct ast **ss)
+{
+  while (*ss != NULL)
+    {
+      struct ast *s = *ss, *pre = NULL;
+      if (s->type == cond_type && is_logical (s->ops[0]))
+	{
+	  *ss = lower_logical_cond (s);
+	  continue;
+	}
+      if (is_guarded_logical (s))
+	{
+	  pre = lower_ternary_value (ss);
+	  *ss = ast_cat (pre, *ss);
+	  continue;
+	}
+      if (s->type != block_type)
+	{
+	  int i;
+	  for (i = 0; i < s->num_ops; i++)
+	    hoist_logical (&s->ops[i], &pre);
+	}
+      if (pre != NULL)
+	{
+	  *ss = ast_cat (pre, s);
+	  continue;
+	}
+      ss = &s->next;
+    }
+}
+
 static void
 transform_r (struct ast **ss)
 {
@@ -73,9 +436,24 @@ transform_r (struct ast **ss)
       break;
 
     case cond_type:
+    case ternary_type:
+      /* The condition only sets the flags. */
       s->ops[0]->noreturnint = 1;
       break;
 
+    case block_type:
+      lower_logical (&s->ops[0]);
+      break;
+
+    case function_type:
+      free_labels ();
+      collect_labels (s->ops[1]);
+      break;
+
+    case computed_jump_type:
+      s = lower_computed_jump (s);
+      break;
+
     case function_call_type:
       /* Certain functions are considered builtin and thus require
 	 special treatment. */
@@ -101,5 +479,6 @@ int
 transform (struct ast **ss)
 {
   transform_r (ss);
+  free_labels ();
   return 0;
 }
@@ -0,0 +1,485 @@
+/**
+ * @file   unroll.c
+ * @author Kieran Colford <colfordk@gmail.com>
+ *
+ * @brief This is the loop unrolling pass.
+ *
+ * Copyright (C) 2014, 2015 Kieran Colford
+ *
+ * This file is part of Mongoose.
+ *
+ * Mongoose is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mongoose is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mongoose; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * @note Only the innermost loops that the rotate pass has left with
+ * their test at the bottom are unrolled, and only when the test
+ * compares a variable that the loop steps by a literal once on every
+ * trip around to something that doesn't change.
+ *
+ * When the variable is set to a literal just before the loop and the
+ * test is against a literal, the number of trips is known, and a
+ * small enough loop is replaced by that many copies of its body.
+ * Otherwise the body is copied a few times into a new loop that runs
+ * as long as there are that many trips left, and the old loop is
+ * kept after it to run the ones that are left over.
+ *
+ * A loop marked with #pragma unroll N is fully unrolled if it makes
+ * no more than N trips, and otherwise unrolled N times, however big
+ * it is.  #pragma unroll 1 keeps a loop from being unrolled at all.
+ *
+ */
+
+#include "config.h"
+
+#include "ast.h"
+#include "ast_util.h"
+#include "cfg.h"
+#include "compiler.h"
+#include "free.h"
+#include "lib.h"
+#include "my_printf.h"
+#include "parse.h"
+#include "xalloc.h"
+
+#include <string.h>
+
+#define FULL_TRIPS 8		/**< The most trips that a loop is fully
+				   unrolled for without being asked
+				   to. */
+#define FULL_STMTS 64		/**< The most statements that fully
+				   unrolling a loop can make without
+				   being asked to. */
+#define FACTOR 4		/**< The number of copies of the body
+				   that a loop is unrolled into
+				   without being asked to. */
+#define SMALL_BODY 8		/**< The most statements that the body
+				   of a loop can have to be unrolled
+				   without being asked to. */
+
+static struct cfg *graph;	/**< The function being worked on. */
+static int labelno = 1;		/**< The number of the next label. */
+
+/**
+ * Make a label with a new name.
+ *
+ * @return The label.
+ */
+static struct ast *
+new_label (void)
+{
+  char *name = my_printf (".LU%d", labelno++);
+  struct ast *l = make_label (xstrdup (name));
+  MAKE_BASE_LOC (l->loc, symbol_loc, name);
+  return l;
+}
+
+/**
+ * Make a conditional goto to the label @c l.
+ *
+ * @param c The condition.
+ * @param l The label.
+ *
+ * @return The conditional goto.
+ */
+static struct ast *
+make_branch (struct ast *c, const struct ast *l)
+{
+  struct ast *s = make_cond (xstrdup (l->op.label.name), c);
+  c->noreturnint = 1;
+  s->loc = loc_dup (l->loc);
+  return s;
+}
+
+/**
+ * Copy the statements from @c first up to but not including @c last,
+ * giving the labels among them new names.
+ *
+ * @param first The first statement.
+ * @param last The statement after the last one.
+ *
+ * @return The copy.
+ */
+static struct ast *
+copy_body (struct ast *first, const struct ast *last)
+{
+  struct ast *out = NULL, **tail = &out, *s, *t;
+  for (s = first; s != last; s = s->next)
+    {
+      struct ast *next = s->next;
+      s->next = NULL;
+      *tail = ast_dup (s);
+      s->next = next;
+      tail = &(*tail)->next;
+    }
+
+  for (s = out; s != NULL; s = s->next)
+    {
+      if (s->type != label_type)
+	continue;
+      struct ast *l = new_label ();
+      for (t = out; t != NULL; t = t->next)
+	if ((t->type == jump_type || t->type == cond_type)
+	    && STREQ (t->loc->base, s->loc->base))
+	  {
+	    FREE_LOC (t->loc);
+	    t->loc = loc_dup (l->loc);
+	  }
+      FREE_LOC (s->loc);
+      s->loc = l->loc;
+      l->loc = NULL;
+      AST_FREE (l);
+    }
+  return out;
+}
+
+/**
+ * Find the reference to the statement @c s in the body of the
+ * function.
+ *
+ * @param s The statement.
+ *
+ * @return The reference.
+ */
+static struct ast **
+find_stmt (const struct ast *s)
+{
+  struct ast **ss = &graph->function->ops[1]->ops[0];
+  while (*ss != s)
+    ss = &(*ss)->next;
+  return ss;
+}
+
+/**
+ * Evaluate the test @c e of a loop for a value of its variable.
+ *
+ * @param e The test.
+ * @param j Which side of the test the variable is on.
+ * @param v The value of the variable.
+ *
+ * @return Whether the loop goes around again.
+ */
+static int
+run_test (const struct ast *e, int j, long long v)
+{
+  long long a = j == 0 ? v : e->ops[0]->op.integer.i;
+  long long b = j == 1 ? v : e->ops[1]->op.integer.i;
+  int r;
+  switch (e->op.binary.op)
+    {
+    case '<':
+      r = a < b;
+      break;
+    case '>':
+      r = a > b;
+      break;
+    case LE:
+      r = a <= b;
+      break;
+    case GE:
+      r = a >= b;
+      break;
+    default:
+      r = a == b;
+    }
+  return r ^ e->boolean_not;
+}
+
+/**
+ * Check if a test keeps passing for as long as its variable moves in
+ * the direction of @c step, up until some point.
+ *
+ * @param e The test.
+ * @param j Which side of the test the variable is on.
+ * @param step What the variable is stepped by.
+ *
+ * @return true if it does, false otherwise.
+ */
+static int
+monotonic (const struct ast *e, int j, long long step)
+{
+  int op = e->op.binary.op, up;
+  switch (op)
+    {
+    case '<':
+    case LE:
+      up = 1;
+      break;
+    case '>':
+    case GE:
+      up = 0;
+      break;
+    default:
+      return 0;
+    }
+  up ^= j ^ e->boolean_not;
+  return up ? step > 0 : step < 0;
+}
+
+/**
+ * Unroll the loop whose header is @c h, if it can be.
+ *
+ * @param h The header.
+ * @param body The blocks of the loop.
+ * @param done Where to add the labels of new loops, so that they
+ * aren't unrolled again.
+ * @param ndone The number of labels there.
+ */
+static void
+unroll_loop (int h, const char *body, char ***done, int *ndone)
+{
+  struct cfg *g = graph;
+  int nb = g->nblocks, n = g->nvars, l, b, k, v, j;
+  if (!cfg_preheader (g, h, body))
+    return;
+
+  /* The loop has to be laid out in one piece, with its only jump
+     back at the bottom. */
+  for (l = h; l + 1 < nb && body[l + 1]; l++)
+    ;
+  for (b = 0; b < nb; b++)
+    if (body[b] && (b < h || b > l))
+      return;
+  struct ast *label = g->blocks[h].first, *latch = g->blocks[l].last;
+  if (latch->type != cond_type || !STREQ (latch->loc->base, label->loc->base))
+    return;
+  for (b = h; b <= l; b++)
+    for (k = 0; k < 2; k++)
+      {
+	int t = g->blocks[b].succ[k];
+	if (t >= h && t <= b && !(b == l && t == h && k == 1))
+	  return;
+      }
+
+  /* Find the variable that the test depends on. */
+  struct ast *e = latch->ops[0];
+  if (e->type != binary_type)
+    return;
+  switch (e->op.binary.op)
+    {
+    case '<':
+    case '>':
+    case LE:
+    case GE:
+    case EQ:
+      break;
+    default:
+      return;
+    }
+  char *kill = xzalloc (n + 1), *k1 = xzalloc (n + 1);
+  int *stores = xcalloc (n + 1, sizeof *stores);
+  struct ast **steps = xcalloc (n + 1, sizeof *steps);
+  int *step_blocks = xcalloc (n + 1, sizeof *step_blocks);
+  struct ast *s;
+  int size = 0;
+  for (b = h; b <= l; b++)
+    CFG_FOREACH_STMT (s, &g->blocks[b])
+      {
+	if (s->type == alloc_type)
+	  size = -1;
+	if (size >= 0 && s != label && s != latch)
+	  size++;
+	memset (k1, 0, n + 1);
+	cfg_kills (g, s, k1);
+	for (k = 0; k < n; k++)
+	  if (k1[k])
+	    {
+	      kill[k] = 1;
+	      stores[k]++;
+	      steps[k] = s;
+	      step_blocks[k] = b;
+	    }
+      }
+  for (j = 0; j < 2; j++)
+    {
+      v = cfg_var (g, e->ops[j]);
+      if (v >= 0 && stores[v] == 1)
+	break;
+    }
+  long long step = 0;
+  const struct ast *x = j < 2 ? e->ops[!j] : NULL;
+  int ok = j < 2 && size > 0;
+  if (ok)
+    {
+      int xv = cfg_var (g, x);
+      ok = ((x->type == integer_type || (xv >= 0 && !kill[xv]))
+	    && cfg_step (g, steps[v], v, &step) && step != 0
+	    && cfg_dominates (g, step_blocks[v], l));
+    }
+  FREE (step_blocks);
+  FREE (steps);
+  FREE (stores);
+  FREE (k1);
+  FREE (kill);
+  if (!ok)
+    return;
+
+  /* Count the trips when they are known. */
+  int factor = label->unroll, trips = -1;
+  if (factor == 1)
+    return;
+  struct ast *init = NULL;
+  CFG_FOREACH_STMT (s, &g->blocks[h - 1])
+    {
+      char *k2 = xzalloc (n + 1);
+      cfg_kills (g, s, k2);
+      if (k2[v])
+	init = (s->type == binary_type && s->op.binary.op == '='
+		&& s->ops[1]->type == integer_type) ? s : NULL;
+      FREE (k2);
+    }
+  if (init != NULL && x->type == integer_type)
+    {
+      long long i = init->ops[1]->op.integer.i;
+      int limit = factor > FULL_TRIPS ? factor : FULL_TRIPS;
+      for (trips = 0; trips <= limit && run_test (e, j, i); trips++)
+	i += step;
+      if (trips > limit)
+	trips = -1;
+    }
+
+  struct ast *guard = g->blocks[h - 1].last;
+  if (trips > 0 && (factor >= trips
+		    || (factor == 0 && trips <= FULL_TRIPS
+			&& trips * size <= FULL_STMTS)))
+    {
+      /* Copy the body once for each trip and drop the test, along
+	 with the guard in front of the loop, which now always
+	 passes. */
+      struct ast *copies = NULL, **ss;
+      for (k = 1; k < trips; k++)
+	copies = ast_cat (copies, copy_body (label->next, latch));
+      ss = find_stmt (latch);
+      *ss = ast_cat (copies, latch->next);
+      latch->next = NULL;
+      if (guard->type == cond_type && !has_side_effects (guard->ops[0]))
+	{
+	  guard->ops[0]->boolean_not ^= 1;
+	  int same = same_tree (guard->ops[0], e);
+	  guard->ops[0]->boolean_not ^= 1;
+	  if (same)
+	    {
+	      ss = find_stmt (guard);
+	      *ss = guard->next;
+	      guard->next = NULL;
+	      AST_FREE (guard);
+	    }
+	}
+      AST_FREE (latch);
+      return;
+    }
+
+  if (factor == 0)
+    {
+      if (size > SMALL_BODY)
+	return;
+      factor = FACTOR;
+    }
+  if (!monotonic (e, j, step))
+    return;
+
+  /* Run the unrolled copies as long as the test would pass for all
+     of them, then fall into the old loop for the trips that are
+     left. */
+  struct ast *more = ast_dup (e);
+  more->ops[j] = make_binary ('+', more->ops[j],
+			      make_integer ((factor - 1) * step));
+  struct ast *end = latch->next;
+  if (end == NULL || end->type != label_type)
+    {
+      end = new_label ();
+      end->next = latch->next;
+      latch->next = end;
+    }
+  struct ast *top = new_label ();
+  struct ast *enter = ast_dup (more);
+  enter->boolean_not ^= 1;
+  struct ast *out = make_branch (enter, label);
+  out = ast_cat (out, top);
+  for (k = 0; k < factor; k++)
+    out = ast_cat (out, copy_body (label->next, latch));
+  out = ast_cat (out, make_branch (more, top));
+  struct ast *left = ast_dup (e);
+  left->boolean_not ^= 1;
+  out = ast_cat (out, make_branch (left, end));
+  ast_cat (out, label);
+  *find_stmt (label) = out;
+
+  *done = xnrealloc (*done, *ndone + 1, sizeof **done);
+  (*done)[(*ndone)++] = xstrdup (top->loc->base);
+}
+
+/**
+ * Unroll the first loop of the function @c f that hasn't been tried
+ * yet.
+ *
+ * @param f The function.
+ * @param done The labels of the headers of the loops that have been
+ * tried.
+ * @param ndone The number of them.
+ *
+ * @return true if there was a loop left to try, false otherwise.
+ */
+static int
+unroll_once (struct ast *f, char ***done, int *ndone)
+{
+  struct cfg *g = cfg_build (f);
+  graph = g;
+  int nb = g->nblocks, h, i;
+  cfg_dominators (g);
+
+  char *body = xzalloc (nb + 1);
+  for (h = 0; h < nb; h++)
+    {
+      const struct ast *l = g->blocks[h].first;
+      if (g->blocks[h].idom < 0 || l->type != label_type)
+	continue;
+      for (i = 0; i < *ndone; i++)
+	if (STREQ ((*done)[i], l->loc->base))
+	  break;
+      if (i == *ndone && cfg_loop (g, h, body) > 0)
+	break;
+    }
+  if (h < nb)
+    {
+      *done = xnrealloc (*done, *ndone + 1, sizeof **done);
+      (*done)[(*ndone)++] = xstrdup (g->blocks[h].first->loc->base);
+      unroll_loop (h, body, done, ndone);
+    }
+
+  FREE (body);
+  cfg_free (g);
+  graph = NULL;
+  return h < nb;
+}
+
+int
+unroll (struct ast *s)
+{
+  if (optimize < 1)
+    return 0;
+  for (; s != NULL; s = s->next)
+    /* A copy of a label whose address is taken would never be gone
+       to. */
+    if (s->type == function_type && !takes_label_address (s->ops[1], NULL))
+      {
+	char **done = NULL;
+	int ndone = 0, i;
+	while (unroll_once (s, &done, &ndone))
+	  ;
+	for (i = 0; i < ndone; i++)
+	  FREE (done[i]);
+	FREE (done);
+      }
+  return 0;
+}
@@ -34,7 +34,9 @@ FILE *outfile = NULL;
 char stop = 0;
 
 int optimize = 0;
+int omit_frame_pointer = 0;
 int debug = 0;
+int verbose = 0;
 
 gl_list_t infile_name = NULL;
 const char *outfile_name = NULL;
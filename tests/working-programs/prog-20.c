@@ -0,0 +1,16 @@
+int sum (int a, int b, int c, int d, int e, int f, int g, int h, int i, int j) {
+    return a + 2 * b + 3 * c + 4 * d + 5 * e + 6 * f + 7 * g + 8 * h + 9 * i + 10 * j;
+}
+
+int last (int a, int b, int c, int d, int e, int f, int g) {
+    return g - a;
+}
+
+int main () {
+    int x = 7;
+    printf ("%d\n", sum (1, 2, 3, 4, 5, 6, 7, 8, 9, 10));
+    printf ("%d\n", sum (x, x + 1, x * 2, 0, 1, 2, x, 3, x - 1, 4));
+    printf ("%d\n", last (1, 2, 3, 4, 5, 6, 40));
+    printf ("%d %d %d %d %d %d %d %d\n", 1, 2, 3, 4, 5, 6, 7, 8);
+    return 0;
+}
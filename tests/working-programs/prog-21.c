@@ -0,0 +1,14 @@
+int main () {
+    int a = 1;
+    { int t = 5; a = a + t; }
+    { int u; u = 7; a = a * u; }
+    {
+	int v = 3;
+	{ int w = 4; a = a + v * w; }
+	{ int x = 6; a = a - x + v; }
+    }
+    int b = 2;
+    { int y = 10; b = b * y; }
+    printf ("%d %d\n", a, b);
+    return 0;
+}
@@ -0,0 +1,15 @@
+int main () {
+    int a = 3;
+    int b = 5;
+    int n = 2;
+    int c = a + b * 4;
+    int d = b * 8 + a + 12;
+    int e = a << n;
+    int f = -40 >> n;
+    int g = a + b + 7;
+    if (10 > a)
+	printf ("%d %d %d %d %d %d\n", a, c, d, e, f, g);
+    if (a)
+	printf ("%d\n", a << 3);
+    return 0;
+}
@@ -0,0 +1,21 @@
+int show (int x) {
+    printf ("%d: %d %d %d %d %d %d %d %d\n", x, x * 0, x * 1, x * -1,
+	    x * 3, x * 6, x * 10, x * 12, x * -8);
+    printf ("%d %d %d %d %d %d %d %d\n", x / 1, x / -1, x / 2, x / 4,
+	    x / -8, x / 3, x / 7, x / 1000);
+    printf ("%d %d %d %d %d %d %d %d\n", x % 1, x % -1, x % 2, x % 8,
+	    x % -4, x % 5, x % 6, x % 1000);
+    return 0;
+}
+
+int main () {
+    show (0);
+    show (1);
+    show (-1);
+    show (7);
+    show (-7);
+    show (100);
+    show (-12345);
+    show (99999);
+    return 0;
+}
@@ -0,0 +1,12 @@
+int main () {
+    int a = -17;
+    int b = 5;
+    int c = -3;
+    int p[2];
+    p[1] = 7;
+    printf ("%d %d %d %d\n", a / b, a % b, a / c, a % c);
+    printf ("%d %d %d %d\n", b / c, b % c, (a * b) / (c * 2), a % (b + c));
+    printf ("%d %d %d %d\n", a * b, b * 11, 11 * c, p[1] * 13);
+    printf ("%d %d %d\n", a * p[1], (a + b) * (b + c), a * b * c * 100);
+    return 0;
+}
@@ -0,0 +1,46 @@
+int scale (int a) {
+    int n = 10;
+    int x = n * 4;
+    int y = a;
+    int z = y + 1;
+    int debug = 0;
+    if (debug)
+	printf ("debug %d\n", a);
+    if (n > 5)
+	z = z + x;
+    else
+	z = 0;
+    return z;
+}
+
+int main () {
+    int i;
+    int s = 0;
+    int k = 3;
+    for (i = 0; i < 10; i++)
+	s = s + k;
+    int c = 1;
+    while (c) {
+	c = 0;
+	s++;
+    }
+    int a;
+    int b;
+    a = b = 7;
+    int y = a;
+    a = 5;
+    printf ("%d %d %d\n", a, b, y);
+    int j = 0;
+    while (1) {
+	j++;
+	if (j > 4)
+	    goto out;
+    }
+ out:
+    if (1)
+	printf ("one %d\n", k);
+    if (!0)
+	printf ("two %d\n", !0);
+    printf ("%d %d %d\n", scale (5), s, j);
+    return 0;
+}
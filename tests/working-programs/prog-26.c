@@ -0,0 +1,33 @@
+int twist (int x, int y) {
+    int a = x + 0;
+    int b = (x + 1) + 2;
+    int c = x * 1 + (y - y);
+    int d = ~~x + -(-y);
+    int e = (x - 3) + 10;
+    int f = (x + 1) * 8;
+    int g = 4 + (y + x);
+    int h = (x * 3) * 5;
+    int i = x ^ x;
+    int j = (x | 0) & -1;
+    int k = (x & 12) & 10;
+    int l = x / -1 + x % -1 + x % 1;
+    return a + b + c + d + e + f + g + h + i + j + k + l;
+}
+
+int noisy (int v) {
+    printf ("noisy %d\n", v);
+    return v;
+}
+
+int main () {
+    printf ("%d\n", twist (5, 7));
+    printf ("%d\n", twist (-9, 2));
+    int n = noisy (4) * 0;
+    n = n + (noisy (1) & 0);
+    printf ("%d\n", n);
+    if (!(noisy (2) - 0))
+	printf ("zero\n");
+    else
+	printf ("nonzero\n");
+    return 0;
+}
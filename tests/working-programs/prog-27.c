@@ -0,0 +1,43 @@
+int mix (int x, int y) {
+    int r = (x + y) * (x - y);
+    if (x > y)
+	r = r + (x + y) * (x - y);
+    else
+	r = r - (x - y) * 3;
+    x = x + 1;
+    r = r + (x + y) * (x - y);
+    r = r + (x > 3 ? (x + y) * 2 : 0) + (x + y) * 2;
+    return r;
+}
+
+int main () {
+    int a[8];
+    int i;
+    for (i = 0; i < 8; i++)
+	a[i] = i * 3 - 5;
+    int k;
+    for (k = 2; k > -4; k = k - 5) {
+	int s = 0;
+	for (i = 0; i < 8; i++) {
+	    s = s + a[i] * k + a[i] / (k + 1);
+	    if (a[i] * k > 10)
+		s = s - a[i] * k;
+	    a[i] = a[i] + 1;
+	    s = s + a[i] * k;
+	}
+	printf ("%d\n", s);
+    }
+    printf ("%d %d\n", a[0], a[7]);
+    printf ("%d\n", mix (7, 2));
+    printf ("%d\n", mix (-4, 9));
+    int j = 0;
+    int t = 0;
+    while (j < 5) {
+	t = t + a[j + 1] * a[j + 1];
+	a[j + 1] = j;
+	t = t + a[j + 1] * a[j + 1];
+	j++;
+    }
+    printf ("%d\n", t);
+    return 0;
+}
@@ -0,0 +1,49 @@
+int say (int v) {
+    printf ("say %d\n", v);
+    return v;
+}
+
+int f (int x) {
+    int unused = x * 3;
+    int y = x + 1;
+    y;
+    x + 2;
+    int arr[10];
+    int z = say (x);
+    int w = 5;
+    w = 6;
+    if (x > 100)
+	return 1;
+    return y + w;
+    x = 9;
+    say (99);
+}
+
+int g (int n) {
+    int k = 0;
+    int t = n;
+    goto skip;
+    k = 100;
+ skip:
+    while (n > 0) {
+	t = n * 2;
+	k = k + n;
+	n--;
+    }
+    t = 0;
+    return k;
+}
+
+int main () {
+    printf ("%d\n", f (4));
+    printf ("%d\n", f (200));
+    printf ("%d\n", g (5));
+    int i = 0;
+    int last = 0;
+    while (i < 4) {
+	last = i;
+	i++;
+    }
+    printf ("%d\n", i);
+    return 0;
+}
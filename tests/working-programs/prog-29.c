@@ -0,0 +1,54 @@
+int tick (int v) {
+    printf ("tick %d\n", v);
+    return v;
+}
+
+int count (int n) {
+    int k = 0;
+    while (tick (n) > 0) {
+	n = n - 1;
+	k = k + 2;
+    }
+    return k;
+}
+
+int sum (int n) {
+    int i;
+    int j;
+    int s = 0;
+    for (i = 0; i < n; i++)
+	for (j = i; j < n; j++)
+	    s = s + i * j;
+    return s;
+}
+
+int skip (int n) {
+    int i = 0;
+    int s = 0;
+    while (i < n) {
+	i++;
+	if (i % 3 == 0)
+	    goto again;
+	s = s + i;
+    again:
+	;
+    }
+    return s;
+}
+
+int main () {
+    printf ("%d\n", count (3));
+    printf ("%d\n", count (0));
+    printf ("%d\n", sum (5));
+    printf ("%d\n", sum (0));
+    printf ("%d\n", skip (10));
+    int i = 10;
+    while (i < 5)
+	i++;
+    printf ("%d\n", i);
+    do
+	i--;
+    while (i > 7);
+    printf ("%d\n", i);
+    return 0;
+}
@@ -0,0 +1,49 @@
+int scale (int n, int a, int b) {
+    int i;
+    int j;
+    int s = 0;
+    int t[8];
+    for (i = 0; i < 8; i++)
+	t[i] = i * i;
+    for (i = 0; i < n; i++) {
+	for (j = 0; j < n; j++)
+	    s = s + a * b + t[a] + i * b;
+	if (i > 100)
+	    s = s + 100 / b;
+    }
+    return s;
+}
+
+int fill (int n, int k) {
+    int i = 0;
+    int s = 0;
+    int t[8];
+    t[2] = 5;
+    while (i < 8) {
+	t[i] = k;
+	k = k + 3;
+	s = s + t[2] * k;
+	i++;
+    }
+    return s;
+}
+
+int count (int n, int d) {
+    int i = 0;
+    int c = 0;
+    do {
+	if (i % (d + 1) == 0)
+	    c++;
+	i++;
+    } while (i < n);
+    return c;
+}
+
+int main () {
+    printf ("%d\n", scale (5, 3, 0));
+    printf ("%d\n", scale (4, 2, 7));
+    printf ("%d\n", scale (0, 2, 7));
+    printf ("%d\n", fill (8, 1));
+    printf ("%d\n", count (20, 2));
+    return 0;
+}
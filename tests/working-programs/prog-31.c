@@ -0,0 +1,43 @@
+int walk (int n) {
+    int a[20];
+    int b[20];
+    int i;
+    int s = 0;
+    for (i = 0; i < 20; i++)
+	a[i] = i * i;
+    for (i = 0; i != 20; i++)
+	b[i] = a[i] - 1;
+    for (i = 19; i >= 0; i--)
+	s = (s * 3 + b[i] % 7) % 1000;
+    printf ("%d\n", s);
+    for (i = 1; i < n; i += 2)
+	s = s + a[i];
+    printf ("%d %d\n", s, i);
+    for (i = 0; i < n; i++)
+	if (a[i] > 50)
+	    s = s - a[i];
+    return s;
+}
+
+int grid (int n) {
+    int t[16];
+    int i;
+    int j;
+    int s = 0;
+    for (i = 0; i < 16; i++)
+	t[i] = 0;
+    for (j = 0; j < n; j++)
+	for (i = j; i < 16; i++)
+	    t[i] = t[i] + j;
+    for (i = 0; i < 16; i++)
+	s = (s * 2 + t[i]) % 1000;
+    return s;
+}
+
+int main () {
+    printf ("%d\n", walk (20));
+    printf ("%d\n", walk (0));
+    printf ("%d\n", grid (5));
+    printf ("%d\n", grid (0));
+    return 0;
+}
@@ -0,0 +1,73 @@
+int tri (int n) {
+    int i;
+    int s = 0;
+    for (i = 0; i < n; i++)
+	s = s + i;
+    return s;
+}
+
+int odd (int n) {
+    int i;
+    int s = 0;
+#pragma unroll 3
+    for (i = n; i >= 0; i -= 2)
+	if (i % 3 != 0)
+	    s = s + i;
+    return s;
+}
+
+int fixed () {
+    int a[8];
+    int i;
+    int s = 0;
+    for (i = 0; i < 8; i++)
+	a[i] = i * 5;
+#pragma unroll 1
+    for (i = 0; i < 8; i++)
+	s = s + a[i];
+#pragma unroll 16
+    for (i = 1; i <= 12; i++)
+	s = s + i;
+    return s;
+}
+
+int nest (int n) {
+    int i;
+    int j;
+    int s = 0;
+    for (i = 0; i < n; i++)
+	for (j = 0; j < 3; j++)
+	    s = s + i * j;
+    return s;
+}
+
+int blocked (int n) {
+    int s = 0;
+#pragma unroll 3
+    {
+	int i;
+	for (i = 0; i < n; i++)
+	    s = s + i * i;
+    }
+#pragma unroll 1
+    {
+	int k = 0;
+	while (k < 4) {
+	    s = s + k;
+	    k++;
+	}
+    }
+    return s;
+}
+
+int main () {
+    int n;
+    for (n = 0; n < 7; n++) {
+	printf ("%d ", tri (n));
+	printf ("%d ", odd (n));
+	printf ("%d ", nest (n));
+	printf ("%d\n", blocked (n));
+    }
+    printf ("%d\n", fixed ());
+    return 0;
+}
@@ -0,0 +1,72 @@
+static inline int sq (int x) {
+    return x * x;
+}
+
+static inline int max (int a, int b) {
+    return a > b ? a : b;
+}
+
+#ifdef GCC
+/* A plain inline definition only gives an external one with this. */
+extern int clamp (int x, int lo, int hi);
+#endif
+
+inline int clamp (int x, int lo, int hi) {
+    if (x < lo)
+	return lo;
+    if (x > hi)
+	return hi;
+    return x;
+}
+
+static int sum_sq (int n) {
+    int i;
+    int s = 0;
+    for (i = 1; i <= n; i++)
+	s = s + sq (i);
+    return s;
+}
+
+int fact (int n) {
+    if (n <= 1)
+	return 1;
+    return n * fact (n - 1);
+}
+
+static int show (int a, int b) {
+    printf ("%d:%d\n", a, b);
+    return a + b;
+}
+
+static int collatz (int n) {
+    int steps = 0;
+    while (n != 1) {
+	if (n % 2 == 0)
+	    n = n / 2;
+	else
+	    n = 3 * n + 1;
+	steps++;
+    }
+    return steps;
+}
+
+int main () {
+    int i;
+    int t = 0;
+    for (i = -3; i < 12; i++) {
+	printf ("%d ", clamp (i, 0, 9));
+	printf ("%d ", max (sq (i), 10));
+	printf ("%d\n", sum_sq (i));
+    }
+    for (i = 1; i < 8; i++) {
+	printf ("%d ", fact (i));
+	printf ("%d ", collatz (i));
+	printf ("%d\n", collatz (i + 1));
+    }
+    show (1, 2);
+    t = show (sq (3), 5);
+    printf ("%d\n", t);
+    t = t ? clamp (t, 5, 6) : sq (7);
+    printf ("%d\n", t);
+    return 0;
+}
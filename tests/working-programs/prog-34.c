@@ -0,0 +1,44 @@
+int gcd (int a, int b) {
+    if (b == 0)
+	return a;
+    return gcd (b, a % b);
+}
+
+int sum (int n, int acc) {
+    if (n == 0)
+	return acc;
+    return sum (n - 1, (acc + n) % 10007);
+}
+
+int is_even (int n) {
+    if (n == 0)
+	return 1;
+    return is_odd (n - 1);
+}
+
+int is_odd (int n) {
+    if (n == 0)
+	return 0;
+    return is_even (n - 1);
+}
+
+int show (int x) {
+    return printf ("%d\n", x);
+}
+
+int through (int x) {
+    int y = x * 3;
+    return show (*&y);
+}
+
+int main () {
+    int i;
+    for (i = 1; i < 6; i++)
+	printf ("%d\n", gcd (i * 462, 1071));
+    printf ("%d\n", sum (100000, 0));
+    printf ("%d\n", is_even (50001));
+    printf ("%d\n", is_odd (50001));
+    printf ("%d\n", show (42));
+    printf ("%d\n", through (5));
+    return 0;
+}
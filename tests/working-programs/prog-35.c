@@ -0,0 +1,61 @@
+int min (int a, int b) {
+    if (a < b)
+	return a;
+    else
+	return b;
+}
+
+int absv (int x) {
+    if (x < 0)
+	x = -x;
+    return x;
+}
+
+int clamp (int x, int lo, int hi) {
+    if (x < lo)
+	return lo;
+    if (x > hi)
+	return hi;
+    return x;
+}
+
+int pick (int a, int b) {
+    int r;
+    if (a == b)
+	r = a + 1;
+    else
+	r = b - 1;
+    return r;
+}
+
+int safe_div (int a, int b) {
+    int r = 0;
+    if (b != 0)
+	r = a / b;
+    return r;
+}
+
+int main () {
+    int a[4];
+    int i;
+    int j = 0;
+    int n = 0;
+    for (i = 0; i < 4; i++)
+	a[i] = i * 7;
+    for (i = -4; i < 5; i++) {
+	printf ("%d ", min (i, 1));
+	printf ("%d ", absv (i));
+	printf ("%d ", clamp (i, -2, 2));
+	printf ("%d ", pick (i, 0));
+	printf ("%d ", safe_div (12, i));
+	if (i >= 0)
+	    if (i < 4)
+		n = a[i];
+	if (j++ < 3)
+	    n = n + 100;
+	else
+	    n = n - 1;
+	printf ("%d\n", n);
+    }
+    return 0;
+}
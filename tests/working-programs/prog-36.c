@@ -0,0 +1,29 @@
+int cmp (int a, int b) {
+    int x = a < b;
+    int y = a == b;
+    int z = !(a >= b);
+    int w = (a > b) ? -1 : 0;
+    printf ("%d %d %d ", x, y, z);
+    printf ("%d ", w);
+    printf ("%d ", (a <= b) ? 10 : 2);
+    printf ("%d ", (a != b) ? 3 : 7);
+    printf ("%d\n", (a < b) ? 5 : 1);
+    return a > b;
+}
+
+int sign (int x) {
+    return (x > 0) - (x < 0);
+}
+
+int main () {
+    int i;
+    int j;
+    int n = 0;
+    for (i = -2; i < 3; i++)
+	for (j = -1; j < 2; j++)
+	    n = n + cmp (i, j);
+    printf ("%d\n", n);
+    for (i = -2; i < 3; i++)
+	printf ("%d\n", sign (i * 7));
+    return 0;
+}
@@ -0,0 +1,80 @@
+static int run (int op, int acc, int arg) {
+    switch (op) {
+    case 0: acc = acc + arg; break;
+    case 1: acc = acc - arg; break;
+    case 2: acc = acc * arg; break;
+    case 3: acc = acc / arg; break;
+    case 4: acc = acc % arg; break;
+    case 6: acc = -acc; break;
+    case 7:
+    case 8: acc = acc + 1000;
+    case 9: acc = acc + 1; break;
+    default: acc = 0;
+    }
+    return acc;
+}
+
+static inline int kind (int c) {
+    switch (c) {
+    case 32: case 9: case 10: case 13:
+	return 1;
+    case 40: case 41: case 44:
+	return 2;
+    case 59:
+	return 3;
+    }
+    return 0;
+}
+
+int sparse (int x) {
+    switch (x) {
+    case -1000: return 1;
+    case 5: return 2;
+    case 100: return 3;
+    case 1000: return 4;
+    case 100000: return 5;
+    case 7777777: return 6;
+    case -7: return 7;
+    case 3 * 4 - 1: return 8;
+    }
+    return 0;
+}
+
+int main () {
+    int i;
+    int j;
+    int acc = 1;
+    for (i = -1; i < 12; i++) {
+	acc = run (i, acc, 3);
+	printf ("%d\n", acc);
+    }
+    for (i = 0; i < 64; i++)
+	printf ("%d", kind (i));
+    printf ("\n");
+    for (i = -1001; i < 1002; i++)
+	if (sparse (i))
+	    printf ("%d %d\n", i, sparse (i));
+    printf ("%d ", sparse (100000));
+    printf ("%d\n", sparse (7777777));
+    for (i = 0; i < 5; i++) {
+	for (j = 0; j < 5; j++) {
+	    if (j == 3)
+		break;
+	    switch (j) {
+	    case 1: printf ("a"); break;
+	    default: printf ("b");
+	    }
+	}
+	do {
+	    switch (i) {
+	    case 2: break;
+	    }
+	    if (i == 3)
+		break;
+	    printf ("%d\n", i);
+	} while (0);
+	if (i == 4)
+	    break;
+    }
+    return 0;
+}
@@ -0,0 +1,65 @@
+#ifdef GCC
+#define label_t void *
+#endif
+
+int run (int n) {
+    int prog[8];
+    label_t table[4];
+    int pc = 0;
+    int acc = 0;
+    table[0] = &&op_inc;
+    table[1] = &&op_dbl;
+    table[2] = &&op_loop;
+    table[3] = &&op_halt;
+    prog[0] = 0;
+    prog[1] = 1;
+    prog[2] = 0;
+    prog[3] = 2;
+    prog[4] = 3;
+    goto *table[prog[pc]];
+op_inc:
+    acc++;
+    pc++;
+    goto *table[prog[pc]];
+op_dbl:
+    acc = acc * 2;
+    pc++;
+    goto *table[prog[pc]];
+op_loop:
+    n--;
+    if (n > 0)
+	pc = 0;
+    else
+	pc++;
+    goto *table[prog[pc]];
+op_halt:
+    return acc;
+}
+
+int pick (int x) {
+    label_t l = x ? &&yes : &&no;
+    goto *l;
+yes:
+    return 10;
+no:
+    return 20;
+}
+
+int only (int x) {
+    label_t l = &&done;
+    x = x * 3;
+    goto *l;
+    x = 0;
+done:
+    return x;
+}
+
+int main () {
+    int i;
+    for (i = 1; i < 5; i++)
+	printf ("%d\n", run (i));
+    printf ("%d\n", pick (1));
+    printf ("%d\n", pick (0));
+    printf ("%d\n", only (7));
+    return 0;
+}
@@ -0,0 +1,70 @@
+int calls (int n) {
+    printf ("call %d\n", n);
+    return n;
+}
+
+int in_range (int x, int lo, int hi) {
+    return x >= lo && x <= hi;
+}
+
+int outside (int x, int lo, int hi) {
+    return x < lo || x > hi;
+}
+
+int find (int n, int x) {
+    int i = 0;
+    int a[8];
+    for (i = 0; i < 8; i++)
+	a[i] = i * 3;
+    i = 0;
+    while (i < n && a[i] != x)
+	i++;
+    return i;
+}
+
+int guarded (int c, int n) {
+    return c ? (calls (n) && calls (n + 1)) : 0;
+}
+
+int main () {
+    int i;
+    int j;
+    int t;
+    for (i = 0; i < 4; i++) {
+	t = calls (i) && calls (i + 10);
+	printf ("and %d\n", t);
+	t = calls (i - 1) || calls (i + 20);
+	printf ("or %d\n", t);
+	if (i > 1 && calls (i * 2) > 4)
+	    printf ("both %d\n", i);
+	if (!(i == 0 || calls (i) == 2))
+	    printf ("neither %d\n", i);
+    }
+    for (i = -2; i < 12; i++) {
+	printf ("%d ", in_range (i, 0, 9));
+	printf ("%d ", outside (i, 3, 6));
+	t = !(i & 1) && (i > 4 || i < 0);
+	printf ("%d\n", t);
+    }
+    for (i = 0; i < 12; i++)
+	printf ("%d\n", find (8, i));
+    j = 0;
+    for (i = 0; i < 10 && j < 20; i++)
+	j = j + i;
+    printf ("%d %d\n", i, j);
+    i = 0;
+    do
+	i++;
+    while (i < 5 || i % 7);
+    printf ("%d\n", i);
+    printf ("%d %d\n", 3 && 0, 0 || -1);
+    for (i = 0; i < 3; i++) {
+	t = i ? (calls (i) && calls (i + 1)) : 7;
+	printf ("arm %d\n", t);
+	t = i > 1 || (i ? calls (i + 30) || calls (i + 40) : 0);
+	printf ("nested %d\n", t);
+	printf ("%d\n", guarded (i, i * 5));
+	i == 1 ? calls (50) && calls (51) : calls (52);
+    }
+    return 0;
+}
@@ -0,0 +1,42 @@
+#ifdef GCC
+#define at(p, n) ((p)[n])
+#else
+#define at(p, n) (*((p) + (n) * 8))
+#endif
+
+int main () {
+    int a[16];
+    int b[16];
+    int i;
+    int j;
+    int t;
+    for (i = 0; i < 16; i++) {
+	a[i] = i * i;
+	at (b, i) = 100 - i;
+    }
+    for (i = 0; i + 2 < 16; i++)
+	printf ("%d %d %d\n", a[i + 2] - a[i], at (b, i + 1), at (a, i) + b[i + 2]);
+    printf ("%d %d %d\n", a[3], at (b, 5), at (a, 15));
+    a[4] = 7;
+    at (b, 6) = a[4] * 3;
+    a[5]++;
+    at (b, 7)--;
+    printf ("%d %d %d %d\n", a[4], b[6], a[5], b[7]);
+    /* A record of three fields laid out in each group of four. */
+    for (i = 0; i < 4; i++) {
+	at (b, i * 4) = i;
+	at (b, i * 4 + 1) = i * 10;
+	at (b, i * 4 + 2) = at (b, i * 4) + at (b, i * 4 + 1);
+    }
+    t = 0;
+    for (i = 0; i < 4; i++)
+	t = t + at (b, i * 4 + 2);
+    printf ("%d\n", t);
+    j = 3;
+    for (i = 0; i < 8; i++)
+	a[i + j] = a[i] + a[j - 1];
+    for (i = 0; i < 16; i++)
+	printf ("%d ", a[i]);
+    printf ("\n");
+    return 0;
+}
@@ -0,0 +1,52 @@
+#ifdef GCC
+#define ptr_t int *
+#else
+#define ptr_t int
+#endif
+
+int bump (ptr_t p, int by) {
+    *p = *p + by;
+    return *p;
+}
+
+int main () {
+    int x;
+    int y;
+    int i;
+    int t;
+    ptr_t p;
+    ptr_t q;
+    int a[8];
+    p = &x;
+    q = &y;
+    x = 5;
+    y = x + 1;
+    printf ("%d %d\n", x, y);
+    *p = 7;
+    printf ("%d %d\n", x, *p + y);
+    *q = x * 3;
+    printf ("%d %d\n", y, *q);
+    x = 9;
+    y = 2;
+    printf ("%d %d %d\n", x, y, *p);
+    t = bump (p, 4);
+    printf ("%d %d\n", t, x);
+    for (i = 0; i < 8; i++) {
+	a[i] = i * 7;
+	x = a[i] + 1;
+	if (i % 3 == 0)
+	    *p = 100;
+	printf ("%d %d %d\n", a[i], x, *p);
+    }
+    for (i = 0; i < 8; i++) {
+	if (i & 1)
+	    p = &y;
+	else
+	    p = &x;
+	x = i;
+	y = -i;
+	*p = *p * 2;
+	printf ("%d %d\n", x, y);
+    }
+    return 0;
+}
@@ -0,0 +1,25 @@
+#ifdef GCC
+#define ptr_t int *
+#else
+#define ptr_t int
+#endif
+
+int size (int n) {
+    return n * 8;
+}
+
+int fill (ptr_t p) {
+    *p = 42;
+    return *p;
+}
+
+int scratch () {
+    return fill (__builtin_alloca (size (3)));
+}
+
+int main () {
+    int i;
+    for (i = 0; i < 3; i++)
+	printf ("%d\n", scratch () + i);
+    return 0;
+}
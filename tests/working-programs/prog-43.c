@@ -0,0 +1,24 @@
+/* Enough values are kept in registers while dividing that the last
+   of them lands in %rdx. */
+
+int divide (int n, int d) {
+    return n * 3 - (n * 5 - (n * 7 - (n * 9 - (n * 11 - (n * 13 - (n * 15
+	- (n * 17 - (n * 27 / d + n * 29 % (d + n)))))))));
+}
+
+int divide_const (int n) {
+    return n * 3 - (n * 5 - (n * 7 - (n * 9 - (n * 11 - (n * 13 - (n * 15
+	- (n * 27 / 7 + n * 29 % 7)))))));
+}
+
+int main () {
+    int i;
+    int t;
+    for (i = -9; i < 10; i++) {
+	t = divide (i, i * i + 4);
+	printf ("%d ", t);
+	t = divide_const (i);
+	printf ("%d\n", t);
+    }
+    return 0;
+}
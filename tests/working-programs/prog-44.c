@@ -0,0 +1,8 @@
+int main () {
+    int i;
+    printf ("%d\n", 7 * 11);
+    printf ("%d %d\n", 13 * -7, -11 * 1000);
+    for (i = 0; i < 3; i++)
+	printf ("%d\n", i + 7 * 11 * 13);
+    return 0;
+}
@@ -0,0 +1,75 @@
+int twice (int x) {
+    return x + x;
+}
+
+int sequence (int n) {
+    int a;
+    int b;
+    int c;
+    int d;
+    a = twice (n);
+    printf ("%d\n", a);
+    b = twice (a + 1);
+    printf ("%d\n", b);
+    c = twice (b + 1);
+    printf ("%d\n", c);
+    d = twice (c + 1);
+    return d;
+}
+
+int swapping (int n) {
+    int x;
+    int y;
+    int t;
+    int i;
+    x = 1;
+    y = n;
+    for (i = 0; i < 5; i++) {
+	t = x;
+	x = y;
+	y = t + x;
+    }
+    return x * 100 + y;
+}
+
+int escaped (int n) {
+    int a;
+    int b;
+    int sum;
+    a = twice (n);
+    sum = a;
+    scanf ("", &b);
+    b = twice (sum);
+    sum = sum + b;
+    return sum;
+}
+
+int looped (int n) {
+    int i;
+    int j;
+    int total;
+    int s;
+    total = 0;
+    for (i = 0; i < n; i++) {
+	s = i * 3;
+	total = total + s;
+    }
+    for (j = 0; j < n; j++) {
+	s = twice (j);
+	total = total - s;
+    }
+    return total;
+}
+
+int main () {
+    int r;
+    r = sequence (3);
+    printf ("%d\n", r);
+    r = swapping (2);
+    printf ("%d\n", r);
+    r = escaped (5);
+    printf ("%d\n", r);
+    r = looped (10);
+    printf ("%d\n", r);
+    return 0;
+}
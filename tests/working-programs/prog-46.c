@@ -0,0 +1,36 @@
+int show (int x) {
+    printf ("%d\n", x);
+    return x;
+}
+
+int main () {
+    int a = 1;
+    int b = 2;
+    int c = 3;
+    int d = 4;
+    int e = 5;
+    int f = 6;
+    int r;
+
+    r = a + (b + (c + (d + (e + (f + (a + (b + (c + (d + (e + (f
+	+ (a + (b + (c + d))))))))))))));
+    printf ("%d\n", r);
+    r = a * b + (c * d + (e * f + (a * c + (b * d + (c * e + (d * f
+	+ (e * a + (f * b + (a * d + (b * e + (c * f + (d * a + (e * b
+	+ (f * c + (a * e + b * f)))))))))))))));
+    printf ("%d\n", r);
+    r = (a | (b ^ (c & (d | (e ^ (f & (a | (b ^ (c & (d | (e ^ f)))))))))));
+    printf ("%d\n", r);
+    if (a < b + (c + (d + (e + (f + (a + (b + (c + (d + (e + f))))))))))
+	printf ("less\n");
+    if (a * f > b * (c + (d * (e + (f * (a + (b * (c + d))))))))
+	printf ("greater\n");
+    else
+	printf ("not greater\n");
+
+    /* The calls don't keep the registers that hold the other operands
+       yet, so only the order that they are made in is printed. */
+    r = show (1) + (show (2) + (show (3) * (show (4) + show (5))));
+    r = a + (show (6) + (b * (show (7) + (c + show (8)))));
+    return 0;
+}
@@ -0,0 +1,49 @@
+int sign (int x) {
+    if (x > 0)
+	goto positive;
+    if (x < 0)
+	goto negative;
+    return 0;
+  positive:
+    return 1;
+  negative:
+    return -1;
+}
+
+int halvings (int x) {
+    int n = 0;
+    goto start;
+  again:
+    n++;
+  start:
+    if (x > 1) {
+	x = x / 2;
+	goto again;
+    }
+    goto done;
+  done:
+    return n;
+}
+
+int pick (int x) {
+    int r = 20;
+    if (x == 1) {
+	r = 10;
+	goto out;
+    }
+    r = r + 5;
+  out:
+    r = r + x;
+    return r;
+}
+
+int main () {
+    int i;
+    for (i = -2; i <= 3; i++) {
+	int s = sign (i);
+	int h = halvings (i * 7);
+	int p = pick (i);
+	printf ("%d %d %d %d\n", i, s, h, p);
+    }
+    return 0;
+}
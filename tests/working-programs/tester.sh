@@ -31,16 +31,17 @@ run "the regular C compiler could not create an executable" [ -x $prog ] && \
     run "the regular C compiler's executable failed" $prog > $nativeout
 
 mycompile () {    
-    run "could not compile $srcfile with options: $@" \
+    run "could not compile $srcfile with options: $*" \
 	$COMPILER $@ -o $prog $srcfile
 
-    run "the program is not runable with options: $@" [ -x $prog ] && \
-	run "the program failed to run with options: $@" $prog > $myout
+    run "the program is not runable with options: $*" [ -x $prog ] && \
+	run "the program failed to run with options: $*" $prog > $myout
 
-    run "different output with options: $@" \
+    run "different output with options: $*" \
 	cmp $myout $nativeout
 }
 
 mycompile
 mycompile -O
+mycompile -O -fomit-frame-pointer
 die 0